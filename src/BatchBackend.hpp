@@ -0,0 +1,473 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(BATCHBACKEND_HPP)
+#define BATCHBACKEND_HPP
+
+#include <runProgram.hpp>
+#include <which.hpp>
+#include <Launcher.hpp>
+
+#include <libmaus2/util/ArgParser.hpp>
+#include <libmaus2/util/WriteableString.hpp>
+#include <libmaus2/util/stringFunctions.hpp>
+#include <libmaus2/aio/OutputStreamInstance.hpp>
+#include <libmaus2/aio/FileRemoval.hpp>
+#include <libmaus2/exception/LibMausException.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <map>
+#include <set>
+#include <sstream>
+
+/*
+ * resources and command line of a worker job
+ */
+struct BatchJobRequest
+{
+	std::string jobname;
+	// file receiving the standard output and error channels of the job
+	std::string outfn;
+	// prefix for files the backend may create while submitting
+	std::string tmpbase;
+	// run time limit in minutes
+	uint64_t time;
+	// memory limit in MB
+	uint64_t mem;
+	uint64_t threads;
+	std::string partition;
+	// program followed by its arguments
+	std::vector < std::string > command;
+
+	BatchJobRequest() {}
+	BatchJobRequest(
+		std::string const & rjobname,
+		std::string const & routfn,
+		std::string const & rtmpbase,
+		uint64_t const rtime,
+		uint64_t const rmem,
+		uint64_t const rthreads,
+		std::string const & rpartition,
+		std::vector < std::string > const & rcommand
+	) : jobname(rjobname), outfn(routfn), tmpbase(rtmpbase), time(rtime), mem(rmem), threads(rthreads), partition(rpartition), command(rcommand)
+	{
+	}
+
+	std::string getCommandLine() const
+	{
+		std::ostringstream ostr;
+		for ( uint64_t i = 0; i < command.size(); ++i )
+			ostr << (i ? " " : "") << command[i];
+		return ostr.str();
+	}
+};
+
+/*
+ * interface for starting, stopping and inspecting worker jobs. submit
+ * returns an id which the worker reports back to hpcschedcontrol when it
+ * connects.
+ */
+struct BatchBackend
+{
+	typedef BatchBackend this_type;
+	typedef libmaus2::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	enum job_state
+	{
+		job_state_pending,
+		job_state_running,
+		job_state_finished,
+		job_state_unknown
+	};
+
+	virtual ~BatchBackend() {}
+	virtual uint64_t submit(BatchJobRequest const & req) = 0;
+
+	/*
+	 * submit n workers with the same resources. The output file names of
+	 * the tasks are derived from req.outfn. Returns the ids of the tasks
+	 * submitted, which may be fewer than n if submission failed part way.
+	 * The default implementation submits the tasks one by one.
+	 */
+	virtual std::vector < uint64_t > submitArray(BatchJobRequest const & req, uint64_t const n)
+	{
+		std::vector < uint64_t > V;
+
+		for ( uint64_t i = 0; i < n; ++i )
+		{
+			BatchJobRequest treq = req;
+			std::ostringstream suffixstr;
+			suffixstr << "_" << i;
+			treq.outfn += suffixstr.str();
+			treq.tmpbase += suffixstr.str();
+
+			try
+			{
+				V.push_back(submit(treq));
+			}
+			catch(std::exception const & ex)
+			{
+				if ( V.size() )
+				{
+					std::cerr << "[W] submission stopped after " << V.size() << " out of " << n << " workers:\n" << ex.what() << std::endl;
+					break;
+				}
+				else
+					throw;
+			}
+		}
+
+		return V;
+	}
+
+	virtual void cancel(uint64_t const id) = 0;
+	virtual job_state query(uint64_t const id) = 0;
+	virtual std::string getName() const = 0;
+
+	static unique_ptr_type construct(std::string const & name, libmaus2::util::ArgParser const & arg);
+};
+
+/*
+ * SLURM backend using the sbatch, scancel and squeue programs. Several
+ * workers are submitted as a job array. Array tasks are identified by
+ * the array job id in the upper and the task id in the lower 32 bits,
+ * ids of plain jobs are below 2^32.
+ */
+struct SlurmBatchBackend : public BatchBackend
+{
+	libmaus2::util::ArgParser const & arg;
+	// maximum number of tasks per job array
+	uint64_t const maxarraysize;
+	// time in milliseconds after which sbatch, scancel and squeue are killed
+	int64_t const calltimeout;
+
+	SlurmBatchBackend(libmaus2::util::ArgParser const & rarg)
+	: arg(rarg), maxarraysize(arg.uniqueArgPresent("maxarraysize") ? std::max(arg.getParsedArg<uint64_t>("maxarraysize"),static_cast<uint64_t>(1)) : 1000),
+	  calltimeout(arg.uniqueArgPresent("batchtimeout") ? arg.getParsedArg<int64_t>("batchtimeout") : 120000)
+	{
+	}
+
+	static uint64_t getArrayTaskId(uint64_t const arrayjobid, uint64_t const taskid)
+	{
+		return (arrayjobid << 32) | taskid;
+	}
+
+	// job specification understood by scancel and squeue
+	static std::string getJobSpec(uint64_t const id)
+	{
+		std::ostringstream ostr;
+		if ( id >> 32 )
+			ostr << (id >> 32) << "_" << (id & 0xFFFFFFFFull);
+		else
+			ostr << id;
+		return ostr.str();
+	}
+
+	static void writeJobDescription(std::string const & fn, BatchJobRequest const & req, uint64_t const arraysize)
+	{
+		libmaus2::aio::OutputStreamInstance OSI(fn);
+
+		OSI << "#!/bin/bash\n";
+		OSI << "#SBATCH --job-name=" << req.jobname << "\n";
+		if ( arraysize )
+		{
+			OSI << "#SBATCH --array=0-" << arraysize-1 << "\n";
+			OSI << "#SBATCH --output=" << req.outfn << "_%a\n";
+		}
+		else
+		{
+			OSI << "#SBATCH --output=" << req.outfn << "\n";
+		}
+		OSI << "#SBATCH --ntasks=1" << "\n";
+		OSI << "#SBATCH --time=" << req.time << "\n";
+		OSI << "#SBATCH --mem=" << req.mem << "\n";
+		OSI << "#SBATCH --cpus-per-task=" << req.threads << "\n";
+		OSI << "#SBATCH --partition=" << req.partition << "\n";
+		OSI << "srun bash -c \"" << req.getCommandLine() << "\"\n";
+	}
+
+	// run sbatch and return the (array) job id
+	uint64_t sbatch(BatchJobRequest const & req, uint64_t const arraysize)
+	{
+		std::string const descname = req.tmpbase + "_worker.sbatch";
+
+		writeJobDescription(descname,req,arraysize);
+
+		std::vector<std::string> Varg;
+		Varg.push_back("sbatch");
+		Varg.push_back(descname);
+
+		std::string const jobid_s = runProgram(Varg,arg,calltimeout);
+
+		libmaus2::aio::FileRemoval::removeFile(descname);
+
+		// sbatch prints "Submitted batch job <id>"
+		std::deque<std::string> Vtoken = libmaus2::util::stringFunctions::tokenize(jobid_s,std::string(" "));
+
+		if ( Vtoken.size() >= 4 )
+		{
+			std::istringstream istr(Vtoken[3]);
+			uint64_t id;
+			istr >> id;
+
+			if ( istr && istr.peek() == '\n' )
+				return id;
+		}
+
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] unable to find job id in " << jobid_s << std::endl;
+		lme.finish();
+		throw lme;
+	}
+
+	uint64_t submit(BatchJobRequest const & req)
+	{
+		return sbatch(req,0);
+	}
+
+	std::vector < uint64_t > submitArray(BatchJobRequest const & req, uint64_t const n)
+	{
+		std::vector < uint64_t > V;
+
+		if ( n == 1 )
+		{
+			BatchJobRequest treq = req;
+			treq.outfn += "_0";
+			V.push_back(submit(treq));
+			return V;
+		}
+
+		for ( uint64_t low = 0; low < n; low += maxarraysize )
+		{
+			uint64_t const high = std::min(low+maxarraysize,n);
+
+			// each array numbers its tasks from 0
+			BatchJobRequest treq = req;
+			std::ostringstream suffixstr;
+			suffixstr << "_" << low;
+			treq.outfn += suffixstr.str();
+			treq.tmpbase += suffixstr.str();
+
+			uint64_t arrayjobid;
+
+			try
+			{
+				arrayjobid = sbatch(treq,high-low);
+			}
+			catch(std::exception const & ex)
+			{
+				if ( V.size() )
+				{
+					std::cerr << "[W] submission stopped after " << V.size() << " out of " << n << " workers:\n" << ex.what() << std::endl;
+					break;
+				}
+				else
+					throw;
+			}
+
+			for ( uint64_t i = low; i < high; ++i )
+				V.push_back(getArrayTaskId(arrayjobid,i-low));
+		}
+
+		return V;
+	}
+
+	void cancel(uint64_t const id)
+	{
+		std::vector<std::string> Varg;
+		Varg.push_back("scancel");
+		Varg.push_back(getJobSpec(id));
+
+		try
+		{
+			runProgram(Varg,arg,calltimeout);
+		}
+		catch(std::exception const & ex)
+		{
+			std::cerr << "[W] unable to cancel job " << id << ":\n" << ex.what() << std::endl;
+		}
+	}
+
+	job_state query(uint64_t const id)
+	{
+		std::vector<std::string> Varg;
+		Varg.push_back("squeue");
+		Varg.push_back("-h");
+		Varg.push_back("-o");
+		Varg.push_back("%T");
+		Varg.push_back("-j");
+		Varg.push_back(getJobSpec(id));
+
+		std::string state;
+
+		try
+		{
+			state = runProgram(Varg,arg,calltimeout);
+		}
+		catch(std::exception const & ex)
+		{
+			// squeue refuses ids of jobs it no longer knows about
+			if ( std::string(ex.what()).find("Invalid job id") != std::string::npos )
+				return job_state_finished;
+			else
+				return job_state_unknown;
+		}
+
+		while ( state.size() && isspace(state[state.size()-1]) )
+			state.resize(state.size()-1);
+
+		if ( ! state.size() )
+			return job_state_finished;
+		else if ( state == "PENDING" || state == "CONFIGURING" || state == "REQUEUED" || state == "RESIZING" || state == "SUSPENDED" )
+			return job_state_pending;
+		else if ( state == "RUNNING" || state == "COMPLETING" )
+			return job_state_running;
+		else
+			return job_state_finished;
+	}
+
+	std::string getName() const
+	{
+		return "slurm";
+	}
+};
+
+/*
+ * backend running workers as child processes on the local machine. Job
+ * ids are assigned by the backend and passed to the worker via its
+ * --jobid argument. Run time limit and partition are ignored, threads and
+ * memory are passed on as the capacity the worker advertises.
+ */
+struct LocalBatchBackend : public BatchBackend
+{
+	uint64_t nextid;
+	std::map < uint64_t, pid_t > Mpid;
+	std::set < uint64_t > Sfinished;
+
+	LocalBatchBackend() : nextid(1) {}
+
+	~LocalBatchBackend()
+	{
+		reap();
+	}
+
+	// collect exit status of finished workers
+	void reap()
+	{
+		std::vector < uint64_t > Vfinished;
+
+		for ( std::map < uint64_t, pid_t >::const_iterator it = Mpid.begin(); it != Mpid.end(); ++it )
+		{
+			int status = 0;
+			pid_t const r = waitpid(it->second,&status,WNOHANG);
+
+			if ( r == it->second || (r == -1 && errno == ECHILD) )
+				Vfinished.push_back(it->first);
+		}
+
+		for ( uint64_t i = 0; i < Vfinished.size(); ++i )
+		{
+			Mpid.erase(Vfinished[i]);
+			Sfinished.insert(Vfinished[i]);
+		}
+	}
+
+	uint64_t submit(BatchJobRequest const & req)
+	{
+		reap();
+
+		uint64_t const id = nextid++;
+
+		std::vector < std::string > args;
+		args.push_back(req.command.at(0));
+		std::ostringstream jobidstr;
+		jobidstr << "--jobid" << id;
+		args.push_back(jobidstr.str());
+		std::ostringstream threadsstr;
+		threadsstr << "--threads" << req.threads;
+		args.push_back(threadsstr.str());
+		std::ostringstream memstr;
+		memstr << "--mem" << req.mem;
+		args.push_back(memstr.str());
+		for ( uint64_t i = 1; i < req.command.size(); ++i )
+			args.push_back(req.command[i]);
+
+		// the descriptors of hpcschedcontrol are close on exec, so they are not passed on to the worker
+		args[0] = which(args[0]);
+		LaunchRequest lreq(args);
+		lreq.outfn = req.outfn;
+		lreq.errtoout = true;
+		pid_t const pid = Launcher::spawn(lreq);
+
+		Mpid[id] = pid;
+
+		return id;
+	}
+
+	void cancel(uint64_t const id)
+	{
+		std::map < uint64_t, pid_t >::const_iterator const it = Mpid.find(id);
+
+		if ( it != Mpid.end() )
+			::kill(it->second,SIGTERM);
+	}
+
+	job_state query(uint64_t const id)
+	{
+		reap();
+
+		if ( Mpid.find(id) != Mpid.end() )
+			return job_state_running;
+		else if ( Sfinished.find(id) != Sfinished.end() )
+			return job_state_finished;
+		else
+			return job_state_unknown;
+	}
+
+	std::string getName() const
+	{
+		return "local";
+	}
+};
+
+inline BatchBackend::unique_ptr_type BatchBackend::construct(std::string const & name, libmaus2::util::ArgParser const & arg)
+{
+	if ( name == "slurm" )
+	{
+		unique_ptr_type tptr(new SlurmBatchBackend(arg));
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+	else if ( name == "local" )
+	{
+		unique_ptr_type tptr(new LocalBatchBackend);
+		return UNIQUE_PTR_MOVE(tptr);
+	}
+	else
+	{
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] unknown batch backend " << name << " (supported: slurm, local)" << std::endl;
+		lme.finish();
+		throw lme;
+	}
+}
+#endif
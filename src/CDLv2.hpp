@@ -0,0 +1,722 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(CDLV2_HPP)
+#define CDLV2_HPP
+
+#include <libmaus2/util/CommandContainer.hpp>
+#include <libmaus2/util/ContainerDescriptionList.hpp>
+#include <libmaus2/aio/InputStreamInstance.hpp>
+#include <libmaus2/aio/OutputStreamInstance.hpp>
+#include <libmaus2/aio/FileRemoval.hpp>
+#include <libmaus2/exception/LibMausException.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <limits>
+
+/*
+ * version 2 of the container description list (.cdl) file format
+ *
+ * The file consists of a fixed size header followed by these sections
+ *
+ *  - command state table: one CommandState entry per command (mutable)
+ *  - container state table: one ContainerState entry per container (mutable)
+ *  - container table: one ContainerInfo entry per container
+ *  - command table: one CommandInfo entry per command
+ *  - dependencies: numcontainers+1 offsets followed by container ids (CSR)
+ *  - reverse dependencies: same layout as dependencies
+ *  - rule hashes: content hash of the rule of each command (optional)
+ *  - blob section: serialised libmaus2::util::Command objects
+ *
+ * All numbers are stored in native byte order, the header contains a byte
+ * order mark. The whole file is mapped into memory by readers. State changes
+ * are made in place in the state tables, the other sections are read only.
+ * The numattempts and completed fields stored in the serialised commands are
+ * ignored, the state table is authoritative. Files without rule hashes
+ * have hashoffset 0 in the header.
+ */
+struct CDLv2
+{
+	typedef CDLv2 this_type;
+	typedef libmaus2::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	static char const * getMagic()
+	{
+		return "HPCSCDL2";
+	}
+
+	static uint64_t getByteOrderMark()
+	{
+		return 0x0102030405060708ull;
+	}
+
+	static uint64_t getVersion()
+	{
+		return 2;
+	}
+
+	struct Header
+	{
+		char magic[8];
+		uint64_t byteorder;
+		uint64_t version;
+		uint64_t numcontainers;
+		uint64_t numcommands;
+		uint64_t commandstateoffset;
+		uint64_t containerstateoffset;
+		uint64_t containerinfooffset;
+		uint64_t commandinfooffset;
+		uint64_t depoffset;
+		uint64_t rdepoffset;
+		uint64_t bloboffset;
+		uint64_t blobsize;
+		uint64_t hashoffset;
+		uint64_t reserved[2];
+	};
+
+	struct CommandState
+	{
+		uint32_t numattempts;
+		uint8_t completed;
+		uint8_t pad[3];
+	};
+
+	struct ContainerState
+	{
+		uint32_t missingdep;
+		uint32_t attempt;
+	};
+
+	struct ContainerInfo
+	{
+		uint64_t id;
+		uint64_t threads;
+		uint64_t mem;
+		uint64_t maxattempt;
+		// index of first command in command tables
+		uint64_t firstcommand;
+		uint64_t numcommands;
+		// user assigned priority, larger values are scheduled first
+		int64_t priority;
+		// retention of command output as given by LogPolicy::encode (0 keeps all output)
+		uint64_t logpolicy;
+	};
+
+	enum command_flags
+	{
+		command_flag_ignorefail = 1,
+		command_flag_deepsleep = 2,
+		command_flag_modcall = 4,
+		// command is started after the previous command of its container has completed
+		command_flag_sequence = 8
+	};
+
+	struct CommandInfo
+	{
+		uint64_t bloboffset;
+		uint64_t bloblength;
+		uint64_t maxattempts;
+		uint32_t flags;
+		uint32_t reserved;
+	};
+
+	std::string const fn;
+	bool const writable;
+	int fd;
+	uint8_t * base;
+	uint64_t size;
+
+	Header const * header;
+	CommandState * commandstate;
+	ContainerState * containerstate;
+	ContainerInfo const * containerinfo;
+	CommandInfo const * commandinfo;
+	uint64_t const * depoff;
+	uint64_t const * dep;
+	uint64_t const * rdepoff;
+	uint64_t const * rdep;
+	uint64_t const * hashes;
+	char const * blob;
+
+	static bool isCDLv2(std::string const & fn)
+	{
+		libmaus2::aio::InputStreamInstance ISI(fn);
+		char magic[8];
+		ISI.read(&magic[0],sizeof(magic));
+		return ISI.gcount() == static_cast<std::streamsize>(sizeof(magic)) && std::equal(&magic[0],&magic[sizeof(magic)],getMagic());
+	}
+
+	CDLv2(std::string const & rfn, bool const rwritable = false)
+	: fn(rfn), writable(rwritable), fd(-1), base(0), size(0)
+	{
+		while ( (fd = ::open(fn.c_str(),(writable ? O_RDWR : O_RDONLY) | O_CLOEXEC)) < 0 )
+		{
+			int const error = errno;
+
+			switch ( error )
+			{
+				case EINTR:
+				case EAGAIN:
+					break;
+				default:
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] CDLv2: unable to open " << fn << ": " << strerror(error) << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+		}
+
+		struct stat sb;
+		if ( ::fstat(fd,&sb) != 0 )
+		{
+			int const error = errno;
+			::close(fd);
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] CDLv2: fstat on " << fn << " failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+		size = sb.st_size;
+
+		if ( size < sizeof(Header) )
+		{
+			::close(fd);
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] CDLv2: file " << fn << " is too short" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		void * p = ::mmap(0,size,writable ? (PROT_READ|PROT_WRITE) : PROT_READ,MAP_SHARED,fd,0);
+
+		if ( p == MAP_FAILED )
+		{
+			int const error = errno;
+			::close(fd);
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] CDLv2: mmap on " << fn << " failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		base = reinterpret_cast<uint8_t *>(p);
+		header = reinterpret_cast<Header const *>(base);
+
+		try
+		{
+			checkHeader();
+
+			commandstate = reinterpret_cast<CommandState *>(base + header->commandstateoffset);
+			containerstate = reinterpret_cast<ContainerState *>(base + header->containerstateoffset);
+			containerinfo = reinterpret_cast<ContainerInfo const *>(base + header->containerinfooffset);
+			commandinfo = reinterpret_cast<CommandInfo const *>(base + header->commandinfooffset);
+			depoff = reinterpret_cast<uint64_t const *>(base + header->depoffset);
+			dep = depoff + (header->numcontainers+1);
+			rdepoff = reinterpret_cast<uint64_t const *>(base + header->rdepoffset);
+			rdep = rdepoff + (header->numcontainers+1);
+			hashes = header->hashoffset ? reinterpret_cast<uint64_t const *>(base + header->hashoffset) : 0;
+			blob = reinterpret_cast<char const *>(base + header->bloboffset);
+
+			checkTables();
+		}
+		catch(...)
+		{
+			::munmap(base,size);
+			::close(fd);
+			throw;
+		}
+	}
+
+	~CDLv2()
+	{
+		::munmap(base,size);
+		::close(fd);
+	}
+
+	void throwInvalid(char const * what) const
+	{
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] CDLv2: file " << fn << " is invalid (" << what << ")" << std::endl;
+		lme.finish();
+		throw lme;
+	}
+
+	/*
+	 * check whether n elements of size elsize starting at offset off fit
+	 * into the file (without overflowing) and are suitably aligned
+	 */
+	bool sectionFits(uint64_t const off, uint64_t const n, uint64_t const elsize, uint64_t const align) const
+	{
+		return off <= size && (off % align) == 0 && n <= (size - off) / elsize;
+	}
+
+	// check the header and that all sections given by it lie inside the file
+	void checkHeader() const
+	{
+		if (
+			!std::equal(&header->magic[0],&header->magic[sizeof(header->magic)],getMagic())
+			||
+			header->byteorder != getByteOrderMark()
+			||
+			header->version != getVersion()
+		)
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] CDLv2: file " << fn << " has an invalid or unsupported header" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		uint64_t const numcontainers = header->numcontainers;
+		uint64_t const numcommands = header->numcommands;
+
+		if ( ! sectionFits(header->commandstateoffset,numcommands,sizeof(CommandState),sizeof(uint64_t)) )
+			throwInvalid("command state table");
+		if ( ! sectionFits(header->containerstateoffset,numcontainers,sizeof(ContainerState),sizeof(uint64_t)) )
+			throwInvalid("container state table");
+		if ( ! sectionFits(header->containerinfooffset,numcontainers,sizeof(ContainerInfo),sizeof(uint64_t)) )
+			throwInvalid("container table");
+		if ( ! sectionFits(header->commandinfooffset,numcommands,sizeof(CommandInfo),sizeof(uint64_t)) )
+			throwInvalid("command table");
+		// offset arrays of numcontainers+1 entries
+		if ( numcontainers == std::numeric_limits<uint64_t>::max() )
+			throwInvalid("number of containers");
+		if ( ! sectionFits(header->depoffset,numcontainers+1,sizeof(uint64_t),sizeof(uint64_t)) )
+			throwInvalid("dependency offsets");
+		if ( ! sectionFits(header->rdepoffset,numcontainers+1,sizeof(uint64_t),sizeof(uint64_t)) )
+			throwInvalid("reverse dependency offsets");
+		if ( header->hashoffset && ! sectionFits(header->hashoffset,numcommands,sizeof(uint64_t),sizeof(uint64_t)) )
+			throwInvalid("rule hashes");
+		if ( ! sectionFits(header->bloboffset,header->blobsize,1,1) )
+			throwInvalid("blob section");
+	}
+
+	// check dependency lists, command ranges of containers and blob ranges of commands
+	void checkTables() const
+	{
+		uint64_t const numcontainers = header->numcontainers;
+		uint64_t const numcommands = header->numcommands;
+		uint64_t const depbase = header->depoffset + (numcontainers+1) * sizeof(uint64_t);
+		uint64_t const rdepbase = header->rdepoffset + (numcontainers+1) * sizeof(uint64_t);
+
+		if ( ! sectionFits(depbase,depoff[numcontainers],sizeof(uint64_t),sizeof(uint64_t)) )
+			throwInvalid("dependencies");
+		if ( ! sectionFits(rdepbase,rdepoff[numcontainers],sizeof(uint64_t),sizeof(uint64_t)) )
+			throwInvalid("reverse dependencies");
+
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+		{
+			if ( depoff[i] > depoff[i+1] )
+				throwInvalid("dependency offsets");
+			if ( rdepoff[i] > rdepoff[i+1] )
+				throwInvalid("reverse dependency offsets");
+
+			ContainerInfo const & CI = containerinfo[i];
+			if ( CI.firstcommand > numcommands || CI.numcommands > numcommands - CI.firstcommand )
+				throwInvalid("command range of container");
+		}
+
+		for ( uint64_t i = 0; i < depoff[numcontainers]; ++i )
+			if ( dep[i] >= numcontainers )
+				throwInvalid("dependency id");
+		for ( uint64_t i = 0; i < rdepoff[numcontainers]; ++i )
+			if ( rdep[i] >= numcontainers )
+				throwInvalid("reverse dependency id");
+
+		for ( uint64_t i = 0; i < numcommands; ++i )
+		{
+			CommandInfo const & CI = commandinfo[i];
+			if ( CI.bloboffset > header->blobsize || CI.bloblength > header->blobsize - CI.bloboffset )
+				throwInvalid("blob range of command");
+		}
+	}
+
+	uint64_t numContainers() const
+	{
+		return header->numcontainers;
+	}
+
+	uint64_t numCommands() const
+	{
+		return header->numcommands;
+	}
+
+	ContainerInfo const & getContainerInfo(uint64_t const i) const
+	{
+		assert ( i < numContainers() );
+		return containerinfo[i];
+	}
+
+	ContainerState & getContainerState(uint64_t const i)
+	{
+		assert ( i < numContainers() );
+		return containerstate[i];
+	}
+
+	// global command index of command j in container i
+	uint64_t getCommandIndex(uint64_t const i, uint64_t const j) const
+	{
+		assert ( j < getContainerInfo(i).numcommands );
+		return getContainerInfo(i).firstcommand + j;
+	}
+
+	CommandInfo const & getCommandInfo(uint64_t const i, uint64_t const j) const
+	{
+		return commandinfo[getCommandIndex(i,j)];
+	}
+
+	bool hasCommandFlag(uint64_t const i, uint64_t const j, command_flags const flag) const
+	{
+		return (getCommandInfo(i,j).flags & flag) != 0;
+	}
+
+	CommandState & getCommandState(uint64_t const i, uint64_t const j)
+	{
+		return commandstate[getCommandIndex(i,j)];
+	}
+
+	CommandState const & getCommandState(uint64_t const i, uint64_t const j) const
+	{
+		return commandstate[getCommandIndex(i,j)];
+	}
+
+	uint64_t numDependencies(uint64_t const i) const
+	{
+		return depoff[i+1]-depoff[i];
+	}
+
+	uint64_t const * getDependencies(uint64_t const i) const
+	{
+		return dep + depoff[i];
+	}
+
+	uint64_t numReverseDependencies(uint64_t const i) const
+	{
+		return rdepoff[i+1]-rdepoff[i];
+	}
+
+	uint64_t const * getReverseDependencies(uint64_t const i) const
+	{
+		return rdep + rdepoff[i];
+	}
+
+	bool hasHashes() const
+	{
+		return hashes != 0;
+	}
+
+	// content hash of the rule of command j in container i (see RuleSet::getHash)
+	uint64_t getHash(uint64_t const i, uint64_t const j) const
+	{
+		assert ( hasHashes() );
+		return hashes[getCommandIndex(i,j)];
+	}
+
+	std::string getCommandBlob(uint64_t const i, uint64_t const j) const
+	{
+		CommandInfo const & CI = getCommandInfo(i,j);
+		return std::string(blob + CI.bloboffset, blob + CI.bloboffset + CI.bloblength);
+	}
+
+	libmaus2::util::Command getCommand(uint64_t const i, uint64_t const j) const
+	{
+		std::istringstream istr(getCommandBlob(i,j));
+		libmaus2::util::Command C(istr);
+		CommandState const & CS = getCommandState(i,j);
+		C.numattempts = CS.numattempts;
+		C.completed = CS.completed;
+		return C;
+	}
+
+	libmaus2::util::CommandContainer getContainer(uint64_t const i) const
+	{
+		ContainerInfo const & CI = getContainerInfo(i);
+
+		libmaus2::util::CommandContainer CC;
+		CC.id = CI.id;
+		CC.threads = CI.threads;
+		CC.mem = CI.mem;
+		CC.depid = std::vector<uint64_t>(getDependencies(i),getDependencies(i)+numDependencies(i));
+		CC.rdepid = std::vector<uint64_t>(getReverseDependencies(i),getReverseDependencies(i)+numReverseDependencies(i));
+		CC.attempt = containerstate[i].attempt;
+		CC.maxattempt = CI.maxattempt;
+		for ( uint64_t j = 0; j < CI.numcommands; ++j )
+			CC.V.push_back(getCommand(i,j));
+
+		return CC;
+	}
+
+	/*
+	 * write back modified state tables. If blocking is set then the call
+	 * returns after the data has reached the disk.
+	 */
+	void sync(bool const blocking)
+	{
+		if ( ! writable )
+			return;
+
+		uint64_t const pagesize = ::sysconf(_SC_PAGESIZE);
+		uint64_t const low = std::min(header->commandstateoffset,header->containerstateoffset);
+		uint64_t const high = std::max(
+			header->commandstateoffset + header->numcommands * sizeof(CommandState),
+			header->containerstateoffset + header->numcontainers * sizeof(ContainerState)
+		);
+		uint64_t const alow = (low / pagesize) * pagesize;
+
+		while ( ::msync(base + alow, high - alow, blocking ? MS_SYNC : MS_ASYNC) != 0 )
+		{
+			int const error = errno;
+
+			switch ( error )
+			{
+				case EINTR:
+				case EAGAIN:
+					break;
+				default:
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] CDLv2: msync on " << fn << " failed: " << strerror(error) << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+		}
+	}
+
+	static uint32_t getCommandFlags(libmaus2::util::Command const & C)
+	{
+		uint32_t flags = 0;
+		if ( C.ignorefail )
+			flags |= command_flag_ignorefail;
+		if ( C.deepsleep )
+			flags |= command_flag_deepsleep;
+		if ( C.modcall )
+			flags |= command_flag_modcall;
+		return flags;
+	}
+
+	template<typename type>
+	static void writeArray(std::ostream & out, type const * A, uint64_t const n)
+	{
+		out.write(reinterpret_cast<char const *>(A),n * sizeof(type));
+	}
+
+	/*
+	 * write containers in VCC to out in CDL version 2 format. Vpriority
+	 * contains the priority of each container or is empty (all 0),
+	 * Vlogpolicy the encoded log policy of each container or is empty
+	 * (all 0), Vhash the content hash of each command (in the order of the
+	 * containers) or is empty (no hash section is written). Vsequence
+	 * marks the containers whose commands are run one after the other, it
+	 * may be empty (all commands of a container can run at the same time).
+	 */
+	static void write(
+		std::ostream & out,
+		std::vector < libmaus2::util::CommandContainer > const & VCC,
+		std::vector < int64_t > const & Vpriority,
+		std::vector < uint64_t > const & Vlogpolicy,
+		std::vector < uint64_t > const & Vhash,
+		std::vector < bool > const & Vsequence,
+		uint64_t const
+		#if defined(_OPENMP)
+		numthreads
+		#endif
+	)
+	{
+		uint64_t const numcontainers = VCC.size();
+
+		std::vector < uint64_t > firstcommand(numcontainers+1,0);
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+			firstcommand[i+1] = firstcommand[i] + VCC[i].V.size();
+		uint64_t const numcommands = firstcommand[numcontainers];
+
+		// serialise commands
+		std::vector < std::string > Vblob(numcommands);
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1024)
+		#endif
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+			for ( uint64_t j = 0; j < VCC[i].V.size(); ++j )
+			{
+				std::ostringstream ostr;
+				VCC[i].V[j].serialise(ostr);
+				Vblob[firstcommand[i]+j] = ostr.str();
+			}
+
+		std::vector < uint64_t > depoff(numcontainers+1,0), rdepoff(numcontainers+1,0);
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+		{
+			depoff[i+1] = depoff[i] + VCC[i].depid.size();
+			rdepoff[i+1] = rdepoff[i] + VCC[i].rdepid.size();
+		}
+
+		Header H;
+		std::fill(&H.magic[0],&H.magic[sizeof(H.magic)],0);
+		std::copy(getMagic(),getMagic()+sizeof(H.magic),&H.magic[0]);
+		H.byteorder = getByteOrderMark();
+		H.version = getVersion();
+		H.numcontainers = numcontainers;
+		H.numcommands = numcommands;
+		H.commandstateoffset = sizeof(Header);
+		H.containerstateoffset = H.commandstateoffset + numcommands * sizeof(CommandState);
+		H.containerinfooffset = H.containerstateoffset + numcontainers * sizeof(ContainerState);
+		H.commandinfooffset = H.containerinfooffset + numcontainers * sizeof(ContainerInfo);
+		H.depoffset = H.commandinfooffset + numcommands * sizeof(CommandInfo);
+		H.rdepoffset = H.depoffset + (numcontainers + 1 + depoff[numcontainers]) * sizeof(uint64_t);
+		H.hashoffset = Vhash.size() ? (H.rdepoffset + (numcontainers + 1 + rdepoff[numcontainers]) * sizeof(uint64_t)) : 0;
+		H.bloboffset = H.rdepoffset + (numcontainers + 1 + rdepoff[numcontainers] + (Vhash.size() ? numcommands : 0)) * sizeof(uint64_t);
+		H.blobsize = 0;
+		for ( uint64_t i = 0; i < numcommands; ++i )
+			H.blobsize += Vblob[i].size();
+		std::fill(&H.reserved[0],&H.reserved[sizeof(H.reserved)/sizeof(H.reserved[0])],0);
+
+		writeArray(out,&H,1);
+
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+			for ( uint64_t j = 0; j < VCC[i].V.size(); ++j )
+			{
+				CommandState CS;
+				CS.numattempts = VCC[i].V[j].numattempts;
+				CS.completed = VCC[i].V[j].completed;
+				std::fill(&CS.pad[0],&CS.pad[sizeof(CS.pad)],0);
+				writeArray(out,&CS,1);
+			}
+
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+		{
+			ContainerState CS;
+			CS.missingdep = 0;
+			CS.attempt = VCC[i].attempt;
+			writeArray(out,&CS,1);
+		}
+
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+		{
+			ContainerInfo CI;
+			CI.id = VCC[i].id;
+			CI.threads = VCC[i].threads;
+			CI.mem = VCC[i].mem;
+			CI.maxattempt = VCC[i].maxattempt;
+			CI.firstcommand = firstcommand[i];
+			CI.numcommands = VCC[i].V.size();
+			CI.priority = i < Vpriority.size() ? Vpriority[i] : 0;
+			CI.logpolicy = i < Vlogpolicy.size() ? Vlogpolicy[i] : 0;
+			writeArray(out,&CI,1);
+		}
+
+		uint64_t bloboffset = 0;
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+			for ( uint64_t j = 0; j < VCC[i].V.size(); ++j )
+			{
+				CommandInfo CI;
+				CI.bloboffset = bloboffset;
+				CI.bloblength = Vblob[firstcommand[i]+j].size();
+				CI.maxattempts = VCC[i].V[j].maxattempts;
+				CI.flags = getCommandFlags(VCC[i].V[j]);
+				if ( j && i < Vsequence.size() && Vsequence[i] )
+					CI.flags |= command_flag_sequence;
+				CI.reserved = 0;
+				writeArray(out,&CI,1);
+				bloboffset += CI.bloblength;
+			}
+
+		writeArray(out,depoff.data(),depoff.size());
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+			writeArray(out,VCC[i].depid.data(),VCC[i].depid.size());
+		writeArray(out,rdepoff.data(),rdepoff.size());
+		for ( uint64_t i = 0; i < numcontainers; ++i )
+			writeArray(out,VCC[i].rdepid.data(),VCC[i].rdepid.size());
+		if ( Vhash.size() )
+		{
+			assert ( Vhash.size() == numcommands );
+			writeArray(out,Vhash.data(),Vhash.size());
+		}
+
+		for ( uint64_t i = 0; i < numcommands; ++i )
+			out.write(Vblob[i].c_str(),Vblob[i].size());
+
+		out.flush();
+
+		if ( ! out )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] CDLv2::write: failed to write container description list" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
+
+	static void write(
+		std::string const & fn,
+		std::vector < libmaus2::util::CommandContainer > const & VCC,
+		std::vector < int64_t > const & Vpriority,
+		std::vector < uint64_t > const & Vlogpolicy,
+		std::vector < uint64_t > const & Vhash,
+		std::vector < bool > const & Vsequence,
+		uint64_t const numthreads
+	)
+	{
+		libmaus2::aio::OutputStreamInstance::unique_ptr_type OSI(new libmaus2::aio::OutputStreamInstance(fn));
+		write(*OSI,VCC,Vpriority,Vlogpolicy,Vhash,Vsequence,numthreads);
+		OSI.reset();
+	}
+
+	/*
+	 * convert version 1 file fn to version 2 in place. The new file is
+	 * written next to the old one and renamed over it.
+	 */
+	static void convertVersion1(std::string const & fn)
+	{
+		std::vector < libmaus2::util::CommandContainer > VCC;
+
+		{
+			libmaus2::util::ContainerDescriptionList CDL;
+			libmaus2::aio::InputStreamInstance ISI(fn);
+			CDL.deserialise(ISI);
+
+			VCC.resize(CDL.V.size());
+			for ( uint64_t i = 0; i < CDL.V.size(); ++i )
+			{
+				std::istringstream istr(CDL.V[i].fn);
+				VCC[i].deserialise(istr);
+				// release memory early
+				CDL.V[i].fn = std::string();
+			}
+		}
+
+		std::string const tmpfn = fn + ".v2tmp";
+		write(tmpfn,VCC,std::vector<int64_t>(),std::vector<uint64_t>(),std::vector<uint64_t>(),std::vector<bool>(),1);
+
+		if ( ::rename(tmpfn.c_str(),fn.c_str()) != 0 )
+		{
+			int const error = errno;
+			libmaus2::aio::FileRemoval::removeFile(tmpfn);
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] CDLv2::convertVersion1: rename(" << tmpfn << "," << fn << ") failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
+};
+#endif
@@ -0,0 +1,124 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(EXECCOMMAND_HPP)
+#define EXECCOMMAND_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cctype>
+#include <stdint.h>
+
+/*
+ * commands run without a shell. Rules consisting of a single simple
+ * command (words without any shell syntax) are stored by hpcschedmake as
+ * the magic line below followed by one argument per line instead of a bash
+ * script. hpcschedworker starts such commands directly.
+ */
+struct ExecCommand
+{
+	static std::string getMagic()
+	{
+		return "#{{hpcschedexec}}\n";
+	}
+
+	static bool isExec(std::string const & script)
+	{
+		std::string const magic = getMagic();
+		return script.size() >= magic.size() && script.compare(0,magic.size(),magic) == 0;
+	}
+
+	// split line at white space if it is a simple command, return empty vector otherwise
+	static std::vector < std::string > tokenise(std::string const & line)
+	{
+		std::vector < std::string > V;
+		uint64_t i = 0;
+
+		while ( i < line.size() )
+		{
+			while ( i < line.size() && (line[i] == ' ' || line[i] == '\t') )
+				++i;
+
+			uint64_t const j = i;
+
+			while ( i < line.size() && line[i] != ' ' && line[i] != '\t' )
+			{
+				unsigned char const c = line[i++];
+
+				// letters, digits and characters without meaning to bash in any position
+				if ( ! isalnum(c) && ! strchr("_-./,:+%@=",c) )
+					return std::vector < std::string >();
+			}
+
+			if ( i > j )
+				V.push_back(line.substr(j,i-j));
+		}
+
+		// variable assignment or shell builtin
+		if ( V.size() && (V[0].find('=') != std::string::npos || isBuiltin(V[0])) )
+			return std::vector < std::string >();
+
+		return V;
+	}
+
+	static bool isBuiltin(std::string const & name)
+	{
+		static char const * builtins[] = {
+			".", ":", "alias", "bg", "bind", "break", "builtin", "caller", "case", "cd", "command",
+			"compgen", "complete", "compopt", "continue", "coproc", "declare", "dirs", "disown",
+			"do", "done", "echo", "elif", "else", "enable", "esac", "eval", "exec", "exit",
+			"export", "false", "fc", "fg", "fi", "for", "function", "getopts", "hash", "help",
+			"history", "if", "in", "jobs", "kill", "let", "local", "logout", "mapfile", "popd",
+			"printf", "pushd", "pwd", "read", "readarray", "readonly", "return", "select", "set",
+			"shift", "shopt", "source", "suspend", "test", "then", "time", "times", "trap", "true",
+			"type", "typeset", "ulimit", "umask", "unalias", "unset", "until", "wait", "while"
+		};
+
+		for ( uint64_t i = 0; i < sizeof(builtins)/sizeof(builtins[0]); ++i )
+			if ( name == builtins[i] )
+				return true;
+
+		return false;
+	}
+
+	static std::string encode(std::vector < std::string > const & args)
+	{
+		std::string s = getMagic();
+		for ( uint64_t i = 0; i < args.size(); ++i )
+			s += args[i] + "\n";
+		return s;
+	}
+
+	static std::vector < std::string > decode(std::string const & script)
+	{
+		std::vector < std::string > V;
+		uint64_t i = getMagic().size();
+
+		while ( i < script.size() )
+		{
+			uint64_t j = i;
+			while ( j < script.size() && script[j] != '\n' )
+				++j;
+			V.push_back(script.substr(i,j-i));
+			i = j+1;
+		}
+
+		return V;
+	}
+};
+#endif
@@ -0,0 +1,464 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(FILECOPY_HPP)
+#define FILECOPY_HPP
+
+#include <libmaus2/types/types.hpp>
+#include <libmaus2/exception/LibMausException.hpp>
+#include <libmaus2/parallel/PosixThread.hpp>
+#include <libmaus2/parallel/PosixMutex.hpp>
+#include <libmaus2/parallel/TerminatableSynchronousQueue.hpp>
+#include <string>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <atomic>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+/*
+ * copying of a list of regular files into one output file, used by the
+ * hpcsched::cp and hpcsched::cat modules. The data is moved inside the
+ * kernel where possible: a single file is first cloned (FICLONE, a
+ * reflink on file systems supporting it), otherwise the data is copied
+ * using copy_file_range, sendfile or pread/pwrite, whichever is the first
+ * one supported for the pair of files. Large inputs are split into chunks
+ * copied by several threads into the output file, which is set to its
+ * final size beforehand.
+ */
+struct FileCopy
+{
+	enum copy_method
+	{
+		method_copy_file_range = 0,
+		method_sendfile = 1,
+		method_read_write = 2
+	};
+
+	// part of an input file and its position in the output file
+	struct Chunk
+	{
+		std::string path;
+		uint64_t inoffset;
+		uint64_t outoffset;
+		uint64_t length;
+
+		Chunk() : inoffset(0), outoffset(0), length(0) {}
+		Chunk(std::string const & rpath, uint64_t const rinoffset, uint64_t const routoffset, uint64_t const rlength)
+		: path(rpath), inoffset(rinoffset), outoffset(routoffset), length(rlength) {}
+	};
+
+	struct CopyThread : public libmaus2::parallel::PosixThread
+	{
+		FileCopy & copy;
+
+		CopyThread(FileCopy & rcopy) : copy(rcopy) {}
+
+		virtual void * run()
+		{
+			copy.work();
+			return 0;
+		}
+	};
+
+	std::string const outpath;
+	uint64_t const numthreads;
+	uint64_t const chunksize;
+
+	libmaus2::parallel::TerminatableSynchronousQueue < Chunk > Q;
+
+	std::atomic<uint64_t> numbytes;
+
+	libmaus2::parallel::PosixMutex errorlock;
+	// first error seen
+	std::string error;
+
+	FileCopy(std::string const & routpath, uint64_t const rnumthreads, uint64_t const rchunksize = 64ull*1024ull*1024ull)
+	: outpath(routpath), numthreads(rnumthreads ? rnumthreads : 1), chunksize(rchunksize ? rchunksize : 1), numbytes(0)
+	{
+	}
+
+	/*
+	 * split module arguments at white space, -t<N> sets the number of
+	 * threads (default numthreads), the other words are returned in V
+	 */
+	static std::vector < std::string > parseArguments(char const * c, uint64_t const n, uint64_t & numthreads)
+	{
+		std::istringstream istr(std::string(c,c+n));
+		std::vector < std::string > V;
+		std::string s;
+
+		while ( istr >> s )
+		{
+			if ( s.size() > 2 && s.substr(0,2) == "-t" )
+			{
+				std::istringstream tistr(s.substr(2));
+				tistr >> numthreads;
+
+				if ( ! tistr || tistr.peek() != std::istream::traits_type::eof() || ! numthreads )
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] unable to parse " << s << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+			else
+				V.push_back(s);
+		}
+
+		return V;
+	}
+
+	static void throwError(char const * call, std::string const & path, int const error)
+	{
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] " << call << "(" << path << "): " << strerror(error) << std::endl;
+		lme.finish();
+		throw lme;
+	}
+
+	static int openFile(std::string const & path, int const flags, mode_t const mode = 0)
+	{
+		int fd;
+
+		while ( (fd = ::open(path.c_str(),flags|O_CLOEXEC,mode)) < 0 )
+		{
+			int const error = errno;
+			if ( error != EINTR )
+				throwError("open",path,error);
+		}
+
+		return fd;
+	}
+
+	void setError(std::string const & s)
+	{
+		errorlock.lock();
+		if ( ! error.size() )
+			error = s;
+		errorlock.unlock();
+	}
+
+	/*
+	 * copy one step of at most n bytes using method, falls back to the next
+	 * method if the current one is not supported for the files. Returns the
+	 * number of bytes copied, 0 on end of input.
+	 */
+	static uint64_t copyStep(
+		int const infd, std::string const & inname, uint64_t const inoffset,
+		int const outfd, std::string const & outname, uint64_t const outoffset,
+		uint64_t const n, copy_method & method
+	)
+	{
+		while ( true )
+		{
+			ssize_t r = -1;
+			int error = 0;
+
+			switch ( method )
+			{
+				case method_copy_file_range:
+				{
+					#if defined(__linux__) && defined(SYS_copy_file_range)
+					loff_t inoff = inoffset;
+					loff_t outoff = outoffset;
+					r = ::syscall(SYS_copy_file_range,infd,&inoff,outfd,&outoff,static_cast<size_t>(n),0u);
+					error = (r < 0) ? errno : 0;
+					#else
+					error = ENOSYS;
+					#endif
+
+					if ( r < 0 && (error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == EBADF) )
+					{
+						method = method_sendfile;
+						continue;
+					}
+					break;
+				}
+				case method_sendfile:
+				{
+					#if defined(__linux__)
+					if ( ::lseek(outfd,outoffset,SEEK_SET) == static_cast<off_t>(-1) )
+						throwError("lseek",outname,errno);
+					off_t inoff = inoffset;
+					r = ::sendfile(outfd,infd,&inoff,static_cast<size_t>(n));
+					error = (r < 0) ? errno : 0;
+					#else
+					error = ENOSYS;
+					#endif
+
+					if ( r < 0 && (error == ENOSYS || error == EINVAL || error == EOPNOTSUPP) )
+					{
+						method = method_read_write;
+						continue;
+					}
+					break;
+				}
+				case method_read_write:
+				{
+					char B[64*1024];
+					r = ::pread(infd,&B[0],std::min(n,static_cast<uint64_t>(sizeof(B))),inoffset);
+					error = (r < 0) ? errno : 0;
+
+					if ( r > 0 )
+					{
+						ssize_t w = 0;
+						while ( w < r )
+						{
+							ssize_t const t = ::pwrite(outfd,&B[w],r-w,outoffset+w);
+
+							if ( t < 0 && errno == EINTR )
+								continue;
+							else if ( t <= 0 )
+								throwError("pwrite",outname,t < 0 ? errno : EIO);
+
+							w += t;
+						}
+					}
+					break;
+				}
+			}
+
+			if ( r < 0 )
+			{
+				if ( error == EINTR || error == EAGAIN )
+					continue;
+				throwError("copy",inname,error);
+			}
+
+			return r;
+		}
+	}
+
+	// copy chunk, opening its own descriptors so threads do not share file positions
+	void copyChunk(Chunk const & C)
+	{
+		int const infd = openFile(C.path,O_RDONLY);
+
+		try
+		{
+			int const outfd = openFile(outpath,O_WRONLY);
+
+			try
+			{
+				copy_method method = method_copy_file_range;
+				uint64_t done = 0;
+
+				while ( done < C.length )
+				{
+					uint64_t const r = copyStep(infd,C.path,C.inoffset+done,outfd,outpath,C.outoffset+done,C.length-done,method);
+
+					if ( ! r )
+					{
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] unexpected end of file in " << C.path << " (file changed while copying)" << std::endl;
+						lme.finish();
+						throw lme;
+					}
+
+					done += r;
+					numbytes += r;
+				}
+			}
+			catch(...)
+			{
+				::close(outfd);
+				throw;
+			}
+
+			::close(outfd);
+		}
+		catch(...)
+		{
+			::close(infd);
+			throw;
+		}
+
+		::close(infd);
+	}
+
+	void work()
+	{
+		while ( true )
+		{
+			Chunk C;
+
+			try
+			{
+				C = Q.deque();
+			}
+			catch(...)
+			{
+				// queue terminated and empty
+				break;
+			}
+
+			try
+			{
+				copyChunk(C);
+			}
+			catch(std::exception const & ex)
+			{
+				setError(ex.what());
+			}
+		}
+	}
+
+	// try to clone infd into outfd, returns true on success
+	static bool clone(int const infd, int const outfd)
+	{
+		#if defined(__linux__) && defined(FICLONE)
+		return ::ioctl(outfd,FICLONE,infd) == 0;
+		#else
+		(void)infd;
+		(void)outfd;
+		return false;
+		#endif
+	}
+
+	/*
+	 * concatenate the files Vin into outpath. The output file is created
+	 * if it does not exist, with permissions mode (minus the umask).
+	 */
+	void run(std::vector < std::string > const & Vin, mode_t const mode = 0666)
+	{
+		std::vector < uint64_t > Vsize;
+		std::vector < std::pair<dev_t,ino_t> > Vid;
+
+		for ( uint64_t i = 0; i < Vin.size(); ++i )
+		{
+			struct stat sb;
+			if ( ::stat(Vin[i].c_str(),&sb) != 0 )
+				throwError("stat",Vin[i],errno);
+			if ( ! S_ISREG(sb.st_mode) )
+			{
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] " << Vin[i] << " is not a regular file" << std::endl;
+				lme.finish();
+				throw lme;
+			}
+			Vsize.push_back(sb.st_size);
+			Vid.push_back(std::pair<dev_t,ino_t>(sb.st_dev,sb.st_ino));
+		}
+
+		int const outfd = openFile(outpath,O_WRONLY|O_CREAT,mode);
+
+		try
+		{
+			struct stat sb;
+			if ( ::fstat(outfd,&sb) != 0 )
+				throwError("fstat",outpath,errno);
+
+			for ( uint64_t i = 0; i < Vid.size(); ++i )
+				if ( Vid[i] == std::pair<dev_t,ino_t>(sb.st_dev,sb.st_ino) )
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] input file " << Vin[i] << " is the output file " << outpath << std::endl;
+					lme.finish();
+					throw lme;
+				}
+
+			if ( ::ftruncate(outfd,0) != 0 )
+				throwError("ftruncate",outpath,errno);
+
+			bool cloned = false;
+			if ( Vin.size() == 1 && Vsize[0] )
+			{
+				int const infd = openFile(Vin[0],O_RDONLY);
+				cloned = clone(infd,outfd);
+				::close(infd);
+			}
+
+			if ( cloned )
+				numbytes += Vsize[0];
+			else
+			{
+				uint64_t total = 0;
+				for ( uint64_t i = 0; i < Vsize.size(); ++i )
+					total += Vsize[i];
+
+				// set final size so chunks can be written in any order
+				if ( ::ftruncate(outfd,total) != 0 )
+					throwError("ftruncate",outpath,errno);
+
+				std::vector < Chunk > VC;
+				uint64_t outoffset = 0;
+				for ( uint64_t i = 0; i < Vin.size(); ++i )
+					for ( uint64_t inoffset = 0; inoffset < Vsize[i]; )
+					{
+						uint64_t const length = std::min(chunksize,Vsize[i]-inoffset);
+						VC.push_back(Chunk(Vin[i],inoffset,outoffset,length));
+						inoffset += length;
+						outoffset += length;
+					}
+
+				uint64_t const usethreads = std::min(numthreads,static_cast<uint64_t>(VC.size()));
+
+				if ( usethreads <= 1 )
+				{
+					for ( uint64_t i = 0; i < VC.size(); ++i )
+						copyChunk(VC[i]);
+				}
+				else
+				{
+					for ( uint64_t i = 0; i < VC.size(); ++i )
+						Q.enque(VC[i]);
+					Q.terminate();
+
+					std::vector < libmaus2::util::shared_ptr<CopyThread>::type > threads;
+					for ( uint64_t i = 0; i < usethreads; ++i )
+					{
+						libmaus2::util::shared_ptr<CopyThread>::type T(new CopyThread(*this));
+						threads.push_back(T);
+						T->start();
+					}
+					for ( uint64_t i = 0; i < threads.size(); ++i )
+						threads[i]->join();
+				}
+			}
+		}
+		catch(...)
+		{
+			::close(outfd);
+			throw;
+		}
+
+		if ( ::close(outfd) != 0 )
+			throwError("close",outpath,errno);
+
+		if ( error.size() )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << error;
+			lme.finish();
+			throw lme;
+		}
+	}
+};
+#endif
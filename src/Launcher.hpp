@@ -0,0 +1,162 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(LAUNCHER_HPP)
+#define LAUNCHER_HPP
+
+#if defined(__APPLE__)
+#include <crt_externs.h>
+#endif
+
+#include <libmaus2/util/WriteableString.hpp>
+#include <libmaus2/exception/LibMausException.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+
+/*
+ * program to be started along with the redirection of its standard
+ * channels. A channel is connected to the given file descriptor if it is
+ * not negative, otherwise to the named file if the name is not empty and
+ * it is inherited if neither is given. If errtoout is set then standard
+ * error is connected to standard output (like 2>&1). If searchpath is set
+ * then the program is looked up in PATH like execvp does.
+ */
+struct LaunchRequest
+{
+	// program path followed by its arguments
+	std::vector < std::string > args;
+	int infd;
+	std::string infn;
+	int outfd;
+	std::string outfn;
+	int errfd;
+	std::string errfn;
+	bool errtoout;
+	bool searchpath;
+
+	LaunchRequest() : infd(-1), outfd(-1), errfd(-1), errtoout(false), searchpath(false) {}
+	LaunchRequest(std::vector < std::string > const & rargs)
+	: args(rargs), infd(-1), outfd(-1), errfd(-1), errtoout(false), searchpath(false) {}
+};
+
+/*
+ * process creation. spawn uses posix_spawn, which does not copy the page
+ * tables of the calling process, so the cost of starting a program does
+ * not grow with the memory used by the caller. forkRedirected is the
+ * fallback for code which has to run in a child of the caller.
+ */
+struct Launcher
+{
+	static char ** getEnviron()
+	{
+		#if defined(__APPLE__)
+		return *_NSGetEnviron();
+		#else
+		return environ;
+		#endif
+	}
+
+	static void redirect(
+		posix_spawn_file_actions_t & actions, int const targetfd, int const fd, std::string const & fn, int const flags
+	)
+	{
+		if ( fd >= 0 )
+			posix_spawn_file_actions_adddup2(&actions,fd,targetfd);
+		else if ( fn.size() )
+			posix_spawn_file_actions_addopen(&actions,targetfd,fn.c_str(),flags,0644);
+	}
+
+	static pid_t spawn(LaunchRequest const & req)
+	{
+		std::vector < std::string > const & args = req.args;
+
+		libmaus2::autoarray::AutoArray < libmaus2::util::WriteableString::unique_ptr_type > AW(args.size());
+		for ( uint64_t i = 0; i < args.size(); ++i )
+		{
+			libmaus2::util::WriteableString::unique_ptr_type tptr(new libmaus2::util::WriteableString(args[i]));
+			AW[i] = UNIQUE_PTR_MOVE(tptr);
+		}
+		libmaus2::autoarray::AutoArray < char * > AA(args.size()+1);
+		for ( uint64_t i = 0; i < args.size(); ++i )
+			AA[i] = AW[i]->A.begin();
+		AA[args.size()] = 0;
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		redirect(actions,STDIN_FILENO,req.infd,req.infn,O_RDONLY);
+		redirect(actions,STDOUT_FILENO,req.outfd,req.outfn,O_WRONLY|O_CREAT|O_TRUNC);
+		if ( req.errtoout )
+			posix_spawn_file_actions_adddup2(&actions,STDOUT_FILENO,STDERR_FILENO);
+		else
+			redirect(actions,STDERR_FILENO,req.errfd,req.errfn,O_WRONLY|O_CREAT|O_TRUNC);
+
+		pid_t pid = -1;
+		int const r = req.searchpath ?
+			posix_spawnp(&pid,args.at(0).c_str(),&actions,NULL,AA.begin(),getEnviron())
+			:
+			posix_spawn(&pid,args.at(0).c_str(),&actions,NULL,AA.begin(),getEnviron());
+
+		posix_spawn_file_actions_destroy(&actions);
+
+		if ( r != 0 )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] posix_spawn failed for " << args[0] << ": " << strerror(r) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		return pid;
+	}
+
+	/*
+	 * fork with standard output and error connected to outfd and errfd (if
+	 * not negative). Returns 0 in the child and the child's pid in the
+	 * parent.
+	 */
+	static pid_t forkRedirected(int const outfd, int const errfd)
+	{
+		pid_t const pid = fork();
+
+		if ( pid == 0 )
+		{
+			if ( outfd >= 0 && ::dup2(outfd,STDOUT_FILENO) == -1 )
+				_exit(EXIT_FAILURE);
+			if ( errfd >= 0 && ::dup2(errfd,STDERR_FILENO) == -1 )
+				_exit(EXIT_FAILURE);
+			if ( outfd >= 0 && outfd != STDOUT_FILENO && outfd != STDERR_FILENO )
+				::close(outfd);
+			if ( errfd >= 0 && errfd != STDOUT_FILENO && errfd != STDERR_FILENO && errfd != outfd )
+				::close(errfd);
+		}
+		else if ( pid == static_cast<pid_t>(-1) )
+		{
+			int const error = errno;
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] fork failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		return pid;
+	}
+};
+#endif
@@ -0,0 +1,96 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(LOGPOLICY_HPP)
+#define LOGPOLICY_HPP
+
+#include <libmaus2/exception/LibMausException.hpp>
+#include <sstream>
+#include <limits>
+
+/*
+ * retention of the standard output and error of the commands of a rule
+ *
+ *  - log_all: keep the output
+ *  - log_onfailure: keep the output in memory and store it only if the command fails
+ *  - log_discard: drop the output
+ *
+ * If limit is not 0 then at most limit bytes of each stream are kept, the
+ * first half (rounded up) from the beginning and the rest from the end of
+ * the output.
+ */
+struct LogPolicy
+{
+	enum log_mode
+	{
+		log_all = 0,
+		log_onfailure = 1,
+		log_discard = 2
+	};
+
+	log_mode mode;
+	uint64_t limit;
+
+	LogPolicy() : mode(log_all), limit(0) {}
+	LogPolicy(log_mode const rmode, uint64_t const rlimit) : mode(rmode), limit(rlimit) {}
+
+	// encoding stored in the container file, the default policy is encoded as 0
+	uint64_t encode() const
+	{
+		return (limit << 8) | static_cast<uint64_t>(mode);
+	}
+
+	static LogPolicy decode(uint64_t const v)
+	{
+		uint64_t const mode = v & 0xff;
+
+		if ( mode > log_discard )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] LogPolicy::decode: invalid mode " << mode << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		return LogPolicy(static_cast<log_mode>(mode),v >> 8);
+	}
+
+	uint64_t getHeadLimit() const
+	{
+		return limit ? (limit - limit/2) : std::numeric_limits<uint64_t>::max();
+	}
+
+	uint64_t getTailLimit() const
+	{
+		return limit/2;
+	}
+
+	std::string toString() const
+	{
+		std::ostringstream ostr;
+		switch ( mode )
+		{
+			case log_all: ostr << "all"; break;
+			case log_onfailure: ostr << "onfailure"; break;
+			case log_discard: ostr << "discard"; break;
+		}
+		if ( limit )
+			ostr << ",limit=" << limit;
+		return ostr.str();
+	}
+};
+#endif
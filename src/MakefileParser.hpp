@@ -0,0 +1,884 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(MAKEFILEPARSER_HPP)
+#define MAKEFILEPARSER_HPP
+
+#include <libmaus2/exception/LibMausException.hpp>
+#include <LogPolicy.hpp>
+#include <StringRef.hpp>
+#include <TargetTable.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <limits>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * flags set by #{{hpcschedflags}} lines, valid for all rules up to the next
+ * such line
+ */
+struct RuleFlags
+{
+	bool ignorefail;
+	bool deepsleep;
+	int64_t maxattempt;
+	int64_t numthreads;
+	int64_t mem;
+	int64_t priority;
+	LogPolicy logpolicy;
+
+	static uint64_t getDefaultMaxTry()
+	{
+		return 2;
+	}
+
+	static uint64_t getDefaultNumThreads()
+	{
+		return 1;
+	}
+
+	static uint64_t getDefaultMem()
+	{
+		return 1*1024;
+	}
+
+	static int64_t getDefaultPriority()
+	{
+		return 0;
+	}
+
+	RuleFlags()
+	: ignorefail(false), deepsleep(false), maxattempt(getDefaultMaxTry()), numthreads(getDefaultNumThreads()),
+	  mem(getDefaultMem()), priority(getDefaultPriority())
+	{
+	}
+
+	static void throwParseError(std::string const & where, char const * name, std::string const & s)
+	{
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] " << where << ": cannot parse " << name << " parameter in " << s << std::endl;
+		lme.finish();
+		throw lme;
+	}
+
+	/*
+	 * find the first {{<name><digits>}} in s (digits optionally preceded by
+	 * a minus sign if allowneg is set), store the digits in value
+	 */
+	static bool findNumericFlag(std::string const & s, std::string const & name, bool const allowneg, std::string & value)
+	{
+		std::string const prefix = "{{" + name;
+
+		for ( std::string::size_type pos = s.find(prefix); pos != std::string::npos; pos = s.find(prefix,pos+1) )
+		{
+			std::string::size_type i = pos + prefix.size();
+			std::string::size_type const j = i;
+
+			if ( allowneg && i < s.size() && s[i] == '-' )
+				++i;
+
+			std::string::size_type const k = i;
+
+			while ( i < s.size() && s[i] >= '0' && s[i] <= '9' )
+				++i;
+
+			if ( i > k && s.compare(i,2,"}}") == 0 )
+			{
+				value = s.substr(j,i-j);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// parse the decimal number digits, which has to be at most maxvalue
+	static uint64_t parseDigits(
+		std::string const & digits, uint64_t const maxvalue, std::string const & s, std::string const & name, std::string const & where
+	)
+	{
+		uint64_t v = 0;
+
+		for ( uint64_t i = 0; i < digits.size(); ++i )
+		{
+			uint64_t const d = digits[i] - '0';
+
+			if ( v > (maxvalue - d) / 10 )
+				throwParseError(where,name.c_str(),s);
+
+			v = v * 10 + d;
+		}
+
+		return v;
+	}
+
+	static uint64_t parseUnsigned(
+		std::string const & s, std::string const & name, uint64_t const def, uint64_t const maxvalue, std::string const & where
+	)
+	{
+		std::string value;
+
+		if ( ! findNumericFlag(s,name,false,value) )
+			return def;
+
+		return parseDigits(value,maxvalue,s,name,where);
+	}
+
+	static int64_t parseSigned(std::string const & s, std::string const & name, int64_t const def, std::string const & where)
+	{
+		std::string value;
+
+		if ( ! findNumericFlag(s,name,true,value) )
+			return def;
+
+		bool const neg = value[0] == '-';
+		// magnitude of the smallest int64_t is one more than that of the largest
+		uint64_t const maxvalue = static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + (neg ? 1 : 0);
+		uint64_t const v = parseDigits(value.substr(neg ? 1 : 0),maxvalue,s,name,where);
+
+		return neg ? static_cast<int64_t>(0 - v) : static_cast<int64_t>(v);
+	}
+
+	// parse flags f following #{{hpcschedflags}}, where is the location used in error messages
+	static RuleFlags parse(std::string const & f, std::string const & where)
+	{
+		RuleFlags flags;
+		uint64_t const maxint = std::numeric_limits<int64_t>::max();
+
+		flags.maxattempt = parseUnsigned(f,"maxtry",getDefaultMaxTry(),maxint,where);
+		flags.numthreads = parseUnsigned(f,"threads",getDefaultNumThreads(),maxint,where);
+		flags.mem = parseUnsigned(f,"mem",getDefaultMem(),maxint,where);
+		flags.priority = parseSigned(f,"priority",getDefaultPriority(),where);
+
+		bool const onfailure = f.find("{{logonfailure}}") != std::string::npos;
+		bool const discard = f.find("{{logdiscard}}") != std::string::npos;
+
+		if ( onfailure && discard )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] " << where << ": logonfailure and logdiscard are mutually exclusive in " << f << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		if ( onfailure )
+			flags.logpolicy.mode = LogPolicy::log_onfailure;
+		else if ( discard )
+			flags.logpolicy.mode = LogPolicy::log_discard;
+
+		// the limit is stored in the upper 56 bits of the encoded policy
+		flags.logpolicy.limit = parseUnsigned(f,"loglimit",0,(1ull << 56)-1,where);
+
+		flags.ignorefail = f.find("{{ignorefail}}") != std::string::npos;
+		flags.deepsleep = f.find("{{deepsleep}}") != std::string::npos;
+
+		return flags;
+	}
+};
+
+/*
+ * rule of a Makefile. The produced targets, dependencies and commands are
+ * stored in the arrays of the RuleSet (or ChunkResult while parsing), the
+ * rule refers to them by index ranges.
+ */
+struct Rule
+{
+	// line of the input file the rule starts on
+	uint64_t line;
+	uint64_t producedlow;
+	uint64_t producedhigh;
+	uint64_t dependencieslow;
+	uint64_t dependencieshigh;
+	uint64_t commandslow;
+	uint64_t commandshigh;
+	bool ignorefail;
+	bool deepsleep;
+	int64_t maxattempt;
+	int64_t numthreads;
+	int64_t mem;
+	int64_t priority;
+	LogPolicy logpolicy;
+
+	Rule()
+	: line(0), producedlow(0), producedhigh(0), dependencieslow(0), dependencieshigh(0), commandslow(0), commandshigh(0),
+	  ignorefail(false), deepsleep(false), maxattempt(0), numthreads(0), mem(0), priority(0)
+	{
+	}
+
+	void setFlags(RuleFlags const & flags)
+	{
+		ignorefail = flags.ignorefail;
+		deepsleep = flags.deepsleep;
+		maxattempt = flags.maxattempt;
+		numthreads = flags.numthreads;
+		mem = flags.mem;
+		priority = flags.priority;
+		logpolicy = flags.logpolicy;
+	}
+
+	uint64_t getNumProduced() const
+	{
+		return producedhigh - producedlow;
+	}
+
+	uint64_t getNumDependencies() const
+	{
+		return dependencieshigh - dependencieslow;
+	}
+
+	uint64_t getNumCommands() const
+	{
+		return commandshigh - commandslow;
+	}
+};
+
+/*
+ * rules of a Makefile. Targets are referred to by their ids in the
+ * TargetTable, produced and dependencies hold the target ids of all rules
+ * one after the other, commands the command lines.
+ */
+struct RuleSet
+{
+	std::vector < Rule > rules;
+	TargetTable targets;
+	std::vector < uint32_t > produced;
+	std::vector < uint32_t > dependencies;
+	std::vector < StringRef > commands;
+
+	uint64_t size() const
+	{
+		return rules.size();
+	}
+
+	/*
+	 * content hash of rule i, used to match the rules of different versions
+	 * of a Makefile. It covers the produced and dependency names, the
+	 * commands and the ignorefail and deepsleep flags. The maxtry, threads,
+	 * mem, priority and log flags are not included, as changing them does
+	 * not change what the rule produces.
+	 */
+	uint64_t getHash(uint64_t const i) const
+	{
+		Rule const & R = rules[i];
+		uint64_t h = StringRef::getHashSeed();
+
+		h = StringRef::hashNumber(h,R.getNumProduced());
+		for ( uint64_t j = R.producedlow; j < R.producedhigh; ++j )
+		{
+			StringRef const & S = targets[produced[j]];
+			h = S.hash(StringRef::hashNumber(h,S.size()));
+		}
+
+		h = StringRef::hashNumber(h,R.getNumDependencies());
+		for ( uint64_t j = R.dependencieslow; j < R.dependencieshigh; ++j )
+		{
+			StringRef const & S = targets[dependencies[j]];
+			h = S.hash(StringRef::hashNumber(h,S.size()));
+		}
+
+		h = StringRef::hashNumber(h,R.getNumCommands());
+		for ( uint64_t j = R.commandslow; j < R.commandshigh; ++j )
+			h = commands[j].hash(StringRef::hashNumber(h,commands[j].size()));
+
+		h = StringRef::hashNumber(h,R.ignorefail);
+		h = StringRef::hashNumber(h,R.deepsleep);
+
+		return h;
+	}
+
+	std::ostream & print(std::ostream & out, uint64_t const i) const
+	{
+		Rule const & R = rules[i];
+		out << "Rule:" << std::endl;
+		for ( uint64_t j = R.producedlow; j < R.producedhigh; ++j )
+			out << "\tproduced[" << j-R.producedlow << "]=" << targets[produced[j]] << std::endl;
+		for ( uint64_t j = R.dependencieslow; j < R.dependencieshigh; ++j )
+			out << "\tdependencies[" << j-R.dependencieslow << "]=" << targets[dependencies[j]] << std::endl;
+		for ( uint64_t j = R.commandslow; j < R.commandshigh; ++j )
+			out << "\t\tcommands[" << j-R.commandslow << "]=" << commands[j] << std::endl;
+		return out;
+	}
+};
+
+/*
+ * read only view of a file. Regular files are mapped into memory, other
+ * files (like pipes) are read into a buffer.
+ */
+struct MappedFile
+{
+	std::string const fn;
+	char const * data;
+	uint64_t size;
+	bool mapped;
+	std::vector < char > B;
+
+	static void throwError(char const * call, std::string const & fn, int const error)
+	{
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] MappedFile: " << call << " on " << fn << " failed: " << strerror(error) << std::endl;
+		lme.finish();
+		throw lme;
+	}
+
+	MappedFile(std::string const & rfn) : fn(rfn), data(0), size(0), mapped(false)
+	{
+		int fd;
+		while ( (fd = ::open(fn.c_str(),O_RDONLY|O_CLOEXEC)) < 0 )
+			if ( errno != EINTR )
+				throwError("open",fn,errno);
+
+		try
+		{
+			struct stat sb;
+			if ( ::fstat(fd,&sb) != 0 )
+				throwError("fstat",fn,errno);
+
+			if ( S_ISREG(sb.st_mode) && sb.st_size > 0 )
+			{
+				void * p = ::mmap(0,sb.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+
+				if ( p == MAP_FAILED )
+					throwError("mmap",fn,errno);
+
+				#if defined(MADV_SEQUENTIAL)
+				::madvise(p,sb.st_size,MADV_SEQUENTIAL);
+				#endif
+
+				data = reinterpret_cast<char const *>(p);
+				size = sb.st_size;
+				mapped = true;
+			}
+			else
+			{
+				uint64_t n = 0;
+				B.resize(64*1024);
+
+				while ( true )
+				{
+					if ( n == B.size() )
+						B.resize(2*B.size());
+
+					ssize_t const r = ::read(fd,B.data()+n,B.size()-n);
+
+					if ( r > 0 )
+						n += r;
+					else if ( r == 0 )
+						break;
+					else if ( errno != EINTR )
+						throwError("read",fn,errno);
+				}
+
+				B.resize(n);
+				data = B.data();
+				size = n;
+			}
+		}
+		catch(...)
+		{
+			::close(fd);
+			throw;
+		}
+
+		// the mapping stays valid after closing the file
+		::close(fd);
+	}
+
+	~MappedFile()
+	{
+		if ( mapped )
+			::munmap(const_cast<char *>(data),size);
+	}
+
+	private:
+	MappedFile(MappedFile const &);
+	MappedFile & operator=(MappedFile const &);
+};
+
+/*
+ * parser for the Makefile dialect read by hpcschedmake. The input is mapped
+ * and processed in a single pass, rules refer to the input by StringRef,
+ * so the parser has to be kept while the rules are in use. Only logical
+ * lines continued by a backslash at the end of a physical line are copied.
+ *
+ * For parsing with several threads the input is split into chunks starting
+ * at rule lines. The chunks are parsed independently, the flags set by the
+ * last #{{hpcschedflags}} line of a chunk and the line numbers are passed on
+ * to the following chunks afterwards.
+ */
+struct MakefileParser
+{
+	// rules parsed from a chunk of the input
+	struct ChunkResult
+	{
+		// index ranges of the rules refer to the arrays below
+		std::vector < Rule > rules;
+		std::vector < StringRef > produced;
+		std::vector < StringRef > dependencies;
+		std::vector < StringRef > commands;
+		// number of physical lines in the chunk
+		uint64_t numlines;
+		// whether the chunk contains a #{{hpcschedflags}} line
+		bool flagsset;
+		// flags valid at the end of the chunk if flagsset is true
+		RuleFlags flags;
+		// number of rules started before the first #{{hpcschedflags}} line
+		uint64_t numunflagged;
+		// whether parsing failed
+		bool failed;
+
+		ChunkResult() : numlines(0), flagsset(false), numunflagged(0), failed(false) {}
+	};
+
+	MappedFile file;
+	// logical lines joined from several physical lines, one container per chunk
+	std::vector < std::deque < std::string > > joined;
+
+	MakefileParser(std::string const & fn) : file(fn) {}
+
+	std::string getLocation(uint64_t const line) const
+	{
+		std::ostringstream ostr;
+		ostr << file.fn << ":" << line;
+		return ostr.str();
+	}
+
+	static std::string getFlagPrefix()
+	{
+		return "#{{hpcschedflags}}";
+	}
+
+	/*
+	 * get the next logical line starting at offset p and ending before
+	 * offset end. A backslash escapes the following character, an escaped
+	 * newline joins two physical lines (both the backslash and the newline
+	 * are dropped, all other escapes are kept as they are). Joined lines are
+	 * stored in J. lineno is the number of the physical line at offset p,
+	 * linestart is set to the number of the first physical line of the
+	 * logical line returned. Returns false at the end of the input.
+	 */
+	bool getLine(
+		uint64_t & p, uint64_t const end, uint64_t & lineno, StringRef & line, uint64_t & linestart,
+		std::deque < std::string > & joinedlines
+	) const
+	{
+		char const * const data = file.data;
+
+		if ( p >= end )
+			return false;
+
+		linestart = lineno;
+		std::string * J = 0;
+
+		while ( true )
+		{
+			char const * const a = data + p;
+			char const * e = reinterpret_cast<char const *>(::memchr(a,'\n',end-p));
+			if ( ! e )
+				e = data + end;
+
+			p = (e - data) + ((e != data + end) ? 1 : 0);
+			lineno += 1;
+
+			bool const cont = isContinued(a,e);
+
+			if ( ! cont && ! J )
+			{
+				line = StringRef(a,e);
+				return true;
+			}
+
+			if ( ! J )
+			{
+				joinedlines.push_back(std::string());
+				J = &(joinedlines.back());
+			}
+
+			J->append(a,cont ? (e-1) : e);
+
+			if ( ! cont || p >= end )
+			{
+				line = StringRef(J->data(),J->data() + J->size());
+				return true;
+			}
+		}
+	}
+
+	// line [a,e) is continued if it ends in an odd number of backslashes
+	static bool isContinued(char const * const a, char const * const e)
+	{
+		char const * b = e;
+		while ( b != a && b[-1] == '\\' )
+			--b;
+		return ((e-b) & 1) != 0;
+	}
+
+	// offset of the first physical line at or after offset p which starts a rule line
+	uint64_t findRuleStart(uint64_t p) const
+	{
+		char const * const data = file.data;
+		uint64_t const n = file.size;
+
+		// start of next physical line
+		if ( p && data[p-1] != '\n' )
+		{
+			char const * e = reinterpret_cast<char const *>(::memchr(data+p,'\n',n-p));
+			p = e ? (e - data) + 1 : n;
+		}
+
+		while ( p < n )
+		{
+			char const c = data[p];
+
+			// the previous line ends at p-1, is it continued by this one?
+			bool continuation = false;
+			if ( p )
+			{
+				char const * const prevend = data + p - 1;
+				char const * prevstart = prevend;
+				while ( prevstart != data && prevstart[-1] != '\n' )
+					--prevstart;
+				continuation = isContinued(prevstart,prevend);
+			}
+
+			if ( c != '\t' && c != '#' && c != '\n' && ! continuation )
+				return p;
+
+			char const * e = reinterpret_cast<char const *>(::memchr(data+p,'\n',n-p));
+			p = e ? (e - data) + 1 : n;
+		}
+
+		return n;
+	}
+
+	// start offsets of about numchunks chunks of similar size followed by the end of the input
+	std::vector < uint64_t > getChunks(uint64_t const numchunks) const
+	{
+		uint64_t const n = file.size;
+		std::vector < uint64_t > V(1,0);
+
+		for ( uint64_t i = 1; i < numchunks; ++i )
+		{
+			uint64_t const target = (n * i) / numchunks;
+
+			if ( target <= V.back() )
+				continue;
+
+			uint64_t const p = findRuleStart(target);
+
+			if ( p < n && p > V.back() )
+				V.push_back(p);
+		}
+
+		V.push_back(n);
+
+		return V;
+	}
+
+	static bool isSpace(char const c)
+	{
+		return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+	}
+
+	static void splitSpace(char const * a, char const * const e, std::vector<StringRef> & V)
+	{
+		while ( a != e )
+		{
+			while ( a != e && isSpace(*a) )
+				++a;
+
+			char const * const s = a;
+
+			while ( a != e && !isSpace(*a) )
+				++a;
+
+			if ( a != s )
+				V.push_back(StringRef(s,a));
+		}
+	}
+
+	/*
+	 * parse the input between offsets from and end, firstline is the line
+	 * number at offset from and flags the flags valid there
+	 */
+	void parseRange(
+		uint64_t const from, uint64_t const end, uint64_t const firstline, RuleFlags flags,
+		std::deque < std::string > & joinedlines, ChunkResult & result
+	) const
+	{
+		std::string const flagprefix = getFlagPrefix();
+
+		Rule R;
+		bool rulevalid = false;
+		std::vector < Rule > & VR = result.rules;
+
+		uint64_t p = from;
+		uint64_t lineno = firstline;
+		uint64_t linestart = 0;
+		StringRef line;
+
+		while ( getLine(p,end,lineno,line,linestart,joinedlines) )
+		{
+			if ( ! line.size() )
+				continue;
+
+			// rule command line
+			if ( line.a[0] == '\t' )
+			{
+				if ( rulevalid )
+				{
+					result.commands.push_back(StringRef(line.a+1,line.e));
+				}
+				else
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] " << getLocation(linestart) << ": command line " << line << " outside any rule" << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+			// comment
+			else if ( line.a[0] == '#' )
+			{
+				if ( line.startsWith(flagprefix) )
+				{
+					flags = RuleFlags::parse(std::string(line.a + flagprefix.size(),line.e),getLocation(linestart));
+
+					if ( ! result.flagsset )
+						result.numunflagged = VR.size() + (rulevalid ? 1 : 0);
+
+					result.flagsset = true;
+				}
+			}
+			else
+			{
+				if ( rulevalid )
+				{
+					R.commandshigh = result.commands.size();
+					VR.push_back(R);
+				}
+
+				char const * const c = reinterpret_cast<char const *>(::memchr(line.a,':',line.size()));
+
+				if ( c )
+				{
+					R.producedlow = result.produced.size();
+					splitSpace(line.a,c,result.produced);
+					R.producedhigh = result.produced.size();
+
+					R.dependencieslow = result.dependencies.size();
+					splitSpace(c+1,line.e,result.dependencies);
+					R.dependencieshigh = result.dependencies.size();
+
+					R.commandslow = result.commands.size();
+					R.line = linestart;
+					R.setFlags(flags);
+
+					rulevalid = true;
+				}
+				else
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] " << getLocation(linestart) << ": cannot parse line " << line << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+		}
+
+		if ( rulevalid )
+		{
+			R.commandshigh = result.commands.size();
+			VR.push_back(R);
+		}
+
+		if ( ! result.flagsset )
+			result.numunflagged = VR.size();
+
+		result.numlines = lineno - firstline;
+		result.flags = flags;
+	}
+
+	/*
+	 * parse the chunks starting at the offsets in chunks (followed by the
+	 * end offset), line numbers and flags are relative to the chunk
+	 */
+	std::vector < ChunkResult > parseChunks(std::vector < uint64_t > const & chunks, uint64_t const numthreads)
+	{
+		uint64_t const numchunks = chunks.size()-1;
+
+		joined.resize(0);
+		joined.resize(numchunks);
+		std::vector < ChunkResult > VC(numchunks);
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( uint64_t i = 0; i < numchunks; ++i )
+		{
+			try
+			{
+				// line numbers are relative to the chunk (and correct for the first one)
+				parseRange(chunks[i],chunks[i+1],1,RuleFlags(),joined[i],VC[i]);
+			}
+			catch(...)
+			{
+				VC[i].failed = true;
+			}
+		}
+
+		return VC;
+	}
+
+	RuleSet parse(uint64_t const numthreads = 1)
+	{
+		// more chunks than threads for balancing the load
+		std::vector < uint64_t > chunks = getChunks(numthreads > 1 ? 4*numthreads : 1);
+		std::vector < ChunkResult > VC = parseChunks(chunks,numthreads);
+
+		for ( uint64_t i = 0; i < VC.size(); ++i )
+			if ( VC[i].failed )
+			{
+				// parse again as one chunk, which reports the first error in the input with its location
+				chunks.resize(0);
+				chunks.push_back(0);
+				chunks.push_back(file.size);
+				VC.resize(0);
+				VC.resize(1);
+				joined.resize(0);
+				joined.resize(1);
+				parseRange(0,file.size,1,RuleFlags(),joined[0],VC[0]);
+				break;
+			}
+
+		uint64_t const numchunks = VC.size();
+
+		// flags and line number at the start of each chunk and start of its data in the result
+		std::vector < RuleFlags > Vflags(numchunks);
+		std::vector < uint64_t > Vline(numchunks);
+		std::vector < uint64_t > Vrule(numchunks+1,0);
+		std::vector < uint64_t > Vproduced(numchunks+1,0);
+		std::vector < uint64_t > Vdependencies(numchunks+1,0);
+		std::vector < uint64_t > Vcommands(numchunks+1,0);
+		RuleFlags flags;
+		uint64_t line = 0;
+		for ( uint64_t i = 0; i < numchunks; ++i )
+		{
+			Vflags[i] = flags;
+			Vline[i] = line;
+			Vrule[i+1] = Vrule[i] + VC[i].rules.size();
+			Vproduced[i+1] = Vproduced[i] + VC[i].produced.size();
+			Vdependencies[i+1] = Vdependencies[i] + VC[i].dependencies.size();
+			Vcommands[i+1] = Vcommands[i] + VC[i].commands.size();
+
+			if ( VC[i].flagsset )
+				flags = VC[i].flags;
+			line += VC[i].numlines;
+		}
+
+		RuleSet RS;
+
+		{
+			std::vector < std::vector < StringRef > const * > lists;
+			for ( uint64_t i = 0; i < numchunks; ++i )
+				lists.push_back(&(VC[i].produced));
+			RS.targets.build(lists,numthreads);
+		}
+
+		RS.rules.resize(Vrule[numchunks]);
+		RS.produced.resize(Vproduced[numchunks]);
+		RS.dependencies.resize(Vdependencies[numchunks]);
+		RS.commands.resize(Vcommands[numchunks]);
+
+		// first dependency of each chunk which is not produced by any rule and its rule
+		std::vector < uint64_t > Vmissing(numchunks,std::numeric_limits<uint64_t>::max());
+		std::vector < StringRef > Vmissingname(numchunks);
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( uint64_t i = 0; i < numchunks; ++i )
+		{
+			ChunkResult & C = VC[i];
+
+			for ( uint64_t j = 0; j < C.rules.size(); ++j )
+			{
+				Rule R = C.rules[j];
+
+				if ( j < C.numunflagged )
+					R.setFlags(Vflags[i]);
+				R.line += Vline[i];
+
+				for ( uint64_t k = R.producedlow; k < R.producedhigh; ++k )
+				{
+					bool const ok = RS.targets.find(C.produced[k],RS.produced[Vproduced[i]+k]);
+					assert ( ok );
+					(void)ok;
+				}
+				for ( uint64_t k = R.dependencieslow; k < R.dependencieshigh; ++k )
+					if (
+						! RS.targets.find(C.dependencies[k],RS.dependencies[Vdependencies[i]+k])
+						&&
+						Vmissing[i] == std::numeric_limits<uint64_t>::max()
+					)
+					{
+						Vmissing[i] = Vrule[i]+j;
+						Vmissingname[i] = C.dependencies[k];
+					}
+
+				R.producedlow += Vproduced[i];
+				R.producedhigh += Vproduced[i];
+				R.dependencieslow += Vdependencies[i];
+				R.dependencieshigh += Vdependencies[i];
+				R.commandslow += Vcommands[i];
+				R.commandshigh += Vcommands[i];
+
+				RS.rules[Vrule[i]+j] = R;
+			}
+
+			std::copy(C.commands.begin(),C.commands.end(),RS.commands.begin()+Vcommands[i]);
+
+			// free the memory of the chunk
+			ChunkResult().rules.swap(C.rules);
+			std::vector < StringRef >().swap(C.produced);
+			std::vector < StringRef >().swap(C.dependencies);
+			std::vector < StringRef >().swap(C.commands);
+		}
+
+		for ( uint64_t i = 0; i < numchunks; ++i )
+			if ( Vmissing[i] != std::numeric_limits<uint64_t>::max() )
+			{
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] " << getLocation(RS.rules[Vmissing[i]].line) << ": dependency " << Vmissingname[i] << " is not produced by any rule" << std::endl;
+				lme.finish();
+				throw lme;
+			}
+
+		return RS;
+	}
+};
+#endif
@@ -0,0 +1,56 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(MODULEMESSAGE_HPP)
+#define MODULEMESSAGE_HPP
+
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+ * error messages of module calls. The _fd entry points of the modules run
+ * on threads of the worker, so messages are written to the error
+ * descriptor passed by the worker using plain write calls instead of
+ * std::cerr.
+ */
+struct ModuleMessage
+{
+	// write message to fd, errors are ignored as there is nowhere left to report them
+	static void write(int const fd, char const * what)
+	{
+		uint64_t n = strlen(what);
+
+		while ( n )
+		{
+			ssize_t const w = ::write(fd,what,n);
+
+			if ( w > 0 )
+			{
+				what += w;
+				n -= w;
+			}
+			else if ( w < 0 && errno == EINTR )
+			{
+			}
+			else
+				break;
+		}
+	}
+};
+#endif
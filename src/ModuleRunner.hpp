@@ -0,0 +1,349 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(MODULERUNNER_HPP)
+#define MODULERUNNER_HPP
+
+#include <libmaus2/util/DynamicLoading.hpp>
+#include <libmaus2/util/PathTools.hpp>
+#include <libmaus2/parallel/PosixThread.hpp>
+#include <libmaus2/parallel/PosixMutex.hpp>
+#include <libmaus2/parallel/TerminatableSynchronousQueue.hpp>
+#include <libmaus2/exception/LibMausException.hpp>
+
+#include <deque>
+#include <set>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+ * module for hpcsched::<name> rules. function is the entry point
+ * hpcsched_<name> run in a child process. fdfunction is the optional entry
+ * point hpcsched_<name>_fd, which writes its messages to the file
+ * descriptor passed and is safe to call from several threads of the
+ * caller at once.
+ */
+struct Module
+{
+	typedef int(*function_type)(char const *, uint64_t const);
+	typedef int(*fd_function_type)(char const *, uint64_t const, int const);
+
+	libmaus2::util::DynamicLibrary::shared_ptr_type library;
+	libmaus2::util::DynamicLibraryFunction<function_type>::shared_ptr_type function;
+	libmaus2::util::DynamicLibraryFunction<fd_function_type>::shared_ptr_type fdfunction;
+};
+
+/*
+ * loading of modules from the working directory or the installed module
+ * directory next to the program
+ */
+struct ModuleLoader
+{
+	std::string const absprogname;
+	std::map < std::string, Module > modules;
+	// modules which could not be loaded
+	std::set < std::string > failed;
+
+	ModuleLoader(std::string const & rabsprogname) : absprogname(rabsprogname) {}
+
+	static bool canLoadLibrary(std::string const & name)
+	{
+		try
+		{
+			std::cerr << "canLoadLibrary(" << name << ")" << std::endl;
+			libmaus2::util::DynamicLibrary lib(name);
+			return true;
+		}
+		catch(...)
+		{
+			return false;
+		}
+	}
+
+	// split module call into module name and arguments
+	static std::pair<std::string,std::string> split(std::string const & s)
+	{
+		uint64_t p = 0;
+		while ( p < s.size() && !isspace(s[p]) )
+			++p;
+
+		std::string const first = s.substr(0,p);
+
+		while ( p < s.size() && isspace(s[p]) )
+			++p;
+
+		std::string const second = s.substr(p);
+
+		return std::pair<std::string,std::string>(first,second);
+	}
+
+	// get module name, returns NULL if it cannot be loaded
+	Module const * get(std::string const & name)
+	{
+		std::map < std::string, Module >::const_iterator it = modules.find(name);
+
+		if ( it != modules.end() )
+			return &(it->second);
+		if ( failed.find(name) != failed.end() )
+			return 0;
+
+		try
+		{
+			Module module;
+			std::string const functionname = "hpcsched_" + name;
+			std::string modname;
+
+			if ( canLoadLibrary(functionname + ".so") )
+				modname = functionname + ".so";
+			else
+			{
+				std::string const progdir = libmaus2::util::PathTools::sdirname(absprogname);
+				std::string const libdir = progdir + "/../lib/hpcsched/" + PACKAGE_VERSION;
+				std::string const modpath = libdir + "/" + functionname + ".so";
+				if ( canLoadLibrary(modpath) )
+				{
+					modname = modpath;
+				}
+				else
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] unable to find module for " << name << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+
+			libmaus2::util::DynamicLibrary::shared_ptr_type library(
+				new libmaus2::util::DynamicLibrary(modname)
+			);
+			module.library = library;
+
+			libmaus2::util::DynamicLibraryFunction<Module::function_type>::shared_ptr_type function(
+				new libmaus2::util::DynamicLibraryFunction<Module::function_type>(
+					*(module.library),
+					functionname
+				)
+			);
+			module.function = function;
+
+			// modules built for older versions do not have this entry point
+			try
+			{
+				libmaus2::util::DynamicLibraryFunction<Module::fd_function_type>::shared_ptr_type fdfunction(
+					new libmaus2::util::DynamicLibraryFunction<Module::fd_function_type>(
+						*(module.library),
+						functionname + "_fd"
+					)
+				);
+				module.fdfunction = fdfunction;
+			}
+			catch(...)
+			{
+			}
+
+			modules [ name ] = module;
+
+			return &(modules.find(name)->second);
+		}
+		catch(std::exception const & ex)
+		{
+			std::cerr << "[E] trying to load module for " << name << " failed:\n" << ex.what() << std::endl;
+			failed.insert(name);
+			return 0;
+		}
+	}
+};
+
+/*
+ * call of a module entry point on the thread pool. id is chosen by the
+ * caller to identify the result.
+ */
+struct ModuleTask
+{
+	uint64_t id;
+	Module::fd_function_type function;
+	std::string args;
+	int errfd;
+
+	ModuleTask() : id(0), function(0), errfd(-1) {}
+	ModuleTask(uint64_t const rid, Module::fd_function_type const rfunction, std::string const & rargs, int const rerrfd)
+	: id(rid), function(rfunction), args(rargs), errfd(rerrfd) {}
+};
+
+struct ModuleResult
+{
+	uint64_t id;
+	// exit status in the format returned by waitpid
+	int status;
+
+	ModuleResult() : id(0), status(0) {}
+	ModuleResult(uint64_t const rid, int const rstatus) : id(rid), status(rstatus) {}
+};
+
+/*
+ * threads running module calls inside the calling process, so cheap
+ * modules (like mkdir) do not need a process of their own. Results are
+ * collected via getResults after the read end of the notification pipe
+ * (getFD) has become readable.
+ */
+struct ModuleThreadPool
+{
+	typedef ModuleThreadPool this_type;
+	typedef libmaus2::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	struct WorkerThread : public libmaus2::parallel::PosixThread
+	{
+		typedef WorkerThread this_type;
+		typedef libmaus2::util::shared_ptr<this_type>::type shared_ptr_type;
+
+		ModuleThreadPool & pool;
+
+		WorkerThread(ModuleThreadPool & rpool) : pool(rpool) {}
+
+		virtual void * run()
+		{
+			pool.work();
+			return 0;
+		}
+	};
+
+	libmaus2::parallel::TerminatableSynchronousQueue < ModuleTask > Qtask;
+
+	libmaus2::parallel::PosixMutex resultlock;
+	std::deque < ModuleResult > Qresult;
+
+	int notifyfd[2];
+
+	std::vector < WorkerThread::shared_ptr_type > threads;
+
+	// number of tasks not yet returned via getResults
+	uint64_t outstanding;
+
+	ModuleThreadPool(uint64_t const numthreads) : outstanding(0)
+	{
+		if ( ::pipe(&notifyfd[0]) != 0 )
+		{
+			int const error = errno;
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] ModuleThreadPool: pipe() failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		for ( uint64_t i = 0; i < 2; ++i )
+		{
+			::fcntl(notifyfd[i],F_SETFL,::fcntl(notifyfd[i],F_GETFL) | O_NONBLOCK);
+			::fcntl(notifyfd[i],F_SETFD,FD_CLOEXEC);
+		}
+
+		for ( uint64_t i = 0; i < numthreads; ++i )
+		{
+			WorkerThread::shared_ptr_type T(new WorkerThread(*this));
+			threads.push_back(T);
+			T->start();
+		}
+	}
+
+	~ModuleThreadPool()
+	{
+		shutdown();
+		::close(notifyfd[0]);
+		::close(notifyfd[1]);
+	}
+
+	int getFD() const
+	{
+		return notifyfd[0];
+	}
+
+	void enque(ModuleTask const & T)
+	{
+		outstanding += 1;
+		Qtask.enque(T);
+	}
+
+	// finish queued tasks and stop the threads
+	void shutdown()
+	{
+		Qtask.terminate();
+		for ( uint64_t i = 0; i < threads.size(); ++i )
+			threads[i]->join();
+		threads.resize(0);
+	}
+
+	std::vector < ModuleResult > getResults()
+	{
+		char buf[256];
+		while ( ::read(notifyfd[0],&buf[0],sizeof(buf)) > 0 )
+		{
+		}
+
+		std::vector < ModuleResult > V;
+
+		resultlock.lock();
+		while ( Qresult.size() )
+		{
+			V.push_back(Qresult.front());
+			Qresult.pop_front();
+		}
+		resultlock.unlock();
+
+		assert ( outstanding >= V.size() );
+		outstanding -= V.size();
+
+		return V;
+	}
+
+	void work()
+	{
+		while ( true )
+		{
+			ModuleTask T;
+
+			try
+			{
+				T = Qtask.deque();
+			}
+			catch(...)
+			{
+				// queue terminated and empty
+				break;
+			}
+
+			int r;
+			try
+			{
+				r = T.function(T.args.c_str(),T.args.size(),T.errfd);
+			}
+			catch(...)
+			{
+				r = EXIT_FAILURE;
+			}
+
+			resultlock.lock();
+			// exit code in the status format of waitpid
+			Qresult.push_back(ModuleResult(T.id,(r & 0xff) << 8));
+			resultlock.unlock();
+
+			char const c = 0;
+			// a full pipe already signals pending results
+			ssize_t const w = ::write(notifyfd[1],&c,1);
+			(void)w;
+		}
+	}
+};
+#endif
@@ -0,0 +1,291 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(NONBLOCKINGFDIO_HPP)
+#define NONBLOCKINGFDIO_HPP
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <libmaus2/exception/LibMausException.hpp>
+
+/*
+ * buffered message I/O on a non blocking file descriptor
+ *
+ * numbers and strings use the same encoding as FDIO. Incoming data is
+ * accumulated in an input buffer, messages are parsed from there using
+ * the get* functions. A message consisting of several fields is only
+ * consumed when commit() is called, rollback() restores the read pointer
+ * if a message is incomplete. Outgoing data is queued by the put*
+ * functions and written by flush() as far as the socket accepts it.
+ *
+ * The length of incoming strings and the amount of buffered unconsumed
+ * input are limited, exceeding a limit throws an exception, so a corrupt
+ * or misbehaving peer cannot make the reader buffer without bound.
+ */
+struct NonBlockingFDIO
+{
+	int fd;
+
+	std::string inbuf;
+	// committed read position in inbuf
+	uint64_t incommit;
+	// tentative read position in inbuf
+	uint64_t inptr;
+	bool ineof;
+
+	std::string outbuf;
+	uint64_t outptr;
+
+	// maximum length of an incoming string
+	uint64_t maxstring;
+	// maximum amount of unconsumed input
+	uint64_t maxpending;
+
+	static uint64_t getDefaultMaxString()
+	{
+		return 16ull*1024ull*1024ull;
+	}
+
+	static uint64_t getDefaultMaxPending()
+	{
+		return 64ull*1024ull*1024ull;
+	}
+
+	NonBlockingFDIO(int const rfd = -1)
+	: fd(rfd), inbuf(), incommit(0), inptr(0), ineof(false), outbuf(), outptr(0),
+	  maxstring(getDefaultMaxString()), maxpending(getDefaultMaxPending())
+	{
+
+	}
+
+	static void setNonBlocking(int const fd)
+	{
+		int const flags = ::fcntl(fd,F_GETFL);
+
+		if ( flags < 0 || ::fcntl(fd,F_SETFL,flags | O_NONBLOCK) < 0 )
+		{
+			int const error = errno;
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] NonBlockingFDIO::setNonBlocking: fcntl failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
+
+	void reset(int const rfd = -1)
+	{
+		fd = rfd;
+		inbuf = std::string();
+		incommit = 0;
+		inptr = 0;
+		ineof = false;
+		outbuf = std::string();
+		outptr = 0;
+	}
+
+	/*
+	 * read data until the descriptor would block, returns number of bytes read
+	 * sets ineof if the peer closed the connection
+	 */
+	uint64_t fill()
+	{
+		// drop consumed data before appending
+		if ( incommit )
+		{
+			inbuf.erase(0,incommit);
+			inptr -= incommit;
+			incommit = 0;
+		}
+
+		char B[16*1024];
+		uint64_t n = 0;
+
+		while ( !ineof )
+		{
+			::ssize_t const r = ::read(fd,&B[0],sizeof(B));
+
+			if ( r < 0 )
+			{
+				int const error = errno;
+
+				switch ( error )
+				{
+					case EINTR:
+						break;
+					case EAGAIN:
+					#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+					case EWOULDBLOCK:
+					#endif
+						return n;
+					default:
+					{
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] NonBlockingFDIO::fill: read failed with error " << strerror(error) << std::endl;
+						lme.finish();
+						throw lme;
+					}
+				}
+			}
+			else if ( r == 0 )
+			{
+				ineof = true;
+			}
+			else
+			{
+				if ( static_cast<uint64_t>(r) > maxpending - std::min(maxpending,static_cast<uint64_t>(inbuf.size())) )
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] NonBlockingFDIO::fill: more than " << maxpending << " bytes of unconsumed input" << std::endl;
+					lme.finish();
+					throw lme;
+				}
+
+				inbuf.append(&B[0],r);
+				n += r;
+			}
+		}
+
+		return n;
+	}
+
+	/*
+	 * write queued data until the descriptor would block
+	 * returns true if all queued data has been written
+	 */
+	bool flush()
+	{
+		while ( outptr < outbuf.size() )
+		{
+			::ssize_t const r = ::write(fd,outbuf.c_str() + outptr,outbuf.size() - outptr);
+
+			if ( r < 0 )
+			{
+				int const error = errno;
+
+				switch ( error )
+				{
+					case EINTR:
+						break;
+					case EAGAIN:
+					#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+					case EWOULDBLOCK:
+					#endif
+						return false;
+					default:
+					{
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] NonBlockingFDIO::flush: write failed with error " << strerror(error) << std::endl;
+						lme.finish();
+						throw lme;
+					}
+				}
+			}
+			else
+			{
+				outptr += r;
+			}
+		}
+
+		outbuf = std::string();
+		outptr = 0;
+
+		return true;
+	}
+
+	bool writePending() const
+	{
+		return outptr < outbuf.size();
+	}
+
+	void commit()
+	{
+		incommit = inptr;
+	}
+
+	void rollback()
+	{
+		inptr = incommit;
+	}
+
+	bool getNumber(uint64_t & v)
+	{
+		static unsigned int const n = 8;
+
+		if ( inbuf.size() - inptr < n )
+			return false;
+
+		v = 0;
+		for ( unsigned int i = 0; i < n; ++i )
+		{
+			v <<= 8;
+			v |= static_cast<uint64_t>(static_cast<unsigned char>(inbuf[inptr++]));
+		}
+
+		return true;
+	}
+
+	bool getString(std::string & s)
+	{
+		uint64_t const save = inptr;
+		uint64_t n;
+
+		if ( ! getNumber(n) )
+			return false;
+
+		if ( n > maxstring )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] NonBlockingFDIO::getString: string length " << n << " exceeds limit " << maxstring << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		if ( inbuf.size() - inptr < n )
+		{
+			inptr = save;
+			return false;
+		}
+
+		s = inbuf.substr(inptr,n);
+		inptr += n;
+
+		return true;
+	}
+
+	void putNumber(uint64_t v)
+	{
+		static unsigned int const n = 8;
+		char A[n];
+		for ( unsigned int i = 0; i < n; ++i )
+		{
+			unsigned int const shift = n - i - 1;
+			unsigned int const shift8 = shift << 3;
+			A[i] = static_cast<char>((v >> shift8) & 0xFFull);
+		}
+		outbuf.append(&A[0],n);
+	}
+
+	void putString(std::string const & s)
+	{
+		putNumber(s.size());
+		outbuf.append(s);
+	}
+};
+#endif
@@ -0,0 +1,220 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(READYQUEUE_HPP)
+#define READYQUEUE_HPP
+
+#include <libmaus2/exception/LibMausException.hpp>
+#include <vector>
+#include <string>
+#include <cassert>
+
+/*
+ * queue of jobs ready to run, implemented as an indexed binary max heap
+ *
+ * Jobs are identified by a dense index (the global command index in the
+ * container file). The position of each job in the heap is stored, so
+ * membership tests are O(1) and inserting a job already present is a no-op.
+ * Entries are ordered by two keys (larger first) and the insertion order
+ * (earlier first). The keys are chosen by the caller according to the
+ * queue policy.
+ */
+struct ReadyQueue
+{
+	enum queue_policy
+	{
+		// insertion order
+		queue_policy_fifo,
+		// longest chain of dependent containers first
+		queue_policy_critpath,
+		// user priority first, then critical path
+		queue_policy_priority,
+		// largest number of directly dependent containers first
+		queue_policy_fanout
+	};
+
+	static queue_policy parsePolicy(std::string const & s)
+	{
+		if ( s == "fifo" )
+			return queue_policy_fifo;
+		else if ( s == "critpath" )
+			return queue_policy_critpath;
+		else if ( s == "priority" )
+			return queue_policy_priority;
+		else if ( s == "fanout" )
+			return queue_policy_fanout;
+		else
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] unknown queue policy " << s << " (supported: fifo, critpath, priority, fanout)" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
+
+	struct Entry
+	{
+		uint64_t containerid;
+		uint64_t subid;
+		uint64_t index;
+		int64_t key0;
+		int64_t key1;
+		uint64_t seq;
+
+		Entry() {}
+		Entry(
+			uint64_t const rcontainerid,
+			uint64_t const rsubid,
+			uint64_t const rindex,
+			int64_t const rkey0,
+			int64_t const rkey1,
+			uint64_t const rseq
+		) : containerid(rcontainerid), subid(rsubid), index(rindex), key0(rkey0), key1(rkey1), seq(rseq) {}
+
+		// true if this entry should be run before O
+		bool before(Entry const & O) const
+		{
+			if ( key0 != O.key0 )
+				return key0 > O.key0;
+			else if ( key1 != O.key1 )
+				return key1 > O.key1;
+			else
+				return seq < O.seq;
+		}
+	};
+
+	std::vector < Entry > H;
+	// heap position plus one for each job index, 0 if not in the queue
+	std::vector < uint64_t > P;
+	uint64_t nextseq;
+
+	ReadyQueue(uint64_t const numjobs = 0)
+	: H(), P(numjobs,0), nextseq(0)
+	{
+	}
+
+	uint64_t size() const
+	{
+		return H.size();
+	}
+
+	bool contains(uint64_t const index) const
+	{
+		assert ( index < P.size() );
+		return P[index] != 0;
+	}
+
+	void place(uint64_t const i, Entry const & E)
+	{
+		H[i] = E;
+		P[E.index] = i+1;
+	}
+
+	void siftUp(uint64_t i)
+	{
+		Entry const E = H[i];
+
+		while ( i )
+		{
+			uint64_t const parent = (i-1)/2;
+
+			if ( E.before(H[parent]) )
+			{
+				place(i,H[parent]);
+				i = parent;
+			}
+			else
+				break;
+		}
+
+		place(i,E);
+	}
+
+	void siftDown(uint64_t i)
+	{
+		Entry const E = H[i];
+		uint64_t const n = H.size();
+
+		while ( 2*i+1 < n )
+		{
+			uint64_t child = 2*i+1;
+
+			if ( child+1 < n && H[child+1].before(H[child]) )
+				child += 1;
+
+			if ( H[child].before(E) )
+			{
+				place(i,H[child]);
+				i = child;
+			}
+			else
+				break;
+		}
+
+		place(i,E);
+	}
+
+	// insert job, returns false if it was already queued
+	bool push(uint64_t const containerid, uint64_t const subid, uint64_t const index, int64_t const key0, int64_t const key1)
+	{
+		if ( contains(index) )
+			return false;
+
+		H.push_back(Entry(containerid,subid,index,key0,key1,nextseq++));
+		siftUp(H.size()-1);
+
+		return true;
+	}
+
+	// reinsert an entry taken from the queue, keeping its insertion order
+	bool push(Entry const & E)
+	{
+		if ( contains(E.index) )
+			return false;
+
+		H.push_back(E);
+		siftUp(H.size()-1);
+
+		return true;
+	}
+
+	Entry const & top() const
+	{
+		assert ( H.size() );
+		return H[0];
+	}
+
+	Entry pop()
+	{
+		assert ( H.size() );
+
+		Entry const E = H[0];
+		P[E.index] = 0;
+
+		Entry const L = H.back();
+		H.pop_back();
+
+		if ( H.size() )
+		{
+			H[0] = L;
+			siftDown(0);
+		}
+
+		return E;
+	}
+};
+#endif
@@ -33,8 +33,11 @@ struct RunInfo
 	std::string errfn;
 	int status;
 	std::string scriptname;
+	// number of bytes of standard output and error not stored due to the log policy of the rule
+	uint64_t outskipped;
+	uint64_t errskipped;
 
-	RunInfo()
+	RunInfo() : outskipped(0), errskipped(0)
 	{
 
 	}
@@ -55,6 +58,8 @@ struct RunInfo
 		libmaus2::util::StringSerialisation::serialiseString(out,errfn);
 		libmaus2::util::NumberSerialisation::serialiseSignedNumber(out,status);
 		libmaus2::util::StringSerialisation::serialiseString(out,scriptname);
+		libmaus2::util::NumberSerialisation::serialiseNumber(out,outskipped);
+		libmaus2::util::NumberSerialisation::serialiseNumber(out,errskipped);
 		return out;
 	}
 
@@ -77,6 +82,8 @@ struct RunInfo
 		errfn = libmaus2::util::StringSerialisation::deserialiseString(in);
 		status = libmaus2::util::NumberSerialisation::deserialiseSignedNumber(in);
 		scriptname = libmaus2::util::StringSerialisation::deserialiseString(in);
+		outskipped = libmaus2::util::NumberSerialisation::deserialiseNumber(in);
+		errskipped = libmaus2::util::NumberSerialisation::deserialiseNumber(in);
 		return in;
 	}
 
@@ -0,0 +1,109 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(STRINGREF_HPP)
+#define STRINGREF_HPP
+
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <ostream>
+#include <stdint.h>
+
+/*
+ * range of characters not owned by the object, like the names in the input
+ * of a MakefileParser, which are valid as long as the parser
+ */
+struct StringRef
+{
+	char const * a;
+	char const * e;
+
+	StringRef() : a(0), e(0) {}
+	StringRef(char const * ra, char const * re) : a(ra), e(re) {}
+
+	uint64_t size() const
+	{
+		return e-a;
+	}
+
+	bool startsWith(std::string const & s) const
+	{
+		return size() >= s.size() && ::memcmp(a,s.c_str(),s.size()) == 0;
+	}
+
+	std::string str() const
+	{
+		return std::string(a,e);
+	}
+
+	bool operator<(StringRef const & O) const
+	{
+		uint64_t const n = size();
+		uint64_t const on = O.size();
+		int const r = ::memcmp(a,O.a,std::min(n,on));
+
+		if ( r )
+			return r < 0;
+		else
+			return n < on;
+	}
+
+	bool operator==(StringRef const & O) const
+	{
+		return size() == O.size() && ::memcmp(a,O.a,size()) == 0;
+	}
+
+	static uint64_t getHashSeed()
+	{
+		return 14695981039346656037ull;
+	}
+
+	// continue FNV-1a hash value h over the bytes of v
+	static uint64_t hashNumber(uint64_t h, uint64_t v)
+	{
+		for ( unsigned int i = 0; i < sizeof(v); ++i, v >>= 8 )
+		{
+			h ^= (v & 0xFF);
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	// continue FNV-1a hash value h over the characters
+	uint64_t hash(uint64_t h) const
+	{
+		for ( char const * c = a; c != e; ++c )
+		{
+			h ^= static_cast<unsigned char>(*c);
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	// FNV-1a hash value
+	uint64_t hash() const
+	{
+		return hash(getHashSeed());
+	}
+};
+
+inline std::ostream & operator<<(std::ostream & out, StringRef const & S)
+{
+	return out.write(S.a,S.size());
+}
+#endif
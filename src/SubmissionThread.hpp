@@ -0,0 +1,296 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(SUBMISSIONTHREAD_HPP)
+#define SUBMISSIONTHREAD_HPP
+
+#include <BatchBackend.hpp>
+#include <libmaus2/parallel/PosixThread.hpp>
+#include <libmaus2/parallel/PosixMutex.hpp>
+#include <libmaus2/parallel/PosixSpinLock.hpp>
+#include <libmaus2/parallel/TerminatableSynchronousQueue.hpp>
+#include <libmaus2/aio/StreamLock.hpp>
+
+#include <deque>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+/*
+ * request passed to the submission thread
+ */
+struct SubmissionRequest
+{
+	enum request_type
+	{
+		request_submit,
+		request_cancel,
+		request_query
+	};
+
+	request_type type;
+	// worker class and slots for request_submit
+	uint64_t workerclass;
+	std::vector < uint64_t > slots;
+	BatchJobRequest req;
+	// job id for request_cancel and request_query
+	uint64_t id;
+
+	SubmissionRequest() {}
+
+	static SubmissionRequest submit(uint64_t const workerclass, std::vector < uint64_t > const & slots, BatchJobRequest const & req)
+	{
+		SubmissionRequest R;
+		R.type = request_submit;
+		R.workerclass = workerclass;
+		R.slots = slots;
+		R.req = req;
+		R.id = 0;
+		return R;
+	}
+
+	static SubmissionRequest cancel(uint64_t const id)
+	{
+		SubmissionRequest R;
+		R.type = request_cancel;
+		R.workerclass = 0;
+		R.id = id;
+		return R;
+	}
+
+	static SubmissionRequest query(uint64_t const id)
+	{
+		SubmissionRequest R;
+		R.type = request_query;
+		R.workerclass = 0;
+		R.id = id;
+		return R;
+	}
+};
+
+/*
+ * result of a request. For request_submit ids contains the job ids of
+ * the first ids.size() slots, the remaining slots could not be started.
+ */
+struct SubmissionResult
+{
+	SubmissionRequest request;
+	std::vector < uint64_t > ids;
+	BatchBackend::job_state state;
+
+	SubmissionResult() {}
+	SubmissionResult(SubmissionRequest const & rrequest)
+	: request(rrequest), ids(), state(BatchBackend::job_state_unknown)
+	{
+	}
+};
+
+/*
+ * thread running the calls to the batch backend, so hpcschedcontrol does
+ * not wait for sbatch and friends. Requests are queued by enque, results
+ * are collected via getResults after the read end of the notification
+ * pipe (getFD) has become readable. Backend calls are spaced by at least
+ * the given interval. Failed submissions are retried with exponentially
+ * growing delay before they are reported.
+ */
+struct SubmissionThread : public libmaus2::parallel::PosixThread
+{
+	typedef SubmissionThread this_type;
+	typedef libmaus2::util::unique_ptr<this_type>::type unique_ptr_type;
+
+	BatchBackend & backend;
+	// minimum time between backend calls in milliseconds
+	uint64_t const interval;
+	// number of retries for failed submissions
+	uint64_t const maxretries;
+	// delay before first retry in milliseconds, doubled on each retry
+	uint64_t const retrydelay;
+
+	libmaus2::parallel::TerminatableSynchronousQueue < SubmissionRequest > Qrequest;
+
+	libmaus2::parallel::PosixMutex resultlock;
+	std::deque < SubmissionResult > Qresult;
+
+	int notifyfd[2];
+
+	// number of requests not yet returned via getResults
+	uint64_t outstanding;
+
+	static void msleep(uint64_t const ms)
+	{
+		struct timespec ts;
+		ts.tv_sec = ms / 1000;
+		ts.tv_nsec = (ms % 1000) * 1000000;
+		while ( nanosleep(&ts,&ts) == -1 && errno == EINTR )
+		{
+		}
+	}
+
+	static uint64_t getTimeMs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC,&ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+	}
+
+	SubmissionThread(BatchBackend & rbackend, uint64_t const rinterval, uint64_t const rmaxretries, uint64_t const rretrydelay)
+	: backend(rbackend), interval(rinterval), maxretries(rmaxretries), retrydelay(rretrydelay), outstanding(0)
+	{
+		if ( ::pipe(&notifyfd[0]) != 0 )
+		{
+			int const error = errno;
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] SubmissionThread: pipe() failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		for ( uint64_t i = 0; i < 2; ++i )
+		{
+			::fcntl(notifyfd[i],F_SETFL,::fcntl(notifyfd[i],F_GETFL) | O_NONBLOCK);
+			::fcntl(notifyfd[i],F_SETFD,FD_CLOEXEC);
+		}
+	}
+
+	~SubmissionThread()
+	{
+		::close(notifyfd[0]);
+		::close(notifyfd[1]);
+	}
+
+	int getFD() const
+	{
+		return notifyfd[0];
+	}
+
+	void enque(SubmissionRequest const & R)
+	{
+		outstanding += 1;
+		Qrequest.enque(R);
+	}
+
+	// process queued requests and stop the thread
+	void shutdown()
+	{
+		Qrequest.terminate();
+		join();
+	}
+
+	std::vector < SubmissionResult > getResults()
+	{
+		char buf[256];
+		while ( ::read(notifyfd[0],&buf[0],sizeof(buf)) > 0 )
+		{
+		}
+
+		std::vector < SubmissionResult > V;
+
+		resultlock.lock();
+		while ( Qresult.size() )
+		{
+			V.push_back(Qresult.front());
+			Qresult.pop_front();
+		}
+		resultlock.unlock();
+
+		assert ( outstanding >= V.size() );
+		outstanding -= V.size();
+
+		return V;
+	}
+
+	void putResult(SubmissionResult const & R)
+	{
+		resultlock.lock();
+		Qresult.push_back(R);
+		resultlock.unlock();
+
+		char const c = 0;
+		// a full pipe already signals pending results
+		ssize_t const r = ::write(notifyfd[1],&c,1);
+		(void)r;
+	}
+
+	void handle(SubmissionRequest const & R, uint64_t & lastcall)
+	{
+		SubmissionResult res(R);
+		uint64_t delay = retrydelay;
+
+		for ( uint64_t attempt = 0; ; ++attempt )
+		{
+			uint64_t const now = getTimeMs();
+			if ( now < lastcall + interval )
+				msleep(lastcall + interval - now);
+			lastcall = getTimeMs();
+
+			try
+			{
+				switch ( R.type )
+				{
+					case SubmissionRequest::request_submit:
+						res.ids = backend.submitArray(R.req,R.slots.size());
+						break;
+					case SubmissionRequest::request_cancel:
+						backend.cancel(R.id);
+						break;
+					case SubmissionRequest::request_query:
+						res.state = backend.query(R.id);
+						break;
+				}
+				break;
+			}
+			catch(std::exception const & ex)
+			{
+				libmaus2::parallel::ScopePosixSpinLock slock(libmaus2::aio::StreamLock::cerrlock);
+				std::cerr << "[E] batch backend call failed (attempt " << attempt+1 << "):\n" << ex.what() << std::endl;
+			}
+
+			if ( R.type != SubmissionRequest::request_submit || attempt >= maxretries )
+				break;
+
+			msleep(delay);
+			delay *= 2;
+		}
+
+		putResult(res);
+	}
+
+	virtual void * run()
+	{
+		uint64_t lastcall = 0;
+
+		while ( true )
+		{
+			SubmissionRequest R;
+
+			try
+			{
+				R = Qrequest.deque();
+			}
+			catch(...)
+			{
+				// queue terminated and empty
+				break;
+			}
+
+			handle(R,lastcall);
+		}
+
+		return 0;
+	}
+};
+#endif
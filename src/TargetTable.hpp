@@ -0,0 +1,194 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(TARGETTABLE_HPP)
+#define TARGETTABLE_HPP
+
+#include <libmaus2/exception/LibMausException.hpp>
+#include <StringRef.hpp>
+
+#include <vector>
+#include <limits>
+
+/*
+ * interned target names. Each distinct name is assigned a 32 bit id, the
+ * names themselves are not copied but refer to the input of the parser.
+ * Lookups go through open addressing hash tables (linear probing). The
+ * names are distributed over several tables (shards) by their hash value,
+ * so the tables can be filled by several threads.
+ */
+struct TargetTable
+{
+	struct Shard
+	{
+		// local id plus one of the name in the slot, 0 for empty slots
+		std::vector < uint32_t > slots;
+		uint64_t mask;
+		// id of the first name in the shard
+		uint64_t base;
+		// names in the order of insertion, moved to the global list after building
+		std::vector < StringRef > names;
+
+		Shard() : mask(0), base(0) {}
+	};
+
+	std::vector < Shard > shards;
+	// names by id
+	std::vector < StringRef > names;
+
+	TargetTable() {}
+
+	uint64_t size() const
+	{
+		return names.size();
+	}
+
+	StringRef const & operator[](uint64_t const id) const
+	{
+		return names[id];
+	}
+
+	uint64_t getShard(uint64_t const h) const
+	{
+		// the low bits select the slot
+		return (h >> 48) & (shards.size()-1);
+	}
+
+	static uint64_t nextPowerOfTwo(uint64_t const n)
+	{
+		uint64_t p = 1;
+		while ( p < n )
+			p <<= 1;
+		return p;
+	}
+
+	// find name, returns false if it is not in the table
+	bool find(StringRef const & name, uint32_t & id) const
+	{
+		if ( ! shards.size() )
+			return false;
+
+		uint64_t const h = name.hash();
+		Shard const & S = shards[getShard(h)];
+
+		for ( uint64_t i = h & S.mask; S.slots[i]; i = (i+1) & S.mask )
+			if ( names[S.base + S.slots[i] - 1] == name )
+			{
+				id = S.base + S.slots[i] - 1;
+				return true;
+			}
+
+		return false;
+	}
+
+	// insert name into shard S if it is not present yet (while building)
+	static void insert(Shard & S, StringRef const & name, uint64_t const h)
+	{
+		uint64_t i = h & S.mask;
+
+		for ( ; S.slots[i]; i = (i+1) & S.mask )
+			if ( S.names[S.slots[i]-1] == name )
+				return;
+
+		S.names.push_back(name);
+		S.slots[i] = S.names.size();
+	}
+
+	/*
+	 * build the table from the names in the lists (duplicates allowed).
+	 * Ids are assigned per shard in the order of first occurrence.
+	 */
+	void build(std::vector < std::vector < StringRef > const * > const & lists, uint64_t const numthreads)
+	{
+		uint64_t const numshards = nextPowerOfTwo(4 * std::max(numthreads,static_cast<uint64_t>(1)));
+		uint64_t const numlists = lists.size();
+
+		shards.resize(0);
+		shards.resize(numshards);
+		names.resize(0);
+
+		// names of each list sorted by shard
+		std::vector < std::vector < std::vector < StringRef > > > buckets(
+			numlists, std::vector < std::vector < StringRef > >(numshards)
+		);
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( uint64_t l = 0; l < numlists; ++l )
+		{
+			std::vector < StringRef > const & V = *(lists[l]);
+
+			for ( uint64_t i = 0; i < V.size(); ++i )
+				buckets[l][getShard(V[i].hash())].push_back(V[i]);
+		}
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( uint64_t s = 0; s < numshards; ++s )
+		{
+			Shard & S = shards[s];
+
+			uint64_t n = 0;
+			for ( uint64_t l = 0; l < numlists; ++l )
+				n += buckets[l][s].size();
+
+			// load factor at most 1/2
+			S.slots.resize(nextPowerOfTwo(std::max(2*n,static_cast<uint64_t>(16))));
+			S.mask = S.slots.size()-1;
+
+			for ( uint64_t l = 0; l < numlists; ++l )
+			{
+				std::vector < StringRef > & V = buckets[l][s];
+
+				for ( uint64_t i = 0; i < V.size(); ++i )
+					insert(S,V[i],V[i].hash());
+
+				std::vector < StringRef >().swap(V);
+			}
+		}
+
+		uint64_t total = 0;
+		for ( uint64_t s = 0; s < numshards; ++s )
+		{
+			shards[s].base = total;
+			total += shards[s].names.size();
+		}
+
+		if ( total > std::numeric_limits<uint32_t>::max() )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] TargetTable: number of targets " << total << " exceeds 32 bit id space" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		names.resize(total);
+
+		#if defined(_OPENMP)
+		#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
+		#endif
+		for ( uint64_t s = 0; s < numshards; ++s )
+		{
+			Shard & S = shards[s];
+			std::copy(S.names.begin(),S.names.end(),names.begin() + S.base);
+			std::vector < StringRef >().swap(S.names);
+		}
+	}
+};
+#endif
@@ -0,0 +1,369 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#if ! defined(WRITEAHEADLOG_HPP)
+#define WRITEAHEADLOG_HPP
+
+#include <libmaus2/util/NumberSerialisation.hpp>
+#include <libmaus2/util/StringSerialisation.hpp>
+#include <libmaus2/util/GetFileSize.hpp>
+#include <libmaus2/aio/InputStreamInstance.hpp>
+#include <libmaus2/digest/md5.hpp>
+#include <libmaus2/exception/LibMausException.hpp>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+/*
+ * state change of a single command
+ */
+struct CommandStateUpdate
+{
+	uint64_t containerid;
+	uint64_t subid;
+	uint64_t numattempts;
+	bool completed;
+
+	CommandStateUpdate() : containerid(0), subid(0), numattempts(0), completed(false) {}
+	CommandStateUpdate(
+		uint64_t const rcontainerid,
+		uint64_t const rsubid,
+		uint64_t const rnumattempts,
+		bool const rcompleted
+	) : containerid(rcontainerid), subid(rsubid), numattempts(rnumattempts), completed(rcompleted) {}
+
+	std::ostream & serialise(std::ostream & out) const
+	{
+		libmaus2::util::NumberSerialisation::serialiseNumber(out,containerid);
+		libmaus2::util::NumberSerialisation::serialiseNumber(out,subid);
+		libmaus2::util::NumberSerialisation::serialiseNumber(out,numattempts);
+		libmaus2::util::NumberSerialisation::serialiseNumber(out,completed);
+		return out;
+	}
+
+	std::istream & deserialise(std::istream & in)
+	{
+		containerid = libmaus2::util::NumberSerialisation::deserialiseNumber(in);
+		subid = libmaus2::util::NumberSerialisation::deserialiseNumber(in);
+		numattempts = libmaus2::util::NumberSerialisation::deserialiseNumber(in);
+		completed = libmaus2::util::NumberSerialisation::deserialiseNumber(in);
+		return in;
+	}
+};
+
+/*
+ * append only log of command state updates
+ *
+ * Updates are collected in memory and written as a group (one write call
+ * per group). A group consists of the number of updates, the updates and
+ * the MD5 checksum of the serialised updates. A group which is incomplete
+ * or has a checksum mismatch (e.g. after a crash during writing) ends the
+ * log on replay. Updates store absolute values, so replaying a log more
+ * than once is harmless.
+ */
+struct WriteAheadLog
+{
+	enum sync_policy
+	{
+		// write groups to the file system, leave flushing to the OS
+		sync_policy_write,
+		// call fdatasync after each group
+		sync_policy_fsync
+	};
+
+	std::string const fn;
+	int fd;
+	sync_policy const policy;
+	// maximum number of updates held in memory
+	uint64_t const groupsize;
+	// maximum time in milliseconds an update is held in memory
+	uint64_t const groupinterval;
+
+	std::vector < CommandStateUpdate > pending;
+	uint64_t pendingsince;
+	// number of updates written since last truncation
+	uint64_t numlogged;
+
+	static uint64_t getTimeMilliSeconds()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC,&ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000ull + static_cast<uint64_t>(ts.tv_nsec) / 1000000ull;
+	}
+
+	static sync_policy parseSyncPolicy(std::string const & s)
+	{
+		if ( s == "write" )
+			return sync_policy_write;
+		else if ( s == "fsync" )
+			return sync_policy_fsync;
+		else
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] unknown log sync policy " << s << " (supported: write, fsync)" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
+
+	WriteAheadLog(
+		std::string const & rfn,
+		sync_policy const rpolicy,
+		uint64_t const rgroupsize,
+		uint64_t const rgroupinterval
+	) : fn(rfn), fd(-1), policy(rpolicy), groupsize(std::max(rgroupsize,static_cast<uint64_t>(1))), groupinterval(rgroupinterval),
+	    pending(), pendingsince(0), numlogged(0)
+	{
+		while ( (fd = ::open(fn.c_str(),O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC,0644)) < 0 )
+		{
+			int const error = errno;
+
+			switch ( error )
+			{
+				case EINTR:
+				case EAGAIN:
+					break;
+				default:
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] WriteAheadLog: unable to open " << fn << ": " << strerror(error) << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+		}
+	}
+
+	~WriteAheadLog()
+	{
+		if ( fd >= 0 )
+		{
+			::close(fd);
+			fd = -1;
+		}
+	}
+
+	void append(CommandStateUpdate const & U)
+	{
+		if ( ! pending.size() )
+			pendingsince = getTimeMilliSeconds();
+		pending.push_back(U);
+	}
+
+	bool commitDue() const
+	{
+		return
+			pending.size() >= groupsize
+			||
+			(pending.size() && getTimeMilliSeconds() - pendingsince >= groupinterval);
+	}
+
+	static std::string serialiseUpdates(std::vector < CommandStateUpdate > const & V)
+	{
+		std::ostringstream dstr;
+		for ( uint64_t i = 0; i < V.size(); ++i )
+			V[i].serialise(dstr);
+		return dstr.str();
+	}
+
+	static std::string serialiseGroup(std::vector < CommandStateUpdate > const & V)
+	{
+		std::string const data = serialiseUpdates(V);
+
+		std::string md5data;
+		libmaus2::util::MD5::md5(data,md5data);
+
+		std::ostringstream ostr;
+		libmaus2::util::NumberSerialisation::serialiseNumber(ostr,V.size());
+		ostr.write(data.c_str(),data.size());
+		libmaus2::util::StringSerialisation::serialiseString(ostr,md5data);
+
+		return ostr.str();
+	}
+
+	void writeData(char const * p, uint64_t n)
+	{
+		while ( n )
+		{
+			::ssize_t const r = ::write(fd,p,n);
+
+			if ( r < 0 )
+			{
+				int const error = errno;
+
+				switch ( error )
+				{
+					case EINTR:
+					case EAGAIN:
+						break;
+					default:
+					{
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] WriteAheadLog: write to " << fn << " failed: " << strerror(error) << std::endl;
+						lme.finish();
+						throw lme;
+					}
+				}
+			}
+			else
+			{
+				p += r;
+				n -= r;
+			}
+		}
+	}
+
+	void sync()
+	{
+		while ( ::fdatasync(fd) != 0 )
+		{
+			int const error = errno;
+
+			switch ( error )
+			{
+				case EINTR:
+				case EAGAIN:
+					break;
+				default:
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] WriteAheadLog: fdatasync on " << fn << " failed: " << strerror(error) << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+		}
+	}
+
+	// write all pending updates as one group
+	void commit()
+	{
+		if ( ! pending.size() )
+			return;
+
+		std::string const data = serialiseGroup(pending);
+		writeData(data.c_str(),data.size());
+
+		if ( policy == sync_policy_fsync )
+			sync();
+
+		numlogged += pending.size();
+		pending.resize(0);
+	}
+
+	void commitIfDue()
+	{
+		if ( commitDue() )
+			commit();
+	}
+
+	/*
+	 * drop log contents including pending updates, called after the
+	 * current state has been written to the container file
+	 */
+	void truncate()
+	{
+		pending.resize(0);
+
+		while ( ::ftruncate(fd,0) != 0 )
+		{
+			int const error = errno;
+
+			switch ( error )
+			{
+				case EINTR:
+				case EAGAIN:
+					break;
+				default:
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] WriteAheadLog: ftruncate on " << fn << " failed: " << strerror(error) << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+		}
+
+		if ( policy == sync_policy_fsync )
+			sync();
+
+		numlogged = 0;
+	}
+
+	/*
+	 * read updates from log file fn. Reading stops at the first incomplete
+	 * or damaged group.
+	 */
+	static std::vector < CommandStateUpdate > replay(std::string const & fn)
+	{
+		std::vector < CommandStateUpdate > V;
+
+		if ( ! libmaus2::util::GetFileSize::fileExists(fn) )
+			return V;
+
+		uint64_t const n = libmaus2::util::GetFileSize::getFileSize(fn);
+		uint64_t numgroups = 0;
+
+		libmaus2::aio::InputStreamInstance ISI(fn);
+
+		while ( ISI && ISI.peek() != std::istream::traits_type::eof() )
+		{
+			try
+			{
+				uint64_t const groupstart = ISI.tellg();
+				uint64_t const numrec = libmaus2::util::NumberSerialisation::deserialiseNumber(ISI);
+
+				// each record takes 32 bytes, reject sizes not fitting into the rest of the file
+				if ( numrec > (n - groupstart) / 32 )
+				{
+					std::cerr << "[W] WriteAheadLog: ignoring damaged group at offset " << groupstart << " in " << fn << std::endl;
+					break;
+				}
+
+				std::vector < CommandStateUpdate > G(numrec);
+				for ( uint64_t i = 0; i < numrec; ++i )
+					G[i].deserialise(ISI);
+				std::string const md5in = libmaus2::util::StringSerialisation::deserialiseString(ISI);
+
+				std::string md5data;
+				libmaus2::util::MD5::md5(serialiseUpdates(G),md5data);
+
+				if ( md5in != md5data )
+				{
+					std::cerr << "[W] WriteAheadLog: checksum mismatch for group at offset " << groupstart << " in " << fn << ", ignoring rest of log" << std::endl;
+					break;
+				}
+
+				V.insert(V.end(),G.begin(),G.end());
+				numgroups += 1;
+			}
+			catch(std::exception const & ex)
+			{
+				std::cerr << "[W] WriteAheadLog: ignoring incomplete group at end of " << fn << std::endl;
+				break;
+			}
+		}
+
+		std::cerr << "[V] WriteAheadLog: read " << V.size() << " updates in " << numgroups << " groups from " << fn << std::endl;
+
+		return V;
+	}
+};
+#endif
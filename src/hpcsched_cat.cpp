@@ -0,0 +1,73 @@
+/*
+    libmaus2
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <FileCopy.hpp>
+#include <ModuleMessage.hpp>
+
+/*
+ * concatenation of files
+ *
+ * call: hpcsched::cat [-t<threads>] <output> <input> ...
+ *
+ * writes the concatenation of the input files to the output file, like
+ * cat <input> ... ><output> would. See FileCopy for how the data is copied.
+ */
+
+int hpcsched_cat_cpp(char const * c, uint64_t const n, int const errfd)
+{
+	try
+	{
+		uint64_t numthreads = 4;
+		std::vector < std::string > const V = FileCopy::parseArguments(c,n,numthreads);
+
+		if ( V.size() < 1 )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] hpcsched::cat: usage: [-t<threads>] <output> <input> ..." << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		FileCopy copy(V[0],numthreads);
+		copy.run(std::vector < std::string >(V.begin()+1,V.end()));
+
+		std::ostringstream ostr;
+		ostr << "[V] hpcsched::cat concatenated " << (V.size()-1) << " files (" << copy.numbytes << " bytes)\n";
+		ModuleMessage::write(errfd,ostr.str().c_str());
+
+		return EXIT_SUCCESS;
+	}
+	catch(std::exception const & ex)
+	{
+		ModuleMessage::write(errfd,ex.what());
+		return EXIT_FAILURE;
+	}
+}
+
+extern "C" {
+
+	int hpcsched_cat(char const * c, uint64_t const n)
+	{
+		return hpcsched_cat_cpp(c,n,STDERR_FILENO);
+	}
+
+	// thread safe variant writing messages to errfd
+	int hpcsched_cat_fd(char const * c, uint64_t const n, int const errfd)
+	{
+		return hpcsched_cat_cpp(c,n,errfd);
+	}
+}
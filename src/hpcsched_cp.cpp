@@ -0,0 +1,106 @@
+/*
+    libmaus2
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <FileCopy.hpp>
+#include <ModuleMessage.hpp>
+
+/*
+ * copying of files
+ *
+ * call: hpcsched::cp [-t<threads>] <source> <dest>
+ *       hpcsched::cp [-t<threads>] <source> ... <directory>
+ *
+ * Like cp, if the last argument is an existing directory the sources are
+ * copied into it under their base names. New files get the permissions of
+ * their source. See FileCopy for how the data is copied.
+ */
+
+int hpcsched_cp_cpp(char const * c, uint64_t const n, int const errfd)
+{
+	try
+	{
+		uint64_t numthreads = 4;
+		std::vector < std::string > const V = FileCopy::parseArguments(c,n,numthreads);
+
+		if ( V.size() < 2 )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] hpcsched::cp: usage: [-t<threads>] <source> ... <dest>" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		std::string const & dest = V.back();
+		struct stat db;
+		bool const destisdir = ::stat(dest.c_str(),&db) == 0 && S_ISDIR(db.st_mode);
+
+		if ( V.size() > 2 && ! destisdir )
+		{
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] hpcsched::cp: target " << dest << " is not a directory" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+
+		uint64_t numbytes = 0;
+
+		for ( uint64_t i = 0; i + 1 < V.size(); ++i )
+		{
+			std::string const & source = V[i];
+			std::string target = dest;
+
+			if ( destisdir )
+			{
+				std::string::size_type const p = source.find_last_of('/');
+				target += "/" + ((p == std::string::npos) ? source : source.substr(p+1));
+			}
+
+			struct stat sb;
+			if ( ::stat(source.c_str(),&sb) != 0 )
+				FileCopy::throwError("stat",source,errno);
+
+			FileCopy copy(target,numthreads);
+			copy.run(std::vector < std::string >(1,source),sb.st_mode & 0777);
+			numbytes += copy.numbytes;
+		}
+
+		std::ostringstream ostr;
+		ostr << "[V] hpcsched::cp copied " << (V.size()-1) << " files (" << numbytes << " bytes)\n";
+		ModuleMessage::write(errfd,ostr.str().c_str());
+
+		return EXIT_SUCCESS;
+	}
+	catch(std::exception const & ex)
+	{
+		ModuleMessage::write(errfd,ex.what());
+		return EXIT_FAILURE;
+	}
+}
+
+extern "C" {
+
+	int hpcsched_cp(char const * c, uint64_t const n)
+	{
+		return hpcsched_cp_cpp(c,n,STDERR_FILENO);
+	}
+
+	// thread safe variant writing messages to errfd
+	int hpcsched_cp_fd(char const * c, uint64_t const n, int const errfd)
+	{
+		return hpcsched_cp_cpp(c,n,errfd);
+	}
+}
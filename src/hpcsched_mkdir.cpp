@@ -15,6 +15,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <ModuleMessage.hpp>
 #include <libmaus2/types/types.hpp>
 #include <libmaus2/exception/LibMausException.hpp>
 #include <string>
@@ -22,6 +23,7 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 bool isDir(std::string const & sdir)
 {
@@ -100,7 +102,7 @@ void smkdir(std::string const & sdir)
 
 }
 
-int hpcsched_mkdir_cpp(char const * c, uint64_t const n)
+int hpcsched_mkdir_cpp(char const * c, uint64_t const n, int const errfd)
 {
 	try
 	{
@@ -110,8 +112,7 @@ int hpcsched_mkdir_cpp(char const * c, uint64_t const n)
 	}
 	catch(std::exception const & ex)
 	{
-		char const * what = ex.what();
-		fprintf(stderr,"%s",what);
+		ModuleMessage::write(errfd,ex.what());
 		return EXIT_FAILURE;
 	}
 }
@@ -120,6 +121,12 @@ extern "C" {
 
 	int hpcsched_mkdir(char const * c, uint64_t const n)
 	{
-		return hpcsched_mkdir_cpp(c,n);
+		return hpcsched_mkdir_cpp(c,n,STDERR_FILENO);
+	}
+
+	// thread safe variant writing messages to errfd
+	int hpcsched_mkdir_fd(char const * c, uint64_t const n, int const errfd)
+	{
+		return hpcsched_mkdir_cpp(c,n,errfd);
 	}
 }
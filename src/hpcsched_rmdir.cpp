@@ -15,6 +15,7 @@
     You should have received a copy of the GNU General Public License
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include <ModuleMessage.hpp>
 #include <libmaus2/types/types.hpp>
 #include <libmaus2/exception/LibMausException.hpp>
 #include <string>
@@ -58,7 +59,7 @@ void srmdir(std::string const & sdir)
 
 }
 
-int hpcsched_rmdir_cpp(char const * c, uint64_t const n)
+int hpcsched_rmdir_cpp(char const * c, uint64_t const n, int const errfd)
 {
 	try
 	{
@@ -68,8 +69,7 @@ int hpcsched_rmdir_cpp(char const * c, uint64_t const n)
 	}
 	catch(std::exception const & ex)
 	{
-		char const * what = ex.what();
-		fprintf(stderr,"%s",what);
+		ModuleMessage::write(errfd,ex.what());
 		return EXIT_FAILURE;
 	}
 }
@@ -78,6 +78,12 @@ extern "C" {
 
 	int hpcsched_rmdir(char const * c, uint64_t const n)
 	{
-		return hpcsched_rmdir_cpp(c,n);
+		return hpcsched_rmdir_cpp(c,n,STDERR_FILENO);
+	}
+
+	// thread safe variant writing messages to errfd
+	int hpcsched_rmdir_fd(char const * c, uint64_t const n, int const errfd)
+	{
+		return hpcsched_rmdir_cpp(c,n,errfd);
 	}
 }
@@ -0,0 +1,511 @@
+/*
+    libmaus2
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <ModuleMessage.hpp>
+#include <libmaus2/types/types.hpp>
+#include <libmaus2/exception/LibMausException.hpp>
+#include <libmaus2/parallel/PosixThread.hpp>
+#include <libmaus2/parallel/PosixMutex.hpp>
+#include <libmaus2/parallel/TerminatableSynchronousQueue.hpp>
+#include <string>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <atomic>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+/*
+ * parallel removal of directory trees and files
+ *
+ * call: hpcsched::rmtree [-t<threads>] <path> ...
+ *
+ * Files and symbolic links given are unlinked, directories are removed
+ * along with their contents. Paths which do not exist are ignored, like
+ * they are by hpcsched::rmdir. Each directory is read by one of the
+ * threads, which unlinks the non-directory entries and queues the
+ * subdirectories for the other threads. A directory is removed once all
+ * its entries are gone. Directories are opened and removed relative to
+ * the descriptor of their parent directory (openat, unlinkat), so
+ * symbolic links inside the trees are never followed, even if a directory
+ * is replaced by one during the removal, and the depth of a tree is not
+ * limited by PATH_MAX.
+ */
+
+/*
+ * directory in removal. pending is the number of subdirectories not yet
+ * removed plus one while the directory itself is being read. fd stays
+ * open until pending reaches 0, so the subdirectories can be opened and
+ * removed relative to it. parentfd is the fd of the parent node or, for
+ * a directory given as argument, a descriptor of its parent directory
+ * owned by the node.
+ */
+struct DirNode
+{
+	// full path, used for messages only
+	std::string path;
+	// name in the parent directory
+	std::string name;
+	DirNode * parent;
+	int parentfd;
+	int fd;
+	std::atomic<uint64_t> pending;
+
+	DirNode(std::string const & rpath, std::string const & rname, DirNode * rparent, int const rparentfd)
+	: path(rpath), name(rname), parent(rparent), parentfd(rparentfd), fd(-1), pending(1) {}
+};
+
+/*
+ * reader for the entries of a directory file descriptor. Uses getdents64
+ * on Linux to read many entries per system call without the buffering
+ * of a DIR stream.
+ */
+struct DirReader
+{
+	int const fd;
+	#if defined(__linux__) && defined(SYS_getdents64)
+	struct linux_dirent64
+	{
+		uint64_t d_ino;
+		int64_t d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[];
+	};
+
+	std::vector < char > B;
+	uint64_t p;
+	uint64_t n;
+
+	DirReader(int const rfd) : fd(rfd), B(64*1024), p(0), n(0) {}
+
+	// get next entry, returns false at the end of the directory
+	bool getNext(char const * & name, unsigned char & type)
+	{
+		while ( true )
+		{
+			if ( p == n )
+			{
+				long const r = ::syscall(SYS_getdents64,fd,B.data(),B.size());
+
+				if ( r < 0 )
+				{
+					int const error = errno;
+
+					if ( error == EINTR )
+						continue;
+
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] getdents64: " << strerror(error) << std::endl;
+					lme.finish();
+					throw lme;
+				}
+				else if ( r == 0 )
+					return false;
+
+				p = 0;
+				n = r;
+			}
+
+			linux_dirent64 const * D = reinterpret_cast<linux_dirent64 const *>(B.data() + p);
+			p += D->d_reclen;
+
+			if ( isDot(D->d_name) )
+				continue;
+
+			name = D->d_name;
+			type = D->d_type;
+			return true;
+		}
+	}
+
+	~DirReader() {}
+	#else
+	DIR * dir;
+
+	DirReader(int const rfd) : fd(rfd), dir(0)
+	{
+		int const dupfd = ::dup(fd);
+
+		if ( dupfd < 0 || ! (dir = ::fdopendir(dupfd)) )
+		{
+			int const error = errno;
+			if ( dupfd >= 0 )
+				::close(dupfd);
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] fdopendir: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
+
+	bool getNext(char const * & name, unsigned char & type)
+	{
+		struct dirent * D;
+
+		while ( (D = ::readdir(dir)) )
+		{
+			if ( isDot(D->d_name) )
+				continue;
+
+			name = D->d_name;
+			type = D->d_type;
+			return true;
+		}
+
+		return false;
+	}
+
+	~DirReader()
+	{
+		::closedir(dir);
+	}
+	#endif
+
+	static bool isDot(char const * name)
+	{
+		return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+	}
+};
+
+struct RemoveTree
+{
+	struct RemoveThread : public libmaus2::parallel::PosixThread
+	{
+		RemoveTree & tree;
+
+		RemoveThread(RemoveTree & rtree) : tree(rtree) {}
+
+		virtual void * run()
+		{
+			tree.work();
+			return 0;
+		}
+	};
+
+	libmaus2::parallel::TerminatableSynchronousQueue < DirNode * > Q;
+	// number of directories given as arguments not yet removed
+	std::atomic<uint64_t> numroots;
+	std::atomic<uint64_t> numentries;
+	std::atomic<uint64_t> numbytes;
+
+	libmaus2::parallel::PosixMutex errorlock;
+	// first error seen
+	std::string error;
+
+	RemoveTree() : numroots(0), numentries(0), numbytes(0) {}
+
+	void setError(std::string const & s)
+	{
+		errorlock.lock();
+		if ( ! error.size() )
+			error = s;
+		errorlock.unlock();
+	}
+
+	void setError(char const * call, std::string const & path, int const error)
+	{
+		std::ostringstream ostr;
+		ostr << "[E] hpcsched::rmtree: " << call << "(" << path << "): " << strerror(error) << "\n";
+		setError(ostr.str());
+	}
+
+	// remove non-directory name in directory dirfd, returns false if it turned out to be a directory
+	bool removeEntry(int const dirfd, std::string const & path, char const * name)
+	{
+		struct stat sb;
+		bool const havestat = ::fstatat(dirfd,name,&sb,AT_SYMLINK_NOFOLLOW) == 0;
+
+		if ( havestat && S_ISDIR(sb.st_mode) )
+			return false;
+
+		while ( ::unlinkat(dirfd,name,0) != 0 )
+		{
+			int const error = errno;
+
+			if ( error == EINTR )
+				continue;
+			else if ( error == EISDIR || error == EPERM )
+			{
+				// EPERM is returned by unlinkat for directories on some systems
+				struct stat db;
+				if ( ::fstatat(dirfd,name,&db,AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(db.st_mode) )
+					return false;
+			}
+
+			if ( error != ENOENT )
+				setError("unlinkat",path + "/" + name,error);
+
+			return true;
+		}
+
+		numentries += 1;
+		if ( havestat )
+			numbytes += sb.st_size;
+
+		return true;
+	}
+
+	// one subdirectory of node or node itself has been read completely
+	void release(DirNode * node)
+	{
+		while ( node && --(node->pending) == 0 )
+		{
+			DirNode * parent = node->parent;
+
+			if ( node->fd >= 0 )
+				::close(node->fd);
+
+			bool removed = true;
+			while ( ::unlinkat(node->parentfd,node->name.c_str(),AT_REMOVEDIR) != 0 )
+			{
+				int const error = errno;
+
+				if ( error == EINTR )
+					continue;
+				if ( error != ENOENT )
+					setError("unlinkat",node->path,error);
+				removed = false;
+				break;
+			}
+
+			if ( removed )
+				numentries += 1;
+
+			if ( ! parent )
+				::close(node->parentfd);
+
+			if ( ! parent && --numroots == 0 )
+				Q.terminate();
+
+			delete node;
+			node = parent;
+		}
+	}
+
+	void process(DirNode * node)
+	{
+		try
+		{
+			int const fd = ::openat(node->parentfd,node->name.c_str(),O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC);
+
+			if ( fd < 0 )
+			{
+				int const error = errno;
+				if ( error != ENOENT )
+					setError("openat",node->path,error);
+			}
+			else
+			{
+				// closed by release
+				node->fd = fd;
+
+				try
+				{
+					DirReader reader(fd);
+					char const * name;
+					unsigned char type;
+
+					while ( reader.getNext(name,type) )
+					{
+						bool isdir = (type == DT_DIR);
+
+						if ( ! isdir )
+							isdir = ! removeEntry(fd,node->path,name);
+
+						if ( isdir )
+						{
+							// count the subdirectory before it can be processed by another thread
+							node->pending += 1;
+							Q.enque(new DirNode(node->path + "/" + name, name, node, fd));
+						}
+					}
+				}
+				catch(std::exception const & ex)
+				{
+					setError(std::string("[E] hpcsched::rmtree: ") + node->path + ": " + ex.what());
+				}
+			}
+		}
+		catch(std::exception const & ex)
+		{
+			setError(ex.what());
+		}
+
+		release(node);
+	}
+
+	void work()
+	{
+		while ( true )
+		{
+			DirNode * node = 0;
+
+			try
+			{
+				node = Q.deque();
+			}
+			catch(...)
+			{
+				// queue terminated
+				break;
+			}
+
+			process(node);
+		}
+	}
+
+	void run(std::vector < std::string > const & Vpath, uint64_t const numthreads)
+	{
+		std::vector < DirNode * > Vdir;
+
+		for ( uint64_t i = 0; i < Vpath.size(); ++i )
+		{
+			std::string const & path = Vpath[i];
+			struct stat sb;
+
+			if ( ::lstat(path.c_str(),&sb) != 0 )
+			{
+				int const error = errno;
+				if ( error != ENOENT )
+					setError("lstat",path,error);
+			}
+			else if ( S_ISDIR(sb.st_mode) )
+			{
+				// split into parent directory and name, ignoring trailing slashes
+				std::string::size_type e = path.size();
+				while ( e > 1 && path[e-1] == '/' )
+					--e;
+				std::string::size_type const b = path.find_last_of('/',e-1);
+				std::string const dir = (b == std::string::npos) ? std::string(".") : (b == 0 ? std::string("/") : path.substr(0,b));
+				std::string const name = (b == std::string::npos) ? path.substr(0,e) : path.substr(b+1,e-(b+1));
+
+				if ( ! name.size() || name == "." || name == ".." )
+				{
+					setError("unlinkat",path,EINVAL);
+					continue;
+				}
+
+				int const parentfd = ::open(dir.c_str(),O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+
+				if ( parentfd < 0 )
+					setError("open",dir,errno);
+				else
+					Vdir.push_back(new DirNode(path.substr(0,e),name,0,parentfd));
+			}
+			else if ( ::unlink(path.c_str()) == 0 )
+			{
+				numentries += 1;
+				numbytes += sb.st_size;
+			}
+			else if ( errno != ENOENT )
+				setError("unlink",path,errno);
+		}
+
+		if ( ! Vdir.size() )
+			return;
+
+		// set before any thread can finish a root directory
+		numroots = Vdir.size();
+		for ( uint64_t i = 0; i < Vdir.size(); ++i )
+			Q.enque(Vdir[i]);
+
+		std::vector < libmaus2::util::shared_ptr<RemoveThread>::type > threads;
+		for ( uint64_t i = 0; i < numthreads; ++i )
+		{
+			libmaus2::util::shared_ptr<RemoveThread>::type T(new RemoveThread(*this));
+			threads.push_back(T);
+			T->start();
+		}
+		for ( uint64_t i = 0; i < threads.size(); ++i )
+			threads[i]->join();
+	}
+};
+
+int hpcsched_rmtree_cpp(char const * c, uint64_t const n, int const errfd)
+{
+	try
+	{
+		std::istringstream istr(std::string(c,c+n));
+		std::vector < std::string > Vpath;
+		uint64_t numthreads = 8;
+		std::string s;
+
+		while ( istr >> s )
+		{
+			if ( s.size() > 2 && s.substr(0,2) == "-t" )
+			{
+				std::istringstream tistr(s.substr(2));
+				tistr >> numthreads;
+
+				if ( ! tistr || tistr.peek() != std::istream::traits_type::eof() )
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] hpcsched::rmtree: unable to parse " << s << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+			else
+				Vpath.push_back(s);
+		}
+
+		numthreads = std::max(numthreads,static_cast<uint64_t>(1));
+
+		RemoveTree tree;
+		tree.run(Vpath,numthreads);
+
+		std::ostringstream ostr;
+		ostr << "[V] hpcsched::rmtree removed " << tree.numentries << " entries (" << tree.numbytes << " bytes)\n";
+		ModuleMessage::write(errfd,ostr.str().c_str());
+
+		if ( tree.error.size() )
+		{
+			ModuleMessage::write(errfd,tree.error.c_str());
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	}
+	catch(std::exception const & ex)
+	{
+		ModuleMessage::write(errfd,ex.what());
+		return EXIT_FAILURE;
+	}
+}
+
+extern "C" {
+
+	int hpcsched_rmtree(char const * c, uint64_t const n)
+	{
+		return hpcsched_rmtree_cpp(c,n,STDERR_FILENO);
+	}
+
+	// thread safe variant writing messages to errfd
+	int hpcsched_rmtree_fd(char const * c, uint64_t const n, int const errfd)
+	{
+		return hpcsched_rmtree_cpp(c,n,errfd);
+	}
+}
@@ -32,9 +32,14 @@
 #include <libmaus2/util/ContainerDescriptionList.hpp>
 #include <libmaus2/util/CommandContainer.hpp>
 #include <libmaus2/aio/InputOutputStreamInstance.hpp>
-#include <libmaus2/parallel/TerminatableSynchronousQueue.hpp>
 #include <libmaus2/digest/md5.hpp>
 #include <RunInfo.hpp>
+#include <WriteAheadLog.hpp>
+#include <CDLv2.hpp>
+#include <ReadyQueue.hpp>
+#include <BatchBackend.hpp>
+#include <SubmissionThread.hpp>
+#include <ModuleRunner.hpp>
 #include <sys/wait.h>
 
 #if defined(HAVE_EPOLL_CREATE) || defined(HAVE_EPOLL_CREATE1)
@@ -42,6 +47,8 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <fcntl.h>
 #include <pwd.h>
 
 #if 0
@@ -224,7 +231,7 @@ struct SlurmJobs
 };
 #endif
 
-#include <FDIO.hpp>
+#include <NonBlockingFDIO.hpp>
 
 std::string getUsage(libmaus2::util::ArgParser const & arg)
 {
@@ -238,7 +245,21 @@ std::string getUsage(libmaus2::util::ArgParser const & arg)
 	ostr << " --workertime: time for workers in (default: 1440)\n";
 	ostr << " --workermem : memory for workers (default: 40000)\n";
 	ostr << " -p          : cluster partition (default: haswell)\n";
-	ostr << " --workers   : number of workers (default: 16)\n";
+	ostr << " --workers   : number of workers per worker class (default: 16)\n";
+	ostr << " --workerclasses: worker class definition file or auto (default: single class)\n";
+	ostr << " --walsync   : durability of state log, write or fsync (default: write)\n";
+	ostr << " --walgroup  : maximum number of state updates per log write (default: 1024)\n";
+	ostr << " --walinterval: maximum time in milliseconds updates are held before writing the log (default: 1000)\n";
+	ostr << " --walcheckpoint: number of logged updates triggering a rewrite of the container file (default: 65536)\n";
+	ostr << " --queue     : order of ready jobs, fifo, critpath, priority or fanout (default: priority)\n";
+	ostr << " --backend   : system used for starting workers, slurm or local (default: slurm)\n";
+	ostr << " --maxarraysize: maximum number of workers submitted in one SLURM job array (default: 1000)\n";
+	ostr << " --batchtimeout: time in milliseconds after which calls to sbatch, scancel and squeue are aborted (default: 120000)\n";
+	ostr << " --submitinterval: minimum time between calls to the batch system in milliseconds (default: 100)\n";
+	ostr << " --submitretries: number of retries for failed worker submissions (default: 5)\n";
+	ostr << " --submitretrydelay: delay before first retry of a failed submission in milliseconds, doubled for each retry (default: 1000)\n";
+	ostr << " --controlmodules: comma separated modules run in the control process or none (default: mkdir,rmdir)\n";
+	ostr << " --controlmodulethreads: number of threads running module calls in the control process (default: 2)\n";
 
 	return ostr.str();
 }
@@ -277,12 +298,50 @@ struct SlurmControl
 		}
 	};
 
+	/*
+	 * protocol state of a worker connection, i.e. the message we
+	 * expect to receive next on the socket
+	 */
+	enum worker_protocol_state
+	{
+		// expect acknowledgement for current directory
+		worker_protocol_curdir,
+		// expect names of output, error and meta data files and capacity
+		worker_protocol_files,
+		// expect state message (idle, finished, running)
+		worker_protocol_ready,
+		// expect run info for a job we have just sent
+		worker_protocol_started
+	};
+
 	struct WorkerInfo
 	{
 		int64_t id;
 		libmaus2::network::SocketBase::unique_ptr_type Asocket;
+		NonBlockingFDIO fdio;
+		worker_protocol_state protostate;
+		// EPOLLOUT requested for socket
+		bool pollout;
 		bool active;
-		JobDescription packageid;
+		/*
+		 * slot is in wakeupSet while running jobs. Its request for work
+		 * has been answered with 3, so it is woken by the notification 5
+		 * instead of the reply 1.
+		 */
+		bool notify;
+		// jobs running on the worker
+		std::set<JobDescription> running;
+		/*
+		 * running jobs which are steps of a chain of fused commands sent
+		 * as a whole (see startJob), mapped to the end of the chain
+		 */
+		std::map<JobDescription,int64_t> chainend;
+		// capacity advertised by the worker, mem is 0 if unknown
+		uint64_t threads;
+		uint64_t mem;
+		// resources used by running jobs
+		uint64_t usedthreads;
+		uint64_t usedmem;
 		uint64_t workerid;
 		std::string wtmpbase;
 
@@ -296,163 +355,111 @@ struct SlurmControl
 		{
 			id = -1;
 			Asocket.reset();
+			fdio.reset();
+			protostate = worker_protocol_curdir;
+			pollout = false;
 			active = false;
+			notify = false;
 			workerid = std::numeric_limits<uint64_t>::max();
 			outdatafn = std::string();
 			errdatafn = std::string();
 			metafn = std::string();
-			resetPackageId();
+			threads = 0;
+			mem = 0;
+			resetRunning();
+		}
+
+		void resetRunning()
+		{
+			running.clear();
+			chainend.clear();
+			usedthreads = 0;
+			usedmem = 0;
 		}
 
-		void resetPackageId()
+		// check whether a job with the given requirements fits into the free capacity
+		bool fits(uint64_t const jobthreads, uint64_t const jobmem) const
 		{
-			packageid.reset();
+			return
+				usedthreads + jobthreads <= threads
+				&&
+				(mem == 0 || usedmem + jobmem <= mem);
 		}
 	};
 
-	struct StartWorkerRequest
+	// connection accepted but not yet matched to a worker slot
+	struct PendingConnection
 	{
-		uint64_t * nextworkerid;
-		std::string tmpfilebase;
-		std::string hostname;
-		uint64_t serverport;
-		uint64_t workertime;
-		uint64_t workermem;
-		uint64_t workerthreads;
-		std::string partition;
-		libmaus2::util::ArgParser const * arg;
-		WorkerInfo * AW;
-		uint64_t i;
-		std::map<uint64_t,uint64_t> * idToSlot;
-		uint64_t workers;
-		libmaus2::util::TempFileNameGenerator * tmpgen;
-
-		StartWorkerRequest() {}
-		StartWorkerRequest(
-			uint64_t & rnextworkerid,
-			std::string rtmpfilebase,
-			std::string rhostname,
-			uint64_t rserverport,
-			uint64_t rworkertime,
-			uint64_t rworkermem,
-			uint64_t rworkerthreads,
-			std::string rpartition,
-			libmaus2::util::ArgParser const & rarg,
-			WorkerInfo * rAW,
-			uint64_t ri,
-			std::map<uint64_t,uint64_t> & ridToSlot,
-			uint64_t rworkers,
-			libmaus2::util::TempFileNameGenerator * rtmpgen
-		) :
-			nextworkerid(&rnextworkerid),
-			tmpfilebase(rtmpfilebase),
-			hostname(rhostname),
-			serverport(rserverport),
-			workertime(rworkertime),
-			workermem(rworkermem),
-			workerthreads(rworkerthreads),
-			partition(rpartition),
-			arg(&rarg),
-			AW(rAW),
-			i(ri),
-			idToSlot(&ridToSlot),
-			workers(rworkers),
-			tmpgen(rtmpgen)
-		{
-
-		}
-
-		void dispatch()
-		{
-			uint64_t const workerid = (*nextworkerid)++;
-			std::ostringstream workernamestr;
-			workernamestr << "worker_" << workerid;
-			std::string const workername = workernamestr.str();
+		typedef PendingConnection this_type;
+		typedef libmaus2::util::shared_ptr<this_type>::type shared_ptr_type;
 
-			std::ostringstream wtmpbasestr;
-			wtmpbasestr << tmpgen->getFileName() << "_" << workerid;
-			std::string const wtmpbase = wtmpbasestr.str();
-
-			std::ostringstream outfnstr;
-			outfnstr << wtmpbase << ".out";
-			std::string const outfn = outfnstr.str();
-
-			std::string const descname = wtmpbase + "_worker.sbatch";
-
-			std::ostringstream commandstr;
-			commandstr << "hpcschedworker " << hostname << " " << serverport;
-			std::string command = commandstr.str();
-
-			writeJobDescription(
-				descname,
-				workername,
-				outfn,
-				workertime,
-				workermem,
-				workerthreads,
-				partition,
-				command
-			);
+		libmaus2::network::SocketBase::unique_ptr_type Asocket;
+		NonBlockingFDIO fdio;
 
-			std::vector<std::string> Varg;
-			Varg.push_back("sbatch");
-			Varg.push_back(descname);
+		PendingConnection(libmaus2::network::SocketBase::unique_ptr_type & rAsocket)
+		: Asocket(UNIQUE_PTR_MOVE(rAsocket)), fdio(Asocket->getFD())
+		{
 
-			std::string const jobid_s = runProgram(Varg,*arg);
+		}
+	};
 
-			std::deque<std::string> Vtoken = libmaus2::util::stringFunctions::tokenize(jobid_s,std::string(" "));
+	/*
+	 * class of workers started with the same resources. Each class has a
+	 * fixed set of slots, slots are submitted to the batch system when
+	 * jobs of the class are ready and stopped when the class runs dry.
+	 */
+	struct WorkerClass
+	{
+		uint64_t threads;
+		uint64_t mem;
+		uint64_t time;
+		std::string partition;
+		uint64_t maxworkers;
+		// slots belonging to this class
+		std::vector<uint64_t> slots;
+		// slots currently not submitted to the batch system
+		std::set<uint64_t> stopped;
 
-			if ( Vtoken.size() >= 4 )
-			{
-				std::istringstream istr(Vtoken[3]);
-				uint64_t id;
-				istr >> id;
+		WorkerClass() {}
+		WorkerClass(
+			uint64_t const rthreads,
+			uint64_t const rmem,
+			uint64_t const rtime,
+			std::string const & rpartition,
+			uint64_t const rmaxworkers
+		) : threads(rthreads), mem(rmem), time(rtime), partition(rpartition), maxworkers(rmaxworkers)
+		{
+		}
 
-				if ( istr && istr.peek() == '\n' )
-				{
-					// std::cerr << "got job id " << id << std::endl;
+		bool fits(uint64_t const jobthreads, uint64_t const jobmem) const
+		{
+			return jobthreads <= threads && jobmem <= mem;
+		}
 
-					AW [ i ].id = id;
-					AW [ i ].workerid = workerid;
-					AW [ i ].wtmpbase = wtmpbase;
-					(*idToSlot)[id] = i;
-				}
-				else
-				{
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[E] unable to find job id in " << jobid_s << std::endl;
-					lme.finish();
-					throw lme;
-				}
-			}
+		bool operator<(WorkerClass const & O) const
+		{
+			if ( threads != O.threads )
+				return threads < O.threads;
 			else
-			{
-				libmaus2::exception::LibMausException lme;
-				lme.getStream() << "[E] unable to find job id in " << jobid_s << std::endl;
-				lme.finish();
-				throw lme;
-			}
-
-			libmaus2::aio::FileRemoval::removeFile(descname);
-
-			std::cerr << "[V] started job " << (i+1) << " out of " << workers << " with id " << AW[i].id << std::endl;
+				return mem < O.mem;
 		}
 	};
 
-
 	struct EPoll
 	{
 		int fd;
 		std::set<int> activeset;
+		#if defined(HAVE_EPOLL_CREATE) || defined(HAVE_EPOLL_CREATE1)
+		libmaus2::autoarray::AutoArray<struct epoll_event> events;
+		#endif
 
-		EPoll(int const
-		#if defined(HAVE_EPOLL_CREATE) && !defined(HAVE_EPOLL_CREATE1)
-			size
+		EPoll(int const size) : fd(-1), activeset()
+		#if defined(HAVE_EPOLL_CREATE) || defined(HAVE_EPOLL_CREATE1)
+		  , events(std::max(size,1),false)
 		#endif
-		) : fd(-1), activeset()
 		{
 			#if defined(HAVE_EPOLL_CREATE1)
-			fd = epoll_create1(0);
+			fd = epoll_create1(EPOLL_CLOEXEC);
 
 			std::cerr << "epoll_create1 returned " << fd << std::endl;
 
@@ -480,6 +487,7 @@ struct SlurmControl
 				throw lme;
 			}
 
+			::fcntl(fd,F_SETFD,FD_CLOEXEC);
 			#else
 			libmaus2::exception::LibMausException lme;
 			lme.getStream() << "[E] EPoll: epoll interface not supported " << std::endl;
@@ -585,15 +593,61 @@ struct SlurmControl
 			}
 		}
 
-		bool wait(int & rfd, int const timeout = 1000 /* milli seconds */)
+		void modify(int const modfd, bool const writable)
 		{
-			rfd = -1;
+			struct epoll_event ev;
+			ev.events = EPOLLIN
+				#if defined(EPOLLRDHUP)
+				| EPOLLRDHUP
+				#endif
+				;
+			if ( writable )
+				ev.events |= EPOLLOUT;
+			ev.data.fd = modfd;
+
+			while ( true )
+			{
+				int const r = epoll_ctl(
+					fd,
+					EPOLL_CTL_MOD,
+					modfd,
+					&ev
+				);
+
+				if ( r == 0 )
+					break;
+
+				int const error = errno;
+
+				switch ( error )
+				{
+					case EINTR:
+					case EAGAIN:
+						break;
+					default:
+					{
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] EPoll:modify: epoll_ctl() failed: " << strerror(error) << std::endl;
+						lme.finish();
+						throw lme;
+					}
+				}
+			}
+		}
 
-			struct epoll_event events[1];
+		/*
+		 * wait for events on the registered file descriptors. All events
+		 * reported by a single epoll_wait call (up to the size of the
+		 * events array) are stored in R as pairs of file descriptor and
+		 * event mask.
+		 */
+		uint64_t wait(std::vector < std::pair<int,uint32_t> > & R, int const timeout = 1000 /* milli seconds */)
+		{
+			R.resize(0);
 
 			while ( true )
 			{
-				int const nfds = epoll_wait(fd, &events[0], sizeof(events)/sizeof(events[0]), timeout);
+				int const nfds = epoll_wait(fd, events.begin(), events.size(), timeout);
 
 				if ( nfds < 0 )
 				{
@@ -613,25 +667,25 @@ struct SlurmControl
 						}
 					}
 				}
-
-				if ( nfds == 0 )
-				{
-					return false;
-				}
 				else
 				{
-					rfd = events[0].data.fd;
-
-					if ( activeset.find(rfd) != activeset.end() )
-					{
-						return true;
-					}
-					else
+					for ( int i = 0; i < nfds; ++i )
 					{
-						libmaus2::parallel::ScopePosixSpinLock slock(libmaus2::aio::StreamLock::cerrlock);
-						std::cerr << "[W] warning: epoll returned inactive file descriptor " << rfd << std::endl;
-						return false;
+						int const rfd = events[i].data.fd;
+
+						if ( activeset.find(rfd) != activeset.end() )
+						{
+							uint32_t const revents = events[i].events;
+							R.push_back(std::pair<int,uint32_t>(rfd,revents));
+						}
+						else
+						{
+							libmaus2::parallel::ScopePosixSpinLock slock(libmaus2::aio::StreamLock::cerrlock);
+							std::cerr << "[W] warning: epoll returned inactive file descriptor " << rfd << std::endl;
+						}
 					}
+
+					return R.size();
 				}
 			}
 		}
@@ -642,9 +696,13 @@ struct SlurmControl
 		void remove(int const)
 		{
 		}
-		bool wait(int &, int const = 1000 /* milli seconds */)
+		void modify(int const, bool const)
 		{
-			return false;
+		}
+		uint64_t wait(std::vector < std::pair<int,uint32_t> > & R, int const = 1000 /* milli seconds */)
+		{
+			R.resize(0);
+			return 0;
 		}
 		#endif
 	};
@@ -792,922 +850,1625 @@ struct SlurmControl
 	uint64_t const workers;
 	std::string const cdl;
 
+	// batch system used for starting workers
+	BatchBackend::unique_ptr_type Pbackend;
+	// thread making the calls to the batch system
+	SubmissionThread::unique_ptr_type Psubmit;
+	bool submitrunning;
+	// slots with a submission in progress
+	std::set < uint64_t > Ssubmitting;
+	// number of job state queries in progress
+	uint64_t numqueries;
+	// time of last check for workers which ended before connecting
+	time_t lastsubmitcheck;
+	// seconds between such checks
+	static time_t const submitcheckinterval = 30;
+
+	// modules run on threads of control instead of a worker (see startControlModule)
+	std::set < std::string > const Scontrolmodules;
+	ModuleLoader moduleloader;
+	ModuleThreadPool::unique_ptr_type Pmodules;
+	// jobs running on Pmodules by task id
+	std::map < uint64_t, JobDescription > Mmodulejobs;
+	uint64_t nextmoduletask;
+	// slot id passed to handleSuccessfulCommand and handleFailedCommand for jobs run in control
+	static uint64_t const controlslot = std::numeric_limits<uint64_t>::max();
+
+	/*
+	 * memory mapped container file. Scheduling uses the container, command
+	 * and state tables, command state is updated in place. Scripts are read
+	 * from the blob section when a command is dispatched.
+	 */
+	CDLv2::unique_ptr_type PCDL;
+
+	uint64_t const maxthreads;
+	uint64_t const workerthreads;
+
+	std::vector < WorkerClass > Vclass;
+	// worker class of each container
+	std::vector < uint64_t > Vcontainerclass;
+	// worker class of each slot
+	std::vector < uint64_t > Vslotclass;
+
 	libmaus2::autoarray::AutoArray<WorkerInfo> AW;
 	std::map<uint64_t,uint64_t> idToSlot;
 	std::map<int,uint64_t> fdToSlot;
 	std::map < JobDescription, uint64_t > Mfail;
 
-	libmaus2::util::ContainerDescriptionList CDL;
-	std::vector < libmaus2::util::ContainerDescription > & CDLV;
-	std::vector < libmaus2::util::CommandContainer > VCC;
-
-	std::set < JobDescription > Sunfinished;
+	ReadyQueue::queue_policy const queuepolicy;
+	// length of longest chain of containers starting at each container
+	std::vector < uint64_t > Vbottomlevel;
+	// index of each command in the ready queue of its worker class
+	std::vector < uint64_t > Vclassindex;
+	// jobs ready to run, one queue per worker class
+	std::vector < ReadyQueue > Vready;
+	// maximum number of ready jobs inspected when looking for one fitting a worker
+	static uint64_t const packlookahead = 256;
 	std::set < JobDescription > Srunning;
-	std::set<uint64_t> Sresubmit;
+	// number of running jobs per worker class
+	std::vector < uint64_t > Vclassrunning;
 	uint64_t ndeepsleep;
-	std::map < uint64_t, uint64_t > Munfinished;
-
-	uint64_t const maxthreads;
-	uint64_t const workerthreads;
+	// number of unfinished commands per container
+	std::vector < uint64_t > Vunfinished;
 
 	EPoll EP;
+	std::vector < std::pair<int,uint32_t> > Vevents;
+	std::map < int, PendingConnection::shared_ptr_type > Mpending;
+	// slots with queued output
+	std::set<uint64_t> Soutput;
 
 	libmaus2::network::ServerSocket::unique_ptr_type Pservsock;
 
-	std::set<uint64_t> restartSet;
 	std::set<uint64_t> wakeupSet;
 	// uint64_t pending;
 
 	ProgState pstate;
 	bool failed;
 
-	std::vector < StartWorkerRequest > Vreq;
-
 	libmaus2::aio::InputOutputStreamInstance metastream;
-	libmaus2::aio::InputOutputStreamInstance::shared_ptr_type cdlstream;
 
-	#if 0
-	libmaus2::parallel::TerminatableSynchronousQueue<WriteContainerRequest> WCRQ;
+	WriteAheadLog WAL;
+	// number of logged updates triggering a checkpoint
+	uint64_t const walcheckpoint;
 
-	struct WCRQWriterThread : public libmaus2::parallel::PosixThread
+	void processWakeupSet()
 	{
-		libmaus2::parallel::TerminatableSynchronousQueue<WriteContainerRequest> & WCRQ;
-		libmaus2::aio::InputOutputStreamInstance::shared_ptr_type cdlstream;
-		std::string const cdl;
-		std::string const journalfn;
-		std::vector < WriteContainerRequest > V;
-		bool runok;
-
-		static uint64_t getUpdateThreshold()
+		for ( std::set < uint64_t >::const_iterator it = wakeupSet.begin();
+			it != wakeupSet.end(); ++it )
 		{
-			return 64;
+			uint64_t const i = *it;
+			std::cerr << "[V] sending wakeup to slot " << i << std::endl;
+
+			AW[i].fdio.putNumber(AW[i].notify ? 5 : 1);
+			AW[i].notify = false;
+			Soutput.insert(i);
 		}
+		wakeupSet.clear();
+	}
 
-		WCRQWriterThread(
-			libmaus2::parallel::TerminatableSynchronousQueue<WriteContainerRequest> & rWCRQ,
-			libmaus2::aio::InputOutputStreamInstance::shared_ptr_type & rcdlstream,
-			std::string const rcdl
-		) : WCRQ(rWCRQ), cdlstream(rcdlstream), cdl(rcdl), journalfn(cdl + ".journal"), runok(true)
-		{
+	uint64_t computeMaxThreads()
+	{
+		uint64_t maxthreads = 1;
+		for ( uint64_t i = 0; i < PCDL->numContainers(); ++i )
+			maxthreads = std::max(maxthreads,PCDL->getContainerInfo(i).threads);
+		return maxthreads;
+	}
 
-		}
+	/*
+	 * read worker classes from file fn. Each non empty line not starting
+	 * with # contains threads, memory, time, partition and the maximum
+	 * number of workers of a class separated by white space.
+	 */
+	static std::vector < WorkerClass > loadWorkerClasses(std::string const & fn)
+	{
+		libmaus2::aio::InputStreamInstance ISI(fn);
+		std::vector < WorkerClass > V;
 
-		static std::string serialiseVector(std::vector < WriteContainerRequest > const & V)
+		while ( ISI )
 		{
-			std::ostringstream ostr;
-			libmaus2::util::NumberSerialisation::serialiseNumber(ostr,V.size());
-			for ( uint64_t i = 0; i < V.size(); ++i )
-				V[i].serialise(ostr);
+			std::string line;
+			std::getline(ISI,line);
 
-			return ostr.str();
-		}
+			if ( ! line.size() || line[0] == '#' )
+				continue;
 
-		static bool loadJournalData(std::string const journalfn, std::string & data)
-		{
-			try
-			{
-				uint64_t n = libmaus2::util::GetFileSize::getFileSize(journalfn);
-				libmaus2::autoarray::AutoArray<char> A(n,false);
-				libmaus2::aio::InputStreamInstance ISI(journalfn);
-				ISI.read(A.begin(),n);
-				data = std::string(A.begin(),A.end());
-				return true;
-			}
-			catch(std::exception const & ex)
+			std::istringstream istr(line);
+			WorkerClass C;
+			istr >> C.threads >> C.mem >> C.time >> C.partition >> C.maxworkers;
+
+			if ( ! istr )
 			{
-				std::cerr << "[E] failed to load journal data" << std::endl;
-				return false;
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] cannot parse worker class line " << line << " in " << fn << std::endl;
+				lme.finish();
+				throw lme;
 			}
+
+			V.push_back(C);
 		}
 
-		static bool parseJournalData(std::vector < WriteContainerRequest > & V, std::string & md5in, std::string const & journaldata)
+		return V;
+	}
+
+	/*
+	 * compute worker classes. Without a specification a single class is
+	 * built from the worker options, auto creates one class per distinct
+	 * (threads,mem) pair of the containers, anything else is read as a
+	 * worker class file.
+	 */
+	std::vector < WorkerClass > computeWorkerClasses(std::string const & spec) const
+	{
+		std::vector < WorkerClass > V;
+
+		if ( ! spec.size() )
 		{
-			try
-			{
-				std::istringstream ISI(journaldata);
-				uint64_t const n = libmaus2::util::NumberSerialisation::deserialiseNumber(ISI);
-				V.resize(n);
-				for ( uint64_t i = 0; i < n; ++i )
-					V[i].deserialise(ISI);
-				md5in = libmaus2::util::StringSerialisation::deserialiseString(ISI);
-				return true;
-			}
-			catch(std::exception const & ex)
-			{
-				std::cerr << "[E] failed to parse journal data" << std::endl;
-				return false;
-			}
+			V.push_back(WorkerClass(workerthreads,workermem,workertime,partition,workers));
 		}
-
-		static bool computeJournalMD5(std::string & md5data, std::vector < WriteContainerRequest > const & V)
+		else if ( spec == "auto" )
 		{
-			try
-			{
-				libmaus2::util::MD5::md5(serialiseVector(V),md5data);
-				return true;
-			}
-			catch(std::exception const & ex)
-			{
-				std::cerr << "[E] failed to compute checksum for journal data:\n" << ex.what() << std::endl;
-				return false;
-			}
+			std::set < std::pair<uint64_t,uint64_t> > S;
+			for ( uint64_t i = 0; i < PCDL->numContainers(); ++i )
+				S.insert(std::pair<uint64_t,uint64_t>(PCDL->getContainerInfo(i).threads,PCDL->getContainerInfo(i).mem));
+			for ( std::set < std::pair<uint64_t,uint64_t> >::const_iterator it = S.begin(); it != S.end(); ++it )
+				V.push_back(WorkerClass(it->first,it->second,workertime,partition,workers));
 		}
-
-		static bool checkJournalMD5(std::string const & md5data, std::string const & md5in)
+		else
 		{
-			try
-			{
-				if ( md5data != md5in )
-				{
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[E] check mismatch " << md5data << " != " << md5in << std::endl;
-					lme.finish();
-					throw lme;
-				}
-
-				return true;
-			}
-			catch(std::exception const & ex)
-			{
-				std::cerr << "[E] checksum mismatch journal data:\n" << ex.what() << std::endl;
-				return false;
-			}
+			V = loadWorkerClasses(spec);
 		}
 
-		static bool dispatchJournal(std::vector < WriteContainerRequest > const & V, std::string const & cdl)
+		if ( ! V.size() )
 		{
-			try
-			{
-				libmaus2::aio::InputOutputStreamInstance::shared_ptr_type cdlstream(
-					new libmaus2::aio::InputOutputStreamInstance(cdl,std::ios::in | std::ios::out | std::ios::binary)
-				);
-
-				// apply updates
-				for ( uint64_t i = 0; i < V.size(); ++i )
-				{
-					V[i].dispatch(*cdlstream);
-					if ( ! cdlstream )
-					{
-						libmaus2::exception::LibMausException lme;
-						lme.getStream() << "[E] failed to write update" << std::endl;
-						lme.finish();
-						throw lme;
-					}
-				}
-				cdlstream->flush();
-				if ( ! cdlstream )
-				{
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[E] failed to write update (flush)" << std::endl;
-					lme.finish();
-					throw lme;
-				}
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] no worker classes defined" << std::endl;
+			lme.finish();
+			throw lme;
+		}
 
-				cdlstream.reset();
+		std::stable_sort(V.begin(),V.end());
 
-				return true;
-			}
-			catch(std::exception const & ex)
+		uint64_t nextslot = 0;
+		for ( uint64_t c = 0; c < V.size(); ++c )
+		{
+			for ( uint64_t j = 0; j < V[c].maxworkers; ++j )
 			{
-				std::cerr << "[E] failed to apply journal data:\n" << ex.what() << std::endl;
-				return false;
+				V[c].slots.push_back(nextslot);
+				V[c].stopped.insert(nextslot);
+				nextslot += 1;
 			}
+
+			std::cerr << "[V] worker class " << c << " threads=" << V[c].threads << " mem=" << V[c].mem << " time=" << V[c].time
+				<< " partition=" << V[c].partition << " workers=" << V[c].maxworkers << std::endl;
 		}
 
-		static bool removeJournal(std::string const & journalfn)
+		return V;
+	}
+
+	// assign each container to the smallest worker class it fits into
+	std::vector < uint64_t > computeContainerClasses() const
+	{
+		std::vector < uint64_t > V(PCDL->numContainers());
+		uint64_t numoversized = 0;
+
+		for ( uint64_t i = 0; i < PCDL->numContainers(); ++i )
 		{
-			try
-			{
-				libmaus2::aio::FileRemoval::removeFile(journalfn);
-				return true;
-			}
-			catch(std::exception const & ex)
+			CDLv2::ContainerInfo const & CI = PCDL->getContainerInfo(i);
+
+			uint64_t c = 0;
+			while ( c < Vclass.size() && ! Vclass[c].fits(CI.threads,CI.mem) )
+				++c;
+
+			if ( c == Vclass.size() )
 			{
-				std::cerr << "[E] failed to delete journal:\n:" << ex.what() << std::endl;
-				return false;
+				c = Vclass.size()-1;
+				numoversized += 1;
 			}
+
+			V[i] = c;
 		}
 
-		static bool applyJournal(std::string const & cdl, std::string const & journalfn)
-		{
-			try
-			{
-				bool ok = true;
+		if ( numoversized )
+			std::cerr << "[W] " << numoversized << " containers exceed the resources of all worker classes" << std::endl;
 
-				std::string journaldata;
-				std::string md5in;
-				std::string md5data;
-				std::vector < WriteContainerRequest > V;
+		return V;
+	}
 
-				ok = ok && loadJournalData(journalfn,journaldata);
-				ok = ok && parseJournalData(V, md5in, journaldata);
-				ok = ok && computeJournalMD5(md5data,V);
-				ok = ok && checkJournalMD5(md5in,md5data);
-				ok = ok && dispatchJournal(V,cdl);
-				ok = ok && removeJournal(journalfn);
+	std::vector < uint64_t > computeSlotClasses() const
+	{
+		std::vector < uint64_t > V;
+		for ( uint64_t c = 0; c < Vclass.size(); ++c )
+			for ( uint64_t j = 0; j < Vclass[c].slots.size(); ++j )
+				V.push_back(c);
+		return V;
+	}
 
-				return ok;
-			}
-			catch(std::exception const & ex)
-			{
-				std::cerr << "[E] applyJournal failed: " << ex.what() << std::endl;
-				return false;
-			}
-		}
+	// number the commands of each worker class consecutively
+	std::vector < uint64_t > computeClassIndex() const
+	{
+		std::vector < uint64_t > V(PCDL->numCommands());
+		std::vector < uint64_t > C(Vclass.size(),0);
 
-		static bool tryApplyJournal(std::string const & cdl, std::string const & journalfn)
-		{
-			try
-			{
-				if ( ! libmaus2::util::GetFileSize::fileExists(journalfn) )
-					return true;
+		for ( uint64_t i = 0; i < PCDL->numContainers(); ++i )
+			for ( uint64_t j = 0; j < PCDL->getContainerInfo(i).numcommands; ++j )
+				V [ PCDL->getCommandIndex(i,j) ] = C [ Vcontainerclass[i] ] ++;
 
-				return applyJournal(cdl,journalfn);
-			}
-			catch(std::exception const & ex)
-			{
-				std::cerr << "[E] tryApplyJournal failed: " << ex.what() << std::endl;
-				return false;
-			}
-		}
+		return V;
+	}
 
-		#if 0
-		enum journal_update_error
-		{
-			journal_update_error_none,
-			journal_update_error_memory,
-			journal_update_error_load,
-			journal_update_error_parse,
-			journal_update_error_checksum,
-			journal_update_error_update,
-			journal_update_error_unknown
-		};
+	std::vector < ReadyQueue > computeReadyQueues() const
+	{
+		std::vector < uint64_t > C(Vclass.size(),0);
+		for ( uint64_t i = 0; i < PCDL->numContainers(); ++i )
+			C [ Vcontainerclass[i] ] += PCDL->getContainerInfo(i).numcommands;
+
+		std::vector < ReadyQueue > V;
+		for ( uint64_t c = 0; c < Vclass.size(); ++c )
+			V.push_back(ReadyQueue(C[c]));
+		return V;
+	}
+
+	uint64_t numReady() const
+	{
+		uint64_t n = 0;
+		for ( uint64_t c = 0; c < Vready.size(); ++c )
+			n += Vready[c].size();
+		return n;
+	}
 
-		static bool loadJournalData(std::string const journalfn, std::string & data)
+	/*
+	 * submit stopped slots of each class while the class has more ready
+	 * jobs than it has submitted slots without running jobs
+	 */
+	void growPools()
+	{
+		for ( uint64_t c = 0; c < Vclass.size(); ++c )
 		{
-			try
-			{
-				uint64_t n = libmaus2::util::GetFileSize::getFileSize(journalfn);
-				libmaus2::autoarray::AutoArray<char> A(n,false);
-				libmaus2::aio::InputStreamInstance ISI(journalfn);
-				ISI.read(A.begin(),n);
-				data = std::string(A.begin(),A.end());
-				return true;
-			}
-			catch(std::exception const & ex)
+			WorkerClass & WC = Vclass[c];
+
+			if ( ! WC.stopped.size() || ! Vready[c].size() )
+				continue;
+
+			uint64_t uncommitted = 0;
+			for ( uint64_t j = 0; j < WC.slots.size(); ++j )
 			{
-				std::cerr << "[E] failed to load journal data" << std::endl;
-				return false;
+				uint64_t const i = WC.slots[j];
+				if ( WC.stopped.find(i) == WC.stopped.end() && ! AW[i].running.size() )
+					uncommitted += 1;
 			}
+
+			std::vector < uint64_t > Vslots;
+			for ( std::set<uint64_t>::const_iterator it = WC.stopped.begin();
+				it != WC.stopped.end() && Vready[c].size() > uncommitted + Vslots.size(); ++it )
+				Vslots.push_back(*it);
+
+			if ( Vslots.size() )
+				startWorkers(c,Vslots);
 		}
+	}
+
+	/*
+	 * submit workers for the given stopped slots of class c in a single
+	 * batch (a job array for SLURM)
+	 */
+	void startWorkers(uint64_t const c, std::vector < uint64_t > const & Vslots)
+	{
+		WorkerClass & WC = Vclass[c];
 
+		std::ostringstream jobnamestr;
+		jobnamestr << "worker_class_" << c;
 
-		static journal_update_error loadJournal(std::vector < WriteContainerRequest > & V, std::string const & journalfn)
+		std::vector<std::string> command;
+		command.push_back("hpcschedworker");
+		std::ostringstream portstr;
+		portstr << serverport;
+		command.push_back(hostname);
+		command.push_back(portstr.str());
+
+		std::string const tmpbase = tmpgen.getFileName();
+
+		for ( uint64_t j = 0; j < Vslots.size(); ++j )
 		{
-			try
-			{
-				std::string journaldata;
-				bool const dataok = loadJournalData(journalfn,journaldata);
+			uint64_t const i = Vslots[j];
+			uint64_t const workerid = nextworkerid++;
 
-				if ( ! dataok )
-					return journal_update_error_load;
+			std::ostringstream wtmpbasestr;
+			wtmpbasestr << tmpbase << "_" << workerid;
+
+			AW [ i ].reset();
+			AW [ i ].workerid = workerid;
+			AW [ i ].wtmpbase = wtmpbasestr.str();
+			WC.stopped.erase(i);
+			Ssubmitting.insert(i);
+		}
+
+		Psubmit->enque(
+			SubmissionRequest::submit(
+				c,
+				Vslots,
+				BatchJobRequest(
+					jobnamestr.str(),
+					tmpbase + ".out",
+					tmpbase,
+					WC.time,
+					WC.mem,
+					WC.threads,
+					WC.partition,
+					command
+				)
+			)
+		);
+
+		std::cerr << "[V] requested " << Vslots.size() << " workers of class " << c << " using backend " << Pbackend->getName() << std::endl;
+	}
 
-				std::cerr << "[V] loading journal" << std::endl;
+	// handle results of batch backend calls made by the submission thread
+	void handleSubmissionResults()
+	{
+		std::vector < SubmissionResult > const V = Psubmit->getResults();
 
-				std::string md5in;
+		for ( uint64_t k = 0; k < V.size(); ++k )
+		{
+			SubmissionResult const & R = V[k];
 
-				try
-				{
-					std::istringstream ISI(journaldata);
-					uint64_t const n = libmaus2::util::NumberSerialisation::deserialiseNumber(ISI);
-					V.resize(n);
-					for ( uint64_t i = 0; i < n; ++i )
-						V[i].deserialise(ISI);
-					md5in = libmaus2::util::StringSerialisation::deserialiseString(ISI);
-				}
-				catch(std::bad_alloc const & ex)
-				{
-					std::cerr << "[E] failed to parse journal data (bad_alloc)" << std::endl;
-					return journal_update_error_memory;
-				}
-				catch(std::exception const & ex)
+			switch ( R.request.type )
+			{
+				case SubmissionRequest::request_submit:
 				{
-					std::cerr << "[E] failed to parse journal data" << std::endl;
-					return journal_update_error_parse;
-				}
+					std::vector < uint64_t > const & Vslots = R.request.slots;
+					assert ( R.ids.size() <= Vslots.size() );
 
-				// compute MD5 for data
-				std::string md5data;
+					for ( uint64_t j = 0; j < Vslots.size(); ++j )
+					{
+						uint64_t const i = Vslots[j];
+						Ssubmitting.erase(i);
 
-				try
-				{
-					libmaus2::util::MD5::md5(serialiseVector(V),md5data);
-				}
-				catch(std::bad_alloc const & ex)
-				{
-					std::cerr << "[E] failed to parse journal data (bad_alloc on checksum)" << std::endl;
-					return journal_update_error_memory;
-				}
-				catch(std::exception const & ex)
-				{
-					std::cerr << "[E] failed to parse journal data (error on checksum):\n" << ex.what() << std::endl;
-					return journal_update_error_checksum;
-				}
+						if ( j < R.ids.size() )
+						{
+							AW [ i ].id = R.ids[j];
+							idToSlot[R.ids[j]] = i;
+						}
+						else
+						{
+							AW [ i ].reset();
+							stopSlot(i);
+						}
+					}
 
-				// check integrity
-				if ( md5data == md5in )
-				{
-					std::cerr << "[V] loaded journal" << std::endl;
-					return journal_update_error_none;
+					std::cerr << "[V] started " << R.ids.size() << " out of " << Vslots.size() << " workers of class " << R.request.workerclass << std::endl;
+					break;
 				}
-				else
+				case SubmissionRequest::request_query:
 				{
-					std::cerr << "[E] journal checksum mismatch" << std::endl;
-					return journal_update_error_checksum;
+					assert ( numqueries );
+					numqueries -= 1;
+
+					std::map<uint64_t,uint64_t>::const_iterator const it = idToSlot.find(R.request.id);
+
+					if ( it != idToSlot.end() && isSubmitted(it->second) && R.state == BatchBackend::job_state_finished )
+					{
+						uint64_t const i = it->second;
+						std::cerr << "[W] worker job " << AW[i].id << " of slot " << i << " ended before connecting" << std::endl;
+						idToSlot.erase(AW[i].id);
+						AW[i].reset();
+						stopSlot(i);
+					}
+					break;
 				}
+				case SubmissionRequest::request_cancel:
+					break;
 			}
-			catch(std::bad_alloc const & ex)
+		}
+	}
+
+	void stopSlot(uint64_t const slotid)
+	{
+		Vclass [ Vslotclass[slotid] ].stopped.insert(slotid);
+	}
+
+	// submitted worker which has not connected yet
+	bool isSubmitted(uint64_t const slotid) const
+	{
+		return AW[slotid].id >= 0 && ! AW[slotid].Asocket;
+	}
+
+	/*
+	 * ask the batch system about workers which have been submitted but
+	 * have not connected. Slots of workers which ended in the meantime are
+	 * stopped, so growPools can start them again.
+	 */
+	void checkSubmitted()
+	{
+		time_t const now = time(0);
+
+		// wait for answers to the previous round of queries
+		if ( numqueries || now - lastsubmitcheck < submitcheckinterval )
+			return;
+
+		lastsubmitcheck = now;
+
+		for ( uint64_t i = 0; i < AW.size(); ++i )
+			if ( isSubmitted(i) )
 			{
-				return journal_update_error_memory;
+				Psubmit->enque(SubmissionRequest::query(AW[i].id));
+				numqueries += 1;
 			}
-			catch(std::exception const & ex)
+	}
+
+	// cancel workers which have been submitted but have not connected
+	void cancelSubmitted()
+	{
+		for ( uint64_t i = 0; i < AW.size(); ++i )
+			if ( isSubmitted(i) )
 			{
-				std::cerr << "[E] failed to load journal: " << ex.what() << std::endl;
-				return journal_update_error_unknown;
+				std::cerr << "[V] cancelling worker job " << AW[i].id << " of slot " << i << std::endl;
+				Psubmit->enque(SubmissionRequest::cancel(AW[i].id));
+				idToSlot.erase(AW[i].id);
+				AW[i].reset();
+				stopSlot(i);
 			}
-		}
+	}
+
+	void markRunning(JobDescription const & J)
+	{
+		Srunning.insert(J);
+		Vclassrunning [ Vcontainerclass[J.containerid] ] += 1;
+		if ( PCDL->hasCommandFlag(J.containerid,J.subid,CDLv2::command_flag_deepsleep) )
+			ndeepsleep += 1;
+	}
 
-		// apply journal
-		static journal_update_error applyJournal(std::iostream & cdlstream, std::string const & journalfn)
+	void unmarkRunning(JobDescription const & J)
+	{
+		Srunning.erase(J);
+		assert ( Vclassrunning [ Vcontainerclass[J.containerid] ] );
+		Vclassrunning [ Vcontainerclass[J.containerid] ] -= 1;
+		if ( PCDL->hasCommandFlag(J.containerid,J.subid,CDLv2::command_flag_deepsleep) )
 		{
-			bool ok = false;
+			assert ( ndeepsleep > 0 );
+			ndeepsleep -= 1;
+		}
+	}
 
-			try
-			{
-				std::cerr << "[V] applying journal" << std::endl;
+	void countUnfinished()
+	{
+		for ( uint64_t i = 0; i < PCDL->numContainers(); ++i )
+			PCDL->getContainerState(i).missingdep = 0;
 
-				// read data
-				std::vector < WriteContainerRequest > V;
-				journal_update_error const journalok = loadJournal(V,journalfn);
+		Vunfinished.resize(PCDL->numContainers());
 
-				switch ( journalok )
-				{
-					case journal_update_error_none:
-					{
-						try
-						{
-							// apply journal
-							for ( uint64_t i = 0; i < V.size(); ++i )
-								V[i].dispatch(cdlstream);
-							cdlstream.sync();
+		// count number of unfinished jobs per command container
+		for ( uint64_t i = 0; i < PCDL->numContainers(); ++i )
+		{
+			uint64_t const numcommands = PCDL->getContainerInfo(i).numcommands;
+			uint64_t numunfinished = 0;
 
-							libmaus2::aio::FileRemoval::removeFile(journalfn);
+			for ( uint64_t j = 0; j < numcommands; ++j )
+				if ( ! PCDL->getCommandState(i,j).completed )
+					numunfinished += 1;
 
-							std::cerr << "[V] applyed journal with " << V.size() << " elements" << std::endl;
+			Vunfinished[i] = numunfinished;
 
-							return journal_update_error_none;
-						}
-						catch(std::exception const & ex)
-						{
-							std::cerr << "[E] error applying journal updates:\n" << ex.what() << std::endl;
-							return journal_update_error_update;
-						}
-					}
-					case journal_update_error_memory:
-					case journal_update_error_load:
-					{
-						return journalok;
-					}
-					case journal_update_error_parse:
-					{
-						// remove defective journal file
-						libmaus2::aio::FileRemoval::removeFile(journalfn);
-						return journalok;
-					}
+			std::cerr << "[V] container " << i << " has " << numunfinished << " unfinished jobs" << std::endl;
 
-				}
-				if ( journalok == journal_update_error_none )
+			if ( numunfinished )
+			{
+				// check reverse dependencies
+				uint64_t const * rdep = PCDL->getReverseDependencies(i);
+				for ( uint64_t j = 0; j < PCDL->numReverseDependencies(i); ++j )
 				{
+					uint64_t const k = rdep[j];
+
+					std::cerr << "[V] container " << k << " has missing dependency " << i << std::endl;
+
+					PCDL->getContainerState(k).missingdep += 1;
 				}
-				else
+			}
+		}
+	}
+
+	/*
+	 * compute the bottom level of each container, i.e. the number of
+	 * containers on the longest path to a container nothing depends on
+	 */
+	static std::vector < uint64_t > computeBottomLevel(CDLv2 const & CDL)
+	{
+		uint64_t const n = CDL.numContainers();
+		std::vector < uint64_t > BL(n,0);
+		// number of reverse dependencies not yet processed
+		std::vector < uint64_t > R(n);
+		std::vector < uint64_t > todo;
+
+		for ( uint64_t i = 0; i < n; ++i )
+		{
+			R[i] = CDL.numReverseDependencies(i);
+			if ( ! R[i] )
+				todo.push_back(i);
+		}
+
+		while ( todo.size() )
+		{
+			uint64_t const i = todo.back();
+			todo.pop_back();
+
+			uint64_t const * rdep = CDL.getReverseDependencies(i);
+			uint64_t bl = 0;
+			for ( uint64_t j = 0; j < CDL.numReverseDependencies(i); ++j )
+				bl = std::max(bl,BL[rdep[j]]);
+			BL[i] = bl + 1;
+
+			uint64_t const * dep = CDL.getDependencies(i);
+			for ( uint64_t j = 0; j < CDL.numDependencies(i); ++j )
+				if ( ! --R[dep[j]] )
+					todo.push_back(dep[j]);
+		}
+
+		return BL;
+	}
+
+	// heap keys for jobs in container i according to the queue policy
+	std::pair<int64_t,int64_t> getQueueKeys(uint64_t const i) const
+	{
+		switch ( queuepolicy )
+		{
+			case ReadyQueue::queue_policy_critpath:
+				return std::pair<int64_t,int64_t>(Vbottomlevel[i],0);
+			case ReadyQueue::queue_policy_priority:
+				return std::pair<int64_t,int64_t>(PCDL->getContainerInfo(i).priority,Vbottomlevel[i]);
+			case ReadyQueue::queue_policy_fanout:
+				return std::pair<int64_t,int64_t>(PCDL->numReverseDependencies(i),0);
+			case ReadyQueue::queue_policy_fifo:
+			default:
+				return std::pair<int64_t,int64_t>(0,0);
+		}
+	}
+
+	void addUnfinished(JobDescription const J)
+	{
+		if ( startControlModule(J) )
+			return;
+
+		std::pair<int64_t,int64_t> const K = getQueueKeys(J.containerid);
+		Vready [ Vcontainerclass[J.containerid] ].push(
+			J.containerid,J.subid,Vclassindex [ PCDL->getCommandIndex(J.containerid,J.subid) ],K.first,K.second
+		);
+	}
+
+	// comma separated list of module names, none for the empty set
+	static std::set < std::string > parseControlModules(std::string const & s)
+	{
+		std::set < std::string > S;
+
+		if ( s == "none" )
+			return S;
+
+		std::istringstream istr(s);
+		std::string name;
+		while ( std::getline(istr,name,',') )
+			if ( name.size() )
+				S.insert(name);
+
+		return S;
+	}
+
+	/*
+	 * run job J on the module thread pool of control if it calls one of
+	 * the modules given by --controlmodules and the module has a thread
+	 * safe entry point. Such jobs need no worker. Returns false if J has to
+	 * be run by a worker.
+	 */
+	bool startControlModule(JobDescription const & J)
+	{
+		if ( ! Scontrolmodules.size() || ! PCDL->hasCommandFlag(J.containerid,J.subid,CDLv2::command_flag_modcall) )
+			return false;
+
+		// a chain of fused commands is run by a worker as a whole
+		if ( getChainEnd(J) > J.subid + 1 )
+			return false;
+
+		libmaus2::util::Command const com = PCDL->getCommand(J.containerid,J.subid);
+		std::pair<std::string,std::string> const P = ModuleLoader::split(com.script);
+
+		if ( Scontrolmodules.find(P.first) == Scontrolmodules.end() )
+			return false;
+
+		Module const * mod = moduleloader.get(P.first);
+
+		if ( ! mod || ! mod->fdfunction )
+			return false;
+
+		uint64_t const id = nextmoduletask++;
+		Mmodulejobs[id] = J;
+		markRunning(J);
+		// messages of the module go to the error channel of control
+		Pmodules->enque(ModuleTask(id,mod->fdfunction->func,P.second,STDERR_FILENO));
+
+		std::cerr << "[V] started " << com << " for " << J.containerid << "," << J.subid << " in control" << std::endl;
+
+		return true;
+	}
+
+	void handleModuleResults()
+	{
+		std::vector < ModuleResult > const V = Pmodules->getResults();
+
+		for ( uint64_t i = 0; i < V.size(); ++i )
+		{
+			std::map < uint64_t, JobDescription >::iterator it = Mmodulejobs.find(V[i].id);
+			assert ( it != Mmodulejobs.end() );
+			JobDescription const J = it->second;
+			Mmodulejobs.erase(it);
+
+			int const istatus = V[i].status;
+
+			std::cerr << "[V] job " << J.containerid << "," << J.subid << " run in control ended with istatus=" << istatus << std::endl;
+
+			if ( WIFEXITED(istatus) && (WEXITSTATUS(istatus) == 0) )
+				handleSuccessfulCommand(controlslot,J);
+			else
+				handleFailedCommand(controlslot,J);
+		}
+	}
+
+	JobDescription getUnfinished(uint64_t const c)
+	{
+		ReadyQueue::Entry const E = Vready[c].pop();
+		return JobDescription(E.containerid,E.subid);
+	}
+
+	/*
+	 * check whether command j of container i can be started once the
+	 * dependencies of the container are complete. Commands of fused rules
+	 * wait for the previous command of their container.
+	 */
+	bool isReleased(uint64_t const i, uint64_t const j) const
+	{
+		return
+			j == 0
+			||
+			! PCDL->hasCommandFlag(i,j,CDLv2::command_flag_sequence)
+			||
+			PCDL->getCommandState(i,j-1).completed;
+	}
+
+	/*
+	 * end of the chain of fused commands starting at J, i.e. the index of
+	 * the first command after J in its container which does not wait for
+	 * the previous one. J.subid+1 if J is not followed by such commands.
+	 */
+	int64_t getChainEnd(JobDescription const & J) const
+	{
+		int64_t j = J.subid + 1;
+		int64_t const n = PCDL->getContainerInfo(J.containerid).numcommands;
+
+		while ( j < n && PCDL->hasCommandFlag(J.containerid,j,CDLv2::command_flag_sequence) )
+			++j;
+
+		return j;
+	}
+
+	void enqueUnfinished()
+	{
+		for ( uint64_t i = 0; i < PCDL->numContainers(); ++i )
+		{
+			if ( PCDL->getContainerState(i).missingdep == 0 )
+			{
+				std::cerr << "[V] container " << i << " has no missing dependencies, enqueuing jobs" << std::endl;
+
+				for ( uint64_t j = 0; j < PCDL->getContainerInfo(i).numcommands; ++j )
 				{
-					switch ( journalok )
+					if ( !PCDL->getCommandState(i,j).completed && isReleased(i,j) )
 					{
-						// this should not happen
-						case journal_update_error_none:
-							assert(false);
-							break;
-						// unable to load journal, may be input error
-						case journal_update_error_load:
-							return false;
-							break;
-						libmaus2::aio::FileRemoval::removeFile(journalfn);
+						addUnfinished(JobDescription(i,j));
 					}
 				}
 			}
+		}
+	}
+
+	void checkRequeue(JobDescription const & J)
+	{
+		Mfail [ J ] += 1;
+
+		// mark pipeline as failed
+		if ( Mfail [ J ] >= PCDL->getContainerInfo(J.containerid).maxattempt )
+		{
+			std::cerr << "[V] too many failures on " << J.containerid << "," << J.subid << ", marking pipeline as failed" << std::endl;
+
+			if ( ! PCDL->hasCommandFlag(J.containerid,J.subid,CDLv2::command_flag_ignorefail) )
+				failed = true;
+		}
+		// requeue
+		else
+		{
+			std::cerr << "[V] requeuing " << J.containerid << "," << J.subid << std::endl;
+
+			addUnfinished(J);
+			processWakeupSet();
+		}
+	}
+
+
+	void resetSlot(uint64_t const slotid)
+	{
+		uint64_t const id = AW[slotid].id;
+		EP.remove(AW[slotid].Asocket->getFD());
+		fdToSlot.erase(AW[slotid].Asocket->getFD());
+		AW[slotid].reset();
+		idToSlot.erase(id);
+		wakeupSet.erase(slotid);
+		Soutput.erase(slotid);
+		// restarted by growPools if jobs of its class are waiting
+		stopSlot(slotid);
+	}
+
+	// close connection of slot without scheduling a restart
+	void closeSlot(uint64_t const slotid)
+	{
+		EP.remove(AW[slotid].Asocket->getFD());
+		fdToSlot.erase(AW[slotid].Asocket->getFD());
+		AW[slotid].Asocket.reset();
+		AW[slotid].fdio.reset();
+		AW[slotid].active = false;
+		idToSlot.erase(AW[slotid].id);
+		AW[slotid].id = -1;
+		wakeupSet.erase(slotid);
+		Soutput.erase(slotid);
+	}
+
+	// send termination request to slot and close connection
+	void terminateSlot(uint64_t const slotid)
+	{
+		uint64_t const id = AW[slotid].id;
+		AW[slotid].fdio.putNumber(2);
+
+		try
+		{
+			// the socket is idle at this point, so the request fits into the send buffer
+			if ( ! AW[slotid].fdio.flush() )
+				std::cerr << "[W] unable to send termination request to slot " << slotid << " without blocking" << std::endl;
+		}
+		catch(std::exception const & ex)
+		{
+			std::cerr << "[W] failed to send termination request to slot " << slotid << ":\n" << ex.what() << std::endl;
+		}
+
+		EP.remove(AW[slotid].Asocket->getFD());
+		fdToSlot.erase(AW[slotid].Asocket->getFD());
+		AW[slotid].reset();
+		idToSlot.erase(id);
+		wakeupSet.erase(slotid);
+		Soutput.erase(slotid);
+		stopSlot(slotid);
+	}
+
+	// mark all jobs running on slot i as failed
+	void failRunningJobs(uint64_t const i)
+	{
+		std::set<JobDescription> const S = AW[i].running;
+
+		// the rest of the chains is not run by this worker
+		AW[i].chainend.clear();
+
+		for ( std::set<JobDescription>::const_iterator it = S.begin(); it != S.end(); ++it )
+			handleFailedCommand(i,*it);
+	}
+
+	void handleSlotFailure(uint64_t const i)
+	{
+		if ( AW[i].running.size() )
+		{
+			try
+			{
+				failRunningJobs(i);
+			}
 			catch(std::exception const & ex)
 			{
-				std::cerr << "[E] applyJournal failed: " << ex.what() << std::endl;
+				std::cerr << "[E] exception in handleFailedCommand: " << std::endl;
+				std::cerr << ex.what() << std::endl;
+				throw;
 			}
+		}
 
-			return ok;
+		try
+		{
+			if ( AW[i].Asocket )
+				resetSlot(i /* slotid */);
 		}
+		catch(std::exception const & ex)
+		{
+			std::cerr << "[E] exception in resetSlot: " << std::endl;
+			std::cerr << ex.what() << std::endl;
+			throw;
+		}
+	}
+
+	/*
+	 * get highest ranked ready job fitting into the free capacity of slot
+	 * i. At most packlookahead jobs are inspected, the ones skipped stay
+	 * in the queue.
+	 */
+	bool getFittingUnfinished(uint64_t const i, uint64_t const c, JobDescription & J)
+	{
+		ReadyQueue & Q = Vready[c];
+		std::vector < ReadyQueue::Entry > skipped;
+		bool found = false;
 
-		// apply journal
-		static bool applyJournal(std::string const & cdl, std::string const & journalfn)
+		while ( !found && Q.size() && skipped.size() < packlookahead )
 		{
-			libmaus2::aio::InputOutputStreamInstance::shared_ptr_type cdlstream(
-				new libmaus2::aio::InputOutputStreamInstance(cdl,std::ios::in | std::ios::out | std::ios::binary)
-			);
+			ReadyQueue::Entry const E = Q.pop();
+			CDLv2::ContainerInfo const & CI = PCDL->getContainerInfo(E.containerid);
 
-			return applyJournal(*cdlstream,journalfn);
+			if ( AW[i].fits(CI.threads,CI.mem) )
+			{
+				J = JobDescription(E.containerid,E.subid);
+				found = true;
+			}
+			else
+			{
+				skipped.push_back(E);
+			}
 		}
-		#endif
 
-		// write journal to disk
-		bool writeJournal()
-		{
-			try
+		for ( uint64_t j = 0; j < skipped.size(); ++j )
+			Q.push(skipped[j]);
+
+		return found;
+	}
+
+	/*
+	 * get fitting job for slot i from the queue of its own worker class or
+	 * failing that from the queues of the smaller classes
+	 */
+	bool getFittingUnfinished(uint64_t const i, JobDescription & J)
+	{
+		for ( uint64_t c = Vslotclass[i]+1; c > 0; --c )
+			if ( getFittingUnfinished(i,c-1,J) )
+				return true;
+		return false;
+	}
+
+	/*
+	 * start job currentid on slot i. A chain of fused commands is sent to
+	 * the worker as a whole. The worker reports each step and runs the
+	 * next one if control acknowledges the report with 0 (see
+	 * continueChain), so the steps keep their own attempts and logs.
+	 */
+	void startJob(uint64_t const i, JobDescription const & currentid)
+	{
+		NonBlockingFDIO & fdio = AW[i].fdio;
+		CDLv2::ContainerInfo const & CI = PCDL->getContainerInfo(currentid.containerid);
+		int64_t const chainend = getChainEnd(currentid);
+
+		// get command from container file
+		libmaus2::util::Command const com = PCDL->getCommand(currentid.containerid,currentid.subid);
+		// process command
+		AW[i].running.insert(currentid);
+		AW[i].usedthreads += CI.threads;
+		AW[i].usedmem += CI.mem;
+
+		if ( chainend > currentid.subid + 1 )
+		{
+			AW[i].chainend[currentid] = chainend;
+			fdio.putNumber(4);
+			fdio.putNumber(currentid.containerid);
+			fdio.putNumber(CI.logpolicy);
+			fdio.putNumber(chainend - currentid.subid);
+
+			for ( int64_t j = currentid.subid; j < chainend; ++j )
 			{
-				std::cerr << "[V] writing journal" << std::endl;
+				std::ostringstream ostr;
+				PCDL->getCommand(currentid.containerid,j).serialise(ostr);
+				fdio.putString(ostr.str());
+				fdio.putNumber(j);
+			}
+		}
+		else
+		{
+			// serialise command to string
+			std::ostringstream ostr;
+			com.serialise(ostr);
+			fdio.putNumber(0);
+			fdio.putString(ostr.str());
+			fdio.putNumber(currentid.containerid);
+			fdio.putNumber(currentid.subid);
+			fdio.putNumber(CI.logpolicy);
+		}
+		Soutput.insert(i);
+		AW[i].protostate = worker_protocol_started;
+
+		markRunning(currentid);
+
+		std::cerr << "[V] started " << com << " for " << currentid.containerid << "," << currentid.subid << " on slot " << i
+			<< " chain length " << (chainend - currentid.subid)
+			<< " wtmpbase " << AW[i].wtmpbase
+			<< " using threads " << AW[i].usedthreads << "/" << AW[i].threads
+			<< " mem " << AW[i].usedmem << "/" << AW[i].mem << std::endl;
+	}
 
-				// get data
-				std::string const data = serialiseVector(V);
+	/*
+	 * let the worker on slot i go on with the chain of fused commands
+	 * after step J has completed. The capacity used on the slot passes on
+	 * to the next step. Returns false if J is not followed by a step sent
+	 * to the worker along with it.
+	 */
+	bool continueChain(uint64_t const i, JobDescription const & J)
+	{
+		if ( i == controlslot )
+			return false;
 
-				// compute checksum
-				std::string md5data;
-				libmaus2::util::MD5::md5(data,md5data);
+		std::map<JobDescription,int64_t>::iterator const it = AW[i].chainend.find(J);
 
-				// write data
-				libmaus2::aio::OutputStreamInstance::unique_ptr_type OSI(new libmaus2::aio::OutputStreamInstance(journalfn));
-				OSI->write(data.c_str(),data.size());
-				libmaus2::util::StringSerialisation::serialiseString(*OSI,md5data);
-				OSI->flush();
+		if ( it == AW[i].chainend.end() || it->second <= J.subid + 1 || AW[i].running.find(J) == AW[i].running.end() )
+			return false;
 
-				if ( ! *OSI )
-				{
-					OSI.reset();
+		JobDescription const N(J.containerid,J.subid+1);
+		int64_t const chainend = it->second;
+
+		AW[i].chainend.erase(it);
+		AW[i].running.erase(J);
+		AW[i].running.insert(N);
+		AW[i].chainend[N] = chainend;
+		markRunning(N);
+
+		std::cerr << "[V] continuing chain with " << N.containerid << "," << N.subid << " on slot " << i << std::endl;
+
+		return true;
+	}
+
+	// remove job J from slot i
+	void releaseJob(uint64_t const i, JobDescription const & J)
+	{
+		if ( i != controlslot )
+			AW[i].chainend.erase(J);
 
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[E] unable to write journal " << journalfn << std::endl;
-					lme.finish();
-					throw lme;
+		if ( i != controlslot && AW[i].running.erase(J) )
+		{
+			CDLv2::ContainerInfo const & CI = PCDL->getContainerInfo(J.containerid);
+			assert ( AW[i].usedthreads >= CI.threads );
+			assert ( AW[i].usedmem >= CI.mem );
+			AW[i].usedthreads -= CI.threads;
+			AW[i].usedmem -= CI.mem;
+		}
+	}
+
+	// handle work request of slot i
+	void handleIdleSlot(uint64_t const i)
+	{
+		NonBlockingFDIO & fdio = AW[i].fdio;
+		uint64_t const c = Vslotclass[i];
+		JobDescription J;
+
+		if ( getFittingUnfinished(i,J) )
+		{
+			startJob(i,J);
+		}
+		else if ( AW[i].running.size() )
+		{
+			// worker is busy and nothing fits into its remaining capacity, notify it once jobs become ready
+			fdio.putNumber(3);
+			Soutput.insert(i);
+			AW[i].notify = true;
+			wakeupSet.insert(i);
+		}
+		else if ( Vready[c].size() )
+		{
+			// no ready job fits into an empty worker, run the highest ranked one anyway
+			J = getUnfinished(c);
+			std::cerr << "[W] job " << J.containerid << "," << J.subid << " exceeds capacity of slot " << i << std::endl;
+			startJob(i,J);
+		}
+		else if ( ! Srunning.size() )
+		{
+			// no more work to be done
+			std::cerr << "[V] terminating slot " << i << std::endl;
+			terminateSlot(i);
+		}
+		else if ( ndeepsleep == Srunning.size() )
+		{
+			// put slot to deep sleep, it is restarted by growPools once jobs of its class are ready
+			std::cerr << "[V] putting slot " << i << " to deep sleep" << std::endl;
+			terminateSlot(i);
+		}
+		else if ( ! Vclassrunning[c] )
+		{
+			// shrink pool of a worker class without ready or running jobs
+			std::cerr << "[V] stopping idle slot " << i << " of worker class " << c << std::endl;
+			terminateSlot(i);
+		}
+		else
+		{
+			std::cerr << "[V] putting slot " << i << " in wakeupSet" << std::endl;
+
+			AW[i].notify = false;
+			wakeupSet.insert(i);
+		}
+	}
+
+	/*
+	 * try to parse and handle the next message from slot i. Returns false
+	 * if the input buffer does not contain a complete message or if the
+	 * slot has been closed.
+	 */
+	bool handleSlotMessage(uint64_t const i)
+	{
+		NonBlockingFDIO & fdio = AW[i].fdio;
+
+		switch ( AW[i].protostate )
+		{
+			case worker_protocol_curdir:
+			{
+				uint64_t curdirok;
+
+				if ( ! fdio.getNumber(curdirok) )
+					return false;
+				fdio.commit();
+
+				if ( curdirok )
+				{
+					fdio.putString(AW[i].wtmpbase);
+					Soutput.insert(i);
+					AW[i].protostate = worker_protocol_files;
+					return true;
+				}
+				else
+				{
+					std::cerr << "[E] worker for slot " << i << " jobid " << AW[i].id << " reports mismatching current directory" << std::endl;
+					closeSlot(i);
+					return false;
+				}
+			}
+			case worker_protocol_files:
+			{
+				std::string outdatafn, errdatafn, metafn;
+				uint64_t threads, mem;
+
+				if ( !(
+					fdio.getString(outdatafn) && fdio.getString(errdatafn) && fdio.getString(metafn)
+					&&
+					fdio.getNumber(threads) && fdio.getNumber(mem)
+				) )
+				{
+					fdio.rollback();
+					return false;
 				}
+				fdio.commit();
 
-				OSI.reset();
+				AW[i].outdatafn = outdatafn;
+				AW[i].errdatafn = errdatafn;
+				AW[i].metafn = metafn;
+				AW[i].threads = threads;
+				AW[i].mem = mem;
+				AW[i].active = true;
+				AW[i].protostate = worker_protocol_ready;
 
-				std::cerr << "[V] wrote journal" << std::endl;
+				std::cerr << "[V] marked slot " << i << " active for jobid " << AW[i].id << " threads " << threads << " mem " << mem << std::endl;
 
 				return true;
 			}
-			catch(std::exception const & ex)
+			case worker_protocol_started:
 			{
-				std::cerr << "[E] writeJournal failed:\n" << ex.what() << std::endl;
-				libmaus2::aio::FileRemoval::removeFile(journalfn);
-				return false;
-			}
-		}
+				std::string sruninfo;
 
-		bool handleVectorFlush()
-		{
-			if ( runok )
+				if ( ! fdio.getString(sruninfo) )
+					return false;
+				fdio.commit();
+
+				AW[i].protostate = worker_protocol_ready;
+
+				return true;
+			}
+			case worker_protocol_ready:
 			{
-				std::cerr << "[V] flushing CDL vector to " << journalfn << std::endl;
+				uint64_t rd;
 
-				bool ok = writeJournal();
+				if ( ! fdio.getNumber(rd) )
+					return false;
 
-				// if we managed to write the journal
-				if ( ok )
+				// worker is idle
+				if ( rd == 0 )
 				{
-					try
+					fdio.commit();
+					// a pending notification is replaced by the answer to this request
+					wakeupSet.erase(i);
+					AW[i].notify = false;
+					handleIdleSlot(i);
+				}
+				// worker has finished a job (may or may not be succesful)
+				else if ( rd == 1 )
+				{
+					uint64_t status;
+					std::string sruninfo;
+
+					if ( !(fdio.getNumber(status) && fdio.getString(sruninfo)) )
+					{
+						fdio.rollback();
+						return false;
+					}
+					fdio.commit();
+
+					int const istatus = static_cast<int>(status);
+					RunInfo const RI(sruninfo);
+					RI.serialise(metastream);
+					metastream.flush();
+
+					JobDescription const J(RI.containerid,RI.subid);
+					JobDescription const N(RI.containerid,RI.subid+1);
+					std::map<JobDescription,int64_t>::const_iterator const itchain = AW[i].chainend.find(J);
+					bool const chained = itchain != AW[i].chainend.end() && itchain->second > N.subid;
+
+					if ( AW[i].running.find(J) == AW[i].running.end() )
 					{
-						// apply updates
-						for ( uint64_t i = 0; i < V.size(); ++i )
+						std::cerr << "[V] slot " << i << " reports finished job " << J.containerid << "," << J.subid << " which is not active" << std::endl;
+						// acknowledge, the worker must not go on with a chain unknown to us
+						fdio.putNumber(1);
+						Soutput.insert(i);
+					}
+					else
+					{
+						std::cerr << "[V] slot " << i << " reports job " << J.containerid << "," << J.subid << " ended with istatus=" << istatus << std::endl;
+
+						if ( WIFEXITED(istatus) && (WEXITSTATUS(istatus) == 0) )
 						{
-							V[i].dispatch(*cdlstream);
-							if ( ! cdlstream )
-							{
-								libmaus2::exception::LibMausException lme;
-								lme.getStream() << "[E] failed to write update" << std::endl;
-								lme.finish();
-								throw lme;
-							}
+							handleSuccessfulCommand(i,J);
 						}
-						cdlstream->flush();
-						if ( ! cdlstream )
+						else
 						{
-							libmaus2::exception::LibMausException lme;
-							lme.getStream() << "[E] failed to write update (flush)" << std::endl;
-							lme.finish();
-							throw lme;
+							std::cerr << "[V] slot " << i << " failed, checking requeue " << J.containerid << "," << J.subid << std::endl;
+							handleFailedCommand(i,J);
 						}
 
-						libmaus2::aio::FileRemoval::removeFile(journalfn);
-					}
-					catch(std::exception const & ex)
-					{
-						std::cerr << "[E] failed to apply updates: " << ex.what() << std::endl;
-						ok = false;
+						/*
+						 * acknowledge, 1 tells the worker to drop the rest
+						 * of the chain J belongs to (the failed step is
+						 * queued again or the pipeline has failed)
+						 */
+						bool const dropchain = chained && AW[i].running.find(N) == AW[i].running.end();
+						fdio.putNumber(dropchain ? 1 : 0);
+						Soutput.insert(i);
 					}
+				}
+				// worker is still running a job
+				else if ( rd == 2 )
+				{
+					fdio.commit();
+					// acknowledge
+					fdio.putNumber(0);
+					Soutput.insert(i);
+				}
+				else
+				{
+					fdio.commit();
 
+					std::cerr << "[V] process for slot " << i << " jobid " << AW[i].id << " is erratic" << std::endl;
+
+					failRunningJobs(i);
+					resetSlot(i /* slotid */);
 				}
 
-				runok = runok && ok;
+				return AW[i].Asocket.get() != 0;
 			}
+			default:
+			{
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] slot " << i << " has invalid protocol state" << std::endl;
+				lme.finish();
+				throw lme;
+			}
+		}
+	}
 
-			V.resize(0);
+	void handleSlotInput(uint64_t const i)
+	{
+		AW[i].fdio.fill();
 
-			return runok;
+		while ( AW[i].Asocket && handleSlotMessage(i) )
+		{
 		}
 
-		void * run()
+		if ( AW[i].Asocket && AW[i].fdio.ineof )
 		{
-			try
-			{
-				while ( true )
-				{
-					WriteContainerRequest WCR = WCRQ.deque();
-					V.push_back(WCR);
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] connection for slot " << i << " closed by worker" << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
 
-					if ( V.size() >= getUpdateThreshold() )
-						handleVectorFlush();
-					// WCR.dispatch(*cdlstream);
-				}
+	void closePendingConnection(int const fd)
+	{
+		EP.remove(fd);
+		Mpending.erase(fd);
+	}
+
+	void handlePendingInput(int const fd)
+	{
+		PendingConnection & P = *(Mpending.find(fd)->second);
+
+		P.fdio.fill();
+
+		uint64_t jobid;
+		if ( P.fdio.getNumber(jobid) )
+		{
+			P.fdio.commit();
+
+			std::cerr << "[V] accepted connection for jobid=" << jobid << " fd " << fd << std::endl;
+
+			std::map<uint64_t,uint64_t>::const_iterator const it = idToSlot.find(jobid);
+
+			if ( it == idToSlot.end() )
+			{
+				std::cerr << "[V] job id unknown" << std::endl;
+				closePendingConnection(fd);
 			}
-			catch(std::exception const & ex)
+			else if ( AW[it->second].Asocket )
 			{
-
+				std::cerr << "[E] erratic worker trying to open second connection" << std::endl;
+				closePendingConnection(fd);
 			}
+			else
+			{
+				uint64_t const slot = it->second;
 
-			handleVectorFlush();
+				AW[slot].Asocket = UNIQUE_PTR_MOVE(P.Asocket);
+				AW[slot].fdio = P.fdio;
+				AW[slot].protostate = worker_protocol_curdir;
+				Mpending.erase(fd);
+				fdToSlot[fd] = slot;
 
-			return 0;
-		}
-	};
-
-	WCRQWriterThread WCRQT;
-	#endif
-
-	static void writeJobDescription(
-		std::string const & fn,
-		std::string const & jobname,
-		std::string const & outfn,
-		uint64_t const utime,
-		uint64_t const umem,
-		uint64_t const threads,
-		std::string const partition,
-		std::string const command
-	)
-	{
-		libmaus2::aio::OutputStreamInstance OSI(fn);
+				AW[slot].fdio.putNumber(AW[slot].workerid);
+				AW[slot].fdio.putString(curdir);
+				Soutput.insert(slot);
 
-		OSI << "#!/bin/bash\n";
-		OSI << "#SBATCH --job-name=" << jobname << "\n";
-		OSI << "#SBATCH --output=" << outfn << "\n";
-		OSI << "#SBATCH --ntasks=1" << "\n";
-		OSI << "#SBATCH --time=" << utime << "\n";
-		OSI << "#SBATCH --mem=" << umem << "\n";
-		OSI << "#SBATCH --cpus-per-task=" << threads << "\n";
-		OSI << "#SBATCH --cpus-per-task=" << threads << "\n";
-		OSI << "#SBATCH --partition=" << partition << "\n";
-		OSI << "srun bash -c \"" << command << "\"\n";
+				try
+				{
+					// handle data received along with the job id
+					while ( AW[slot].Asocket && handleSlotMessage(slot) )
+					{
+					}
+				}
+				catch(std::exception const & ex)
+				{
+					std::cerr << "[E] error on new connection for slot " << slot << ":\n" << ex.what() << std::endl;
+					handleSlotFailure(slot);
+				}
+			}
+		}
+		else if ( P.fdio.ineof )
+		{
+			std::cerr << "[V] connection on fd " << fd << " closed before sending job id" << std::endl;
+			closePendingConnection(fd);
+		}
 	}
 
-	void processWakeupSet()
+	void acceptConnections()
 	{
-		for ( std::set < uint64_t >::const_iterator it = wakeupSet.begin();
-			it != wakeupSet.end(); ++it )
+		while ( true )
 		{
-			uint64_t const i = *it;
-			std::cerr << "[V] sending wakeup to slot " << i << std::endl;
+			// worker connections must not be inherited by programs started by control
+			#if defined(SOCK_CLOEXEC)
+			int const nfd = ::accept4(Pservsock->getFD(),NULL,NULL,SOCK_CLOEXEC);
+			#else
+			int const nfd = ::accept(Pservsock->getFD(),NULL,NULL);
+			if ( nfd >= 0 )
+				::fcntl(nfd,F_SETFD,FD_CLOEXEC);
+			#endif
 
-			FDIO fdio(AW[i].Asocket->getFD());
-			fdio.writeNumber(1);
+			if ( nfd < 0 )
+			{
+				int const error = errno;
+
+				switch ( error )
+				{
+					case EINTR:
+					case ECONNABORTED:
+						break;
+					case EAGAIN:
+					#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+					case EWOULDBLOCK:
+					#endif
+						return;
+					default:
+					{
+						std::cerr << "[E] error while accepting new connection: " << strerror(error) << std::endl;
+						return;
+					}
+				}
+			}
+			else
+			{
+				try
+				{
+					libmaus2::network::SocketBase::unique_ptr_type nptr(new libmaus2::network::SocketBase(nfd));
+					NonBlockingFDIO::setNonBlocking(nfd);
+					PendingConnection::shared_ptr_type P(new PendingConnection(nptr));
+					Mpending[nfd] = P;
+					EP.add(nfd);
+				}
+				catch(std::exception const & ex)
+				{
+					std::cerr << "[E] error while accepting new connection:\n" << ex.what() << std::endl;
+					Mpending.erase(nfd);
+				}
+			}
 		}
-		wakeupSet.clear();
 	}
 
-	void processResubmitSet()
+	// write queued output as far as possible without blocking
+	void flushOutput()
 	{
-		for ( std::set < uint64_t >::const_iterator it = Sresubmit.begin();
-			it != Sresubmit.end(); ++it )
+		while ( Soutput.size() )
 		{
-			uint64_t const i = *it;
-			std::cerr << "[V] resubmitting slot " << i << " after deep sleep" << std::endl;
-			Vreq[i].dispatch();
+			std::set<uint64_t> S;
+			S.swap(Soutput);
 
-		}
-		Sresubmit.clear();
-	}
+			for ( std::set<uint64_t>::const_iterator it = S.begin(); it != S.end(); ++it )
+			{
+				uint64_t const i = *it;
 
-	uint64_t computeMaxThreads()
-	{
-		uint64_t maxthreads = 1;
-		for ( uint64_t i = 0; i < VCC.size(); ++i )
-			maxthreads = std::max(maxthreads,VCC[i].threads);
-		return maxthreads;
-	}
+				if ( ! AW[i].Asocket )
+					continue;
 
-	static libmaus2::util::ContainerDescriptionList loadCDL(std::string const & cdl)
-	{
-		libmaus2::util::ContainerDescriptionList CDL;
-		libmaus2::aio::InputStreamInstance ISI(cdl);
-		CDL.deserialise(ISI);
-		return CDL;
-	}
+				try
+				{
+					bool const done = AW[i].fdio.flush();
 
-	static std::vector < libmaus2::util::CommandContainer > loadVCC(std::vector < libmaus2::util::ContainerDescription > & CDLV)
-	{
-		std::vector < libmaus2::util::CommandContainer > VCC(CDLV.size());
-		for ( uint64_t i = 0; i < CDLV.size(); ++i )
-		{
-			std::istringstream ISI(CDLV[i].fn);
-			VCC[i].deserialise(ISI);
-			CDLV[i].missingdep = 0;
+					if ( done == AW[i].pollout )
+					{
+						EP.modify(AW[i].Asocket->getFD(),!done);
+						AW[i].pollout = !done;
+					}
+				}
+				catch(std::exception const & ex)
+				{
+					std::cerr << "[V] exception while writing to slot " << i << " jobid " << AW[i].id << std::endl;
+					std::cerr << ex.what() << std::endl;
+					handleSlotFailure(i);
+				}
+			}
 		}
-
-		return VCC;
 	}
 
-	void countUnfinished()
+	/*
+	 * wait for events and handle all of them. Worker sockets are non
+	 * blocking, so a slow or unresponsive worker does not stall handling
+	 * of other connections.
+	 */
+	void processEvents(int const timeout = 1000 /* milli seconds */)
 	{
-		// count number of unfinished jobs per command container
-		for ( uint64_t i = 0; i < CDLV.size(); ++i )
-		{
-			libmaus2::util::CommandContainer & CC = VCC[i];
-			uint64_t numunfinished = 0;
+		EP.wait(Vevents,timeout);
 
-			for ( uint64_t j = 0; j < CC.V.size(); ++j )
-				if ( CC.V[j].completed )
-				{
+		for ( uint64_t j = 0; j < Vevents.size(); ++j )
+		{
+			int const rfd = Vevents[j].first;
+			uint32_t const revents = Vevents[j].second;
 
-				}
-				else
-				{
-					Munfinished[i]++;
-					numunfinished += 1;
-				}
+			if ( rfd == Pservsock->getFD() )
+			{
+				acceptConnections();
+				continue;
+			}
 
-			std::cerr << "[V] container " << i << " has " << numunfinished << " unfinished jobs" << std::endl;
+			if ( rfd == Psubmit->getFD() )
+			{
+				handleSubmissionResults();
+				continue;
+			}
 
-			if ( numunfinished )
+			if ( rfd == Pmodules->getFD() )
 			{
-				// check reverse dependencies
-				for ( uint64_t j = 0; j < CC.rdepid.size(); ++j )
-				{
-					uint64_t const k = CC.rdepid[j];
+				handleModuleResults();
+				continue;
+			}
 
-					std::cerr << "[V] container " << k << " has missing dependency " << i << std::endl;
+			std::map < int, PendingConnection::shared_ptr_type >::iterator itpending = Mpending.find(rfd);
 
-					CDLV[k].missingdep += 1;
+			if ( itpending != Mpending.end() )
+			{
+				try
+				{
+					handlePendingInput(rfd);
+				}
+				catch(std::exception const & ex)
+				{
+					std::cerr << "[E] error on connection fd " << rfd << ":\n" << ex.what() << std::endl;
+					if ( Mpending.find(rfd) != Mpending.end() )
+						closePendingConnection(rfd);
 				}
+				continue;
 			}
-		}
-	}
 
-	void addUnfinished(JobDescription const J)
-	{
-		Sunfinished.insert(J);
-	}
+			std::map<int,uint64_t>::const_iterator itslot = fdToSlot.find(rfd);
 
-	JobDescription getUnfinished()
-	{
-		std::set< JobDescription >::const_iterator const it = Sunfinished.begin();
-		JobDescription const P = *it;
-		Sunfinished.erase(it);
-		return P;
-	}
+			// slot may have been closed by an earlier event in this batch
+			if ( itslot == fdToSlot.end() )
+				continue;
 
-	void enqueUnfinished()
-	{
-		for ( uint64_t i = 0; i < CDLV.size(); ++i )
-		{
-			if ( CDLV[i].missingdep == 0 )
-			{
-				std::cerr << "[V] container " << i << " has no missing dependencies, enqueuing jobs" << std::endl;
+			uint64_t const i = itslot->second;
+
+			if ( revents & EPOLLOUT )
+				Soutput.insert(i);
 
-				for ( uint64_t j = 0; j < VCC[i].V.size(); ++j )
+			if ( revents & ~static_cast<uint32_t>(EPOLLOUT) )
+			{
+				try
 				{
-					if ( !VCC[i].V[j].completed )
-					{
-						addUnfinished(JobDescription(i,j));
-					}
+					handleSlotInput(i);
+				}
+				catch(std::exception const & ex)
+				{
+					std::cerr << "[V] exception for slot " << i << " jobid " << AW[i].id << std::endl;
+					std::cerr << ex.what() << std::endl;
+
+					handleSlotFailure(i);
 				}
 			}
 		}
-	}
 
-	std::vector < StartWorkerRequest > computeStartRequests(libmaus2::util::ArgParser const & arg)
-	{
-		std::vector < StartWorkerRequest > Vreq(workers);
-		for ( uint64_t i = 0; i < workers; ++i )
-			Vreq[i] = StartWorkerRequest(
-				nextworkerid,tmpfilebase,hostname,serverport,
-				workertime,workermem,workerthreads,partition,arg,AW.begin(),i,
-				idToSlot,workers,&tmpgen
-			);
-		return Vreq;
+		flushOutput();
 	}
 
-	void checkRequeue(uint64_t const slotid)
+	uint64_t numConnected() const
 	{
-		Mfail [ AW[slotid].packageid ] += 1;
-
-		libmaus2::util::CommandContainer & CC = VCC[AW[slotid].packageid.containerid];
-		libmaus2::util::Command & CO = CC.V[AW[slotid].packageid.subid];
-
-		// mark pipeline as failed
-		if ( Mfail [ AW[slotid].packageid ] >= CC.maxattempt )
-		{
-			std::cerr << "[V] too many failures on " << AW[slotid].packageid.containerid << "," << AW[slotid].packageid.subid << ", marking pipeline as failed" << std::endl;
-
-			if ( !CO.ignorefail )
-				failed = true;
-		}
-		// requeue
-		else
-		{
-			std::cerr << "[V] requeuing " << AW[slotid].packageid.containerid << "," << AW[slotid].packageid.subid << std::endl;
-
-			addUnfinished(AW[slotid].packageid);
-			processWakeupSet();
-			processResubmitSet();
-		}
+		uint64_t c = 0;
+		for ( uint64_t i = 0; i < AW.size(); ++i )
+			if ( AW[i].Asocket )
+				++c;
+		return c;
 	}
 
-
-	void resetSlot(uint64_t const slotid)
+	// log state of command J, the state table has already been updated
+	void writeCommandState(JobDescription const & J)
 	{
-		uint64_t const id = AW[slotid].id;
-		EP.remove(AW[slotid].Asocket->getFD());
-		fdToSlot.erase(AW[slotid].Asocket->getFD());
-		AW[slotid].reset();
-		idToSlot.erase(id);
-		wakeupSet.erase(id);
-		restartSet.insert(slotid);
+		CDLv2::CommandState const & CS = PCDL->getCommandState(J.containerid,J.subid);
+		WAL.append(CommandStateUpdate(J.containerid,J.subid,CS.numattempts,CS.completed));
 	}
 
-	void writeContainer(uint64_t const i)
+	// write back the state tables of the container file and truncate the log
+	void checkpoint()
 	{
-		// serialise object to string
-		std::ostringstream ostr;
-		VCC.at(i).serialise(ostr);
-		// store it in the CDL vector
-		CDL.V.at(i).fn = ostr.str();
+		WAL.commit();
 
-		// get updated object
-		libmaus2::util::ContainerDescription const CD = CDL.V.at(i);
+		PCDL->sync(WAL.policy == WriteAheadLog::sync_policy_fsync);
 
-		// make sure it has the correct size
-		assert ( CDL.checkSize(i,CD) );
+		std::cerr << "[V] checkpoint synced state of " << WAL.numlogged << " updates to " << cdl << std::endl;
 
-		// get offset in file
-		uint64_t const offset = CDL.getOffset(i).first;
-
-		// instantiate request
-		WriteContainerRequest W(CD,offset);
+		WAL.truncate();
+	}
 
-		// get name of journal on disk
-		std::string const journalname = getJournalName();
+	// group commit of logged updates
+	void commitLog()
+	{
+		WAL.commitIfDue();
 
-		// serialise request with checksum
-		W.serialiseWithChecksum(journalname);
+		if ( WAL.numlogged >= walcheckpoint )
+			checkpoint();
+	}
 
-		// see whether we can read it back with checksum correct
-		bool const ok = WriteContainerRequest::deserialiseWithChecksum(journalname);
+	// apply updates left in the log by a previous run
+	void replayLog()
+	{
+		std::vector < CommandStateUpdate > const V = WriteAheadLog::replay(WAL.fn);
 
-		// if not then fail
-		if ( ! ok )
+		for ( uint64_t i = 0; i < V.size(); ++i )
 		{
-			libmaus2::exception::LibMausException lme;
-			lme.getStream() << "[E] failed to read back journal entry" << std::endl;
-			lme.finish();
-			throw lme;
-		}
+			CommandStateUpdate const & U = V[i];
 
-		// update on disk information
-		W.dispatch(*cdlstream);
-		cdlstream->flush();
+			if ( U.containerid >= PCDL->numContainers() || U.subid >= PCDL->getContainerInfo(U.containerid).numcommands )
+			{
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] log " << WAL.fn << " contains update for unknown command " << U.containerid << "," << U.subid << std::endl;
+				lme.finish();
+				throw lme;
+			}
 
-		libmaus2::aio::FileRemoval::removeFile(journalname);
+			CDLv2::CommandState & CS = PCDL->getCommandState(U.containerid,U.subid);
+			CS.numattempts = U.numattempts;
+			CS.completed = U.completed;
+		}
 
-		#if 0
-		// enque write request
-		WCRQ.enque(W);
-		#endif
+		if ( V.size() )
+			checkpoint();
 	}
 
 	void handleSuccessfulCommand(
 		uint64_t const slotid,
+		JobDescription const packageid,
 		bool const verbose = false
 	)
 	{
 		if ( verbose )
-			std::cerr << "[V] getting package id for slot " << slotid << std::endl;
-		JobDescription const packageid = AW[slotid].packageid;
-		if ( verbose )
-			std::cerr << "[V] found package id " << packageid.containerid << "," << packageid.subid << std::endl;
-
-		if ( verbose )
-			std::cerr << "[V] getting command container" << std::endl;
-		libmaus2::util::CommandContainer & CC = VCC[packageid.containerid];
-		if ( verbose )
-			std::cerr << "[V] got command container" << std::endl;
+			std::cerr << "[V] handling success of " << packageid.containerid << "," << packageid.subid << " on slot " << slotid << std::endl;
 
-		libmaus2::util::Command & CO = CC.V[packageid.subid];
+		CDLv2::CommandState & CS = PCDL->getCommandState(packageid.containerid,packageid.subid);
 
 		if ( verbose )
 			std::cerr << "[V] updating numattempts,completed" << std::endl;
-		CO.numattempts += 1;
-		CO.completed = true;
-		if ( CO.deepsleep )
-		{
-			assert ( ndeepsleep > 0 );
-			ndeepsleep -= 1;
-		}
-		Srunning.erase(packageid);
+		CS.numattempts += 1;
+		CS.completed = true;
+		unmarkRunning(packageid);
 		if ( verbose )
-			std::cerr << "[V] updated numattempts,completed to " << CO.numattempts << "," << CO.completed << std::endl;
+			std::cerr << "[V] updated numattempts,completed to " << CS.numattempts << "," << static_cast<int>(CS.completed) << std::endl;
 
-		writeContainer(packageid.containerid);
+		writeCommandState(packageid);
 
-		uint64_t const numunfin = --Munfinished [ packageid.containerid ];
+		assert ( Vunfinished [ packageid.containerid ] );
+		uint64_t const numunfin = --Vunfinished [ packageid.containerid ];
 
 		if ( !numunfin )
 		{
-			std::cerr << "[V] finished command container " << AW[slotid].packageid.containerid << std::endl;
+			std::cerr << "[V] finished command container " << packageid.containerid << std::endl;
 
-			for ( uint64_t j = 0; j < CC.rdepid.size(); ++j )
+			uint64_t const * rdep = PCDL->getReverseDependencies(packageid.containerid);
+			for ( uint64_t j = 0; j < PCDL->numReverseDependencies(packageid.containerid); ++j )
 			{
-				uint64_t const k = CC.rdepid[j];
+				uint64_t const k = rdep[j];
 
-				assert ( CDLV[k].missingdep );
+				CDLv2::ContainerState & KS = PCDL->getContainerState(k);
 
-				CDLV[k].missingdep -= 1;
+				assert ( KS.missingdep );
 
-				if ( ! CDLV[k].missingdep )
+				KS.missingdep -= 1;
+
+				if ( ! KS.missingdep )
 				{
 					std::cerr << "[V] activating container " << k << std::endl;
-					for ( uint64_t j = 0; j < VCC[k].V.size(); ++j )
-					{
-						addUnfinished(JobDescription(k,j));
-					}
-					if ( Sunfinished.size() )
+					for ( uint64_t j = 0; j < PCDL->getContainerInfo(k).numcommands; ++j )
 					{
-						processWakeupSet();
-						processResubmitSet();
+						if ( isReleased(k,j) )
+							addUnfinished(JobDescription(k,j));
 					}
+					processWakeupSet();
 				}
 			}
 		}
+		// the worker goes on with the next step of a chain of fused commands
+		else if ( continueChain(slotid,packageid) )
+		{
+			return;
+		}
+
+		releaseJob(slotid,packageid);
 
-		AW[slotid].resetPackageId();
+		// queue the next step of a chain of fused commands the worker does not run (e.g. after the worker failed)
+		JobDescription const N(packageid.containerid,packageid.subid+1);
+
+		if ( numunfin && getChainEnd(packageid) > N.subid && ! PCDL->getCommandState(N.containerid,N.subid).completed )
+		{
+			std::cerr << "[V] activating command " << N.containerid << "," << N.subid << std::endl;
+			addUnfinished(N);
+			processWakeupSet();
+		}
 	}
 
-	void handleFailedCommand(uint64_t const slotid)
+	void handleFailedCommand(uint64_t const slotid, JobDescription const packageid)
 	{
-		std::cerr << "[V] getting package id for slot " << slotid << std::endl;
-		JobDescription const packageid = AW[slotid].packageid;
-		std::cerr << "[V] found package id " << packageid.containerid << "," << packageid.subid << std::endl;
+		std::cerr << "[V] handling failure of " << packageid.containerid << "," << packageid.subid << " on slot " << slotid << std::endl;
 
-		std::cerr << "[V] getting reference to command container" << std::endl;
-		libmaus2::util::CommandContainer & CC = VCC.at(packageid.containerid);
-		std::cerr << "[V] got reference to command container" << std::endl;
-
-		std::cerr << "[V] gettting reference to command" << std::endl;
-		libmaus2::util::Command & CO = CC.V[packageid.subid];
-		std::cerr << "[V] got reference to command" << std::endl;
+		CDLv2::ContainerInfo const & CI = PCDL->getContainerInfo(packageid.containerid);
+		CDLv2::CommandState & CS = PCDL->getCommandState(packageid.containerid,packageid.subid);
 
 		std::cerr << "[V] incrementing numattempts" << std::endl;
-		CO.numattempts += 1;
-		if ( CO.deepsleep )
-		{
-			assert ( ndeepsleep > 0 );
-			ndeepsleep -= 1;
-		}
-		Srunning.erase(packageid);
-		std::cerr << "[V] incremented numattempts to " << CO.numattempts << std::endl;
+		CS.numattempts += 1;
+		unmarkRunning(packageid);
+		std::cerr << "[V] incremented numattempts to " << CS.numattempts << std::endl;
 
-		if ( CO.numattempts >= CC.maxattempt && CO.ignorefail )
+		if ( CS.numattempts >= CI.maxattempt && PCDL->hasCommandFlag(packageid.containerid,packageid.subid,CDLv2::command_flag_ignorefail) )
 		{
-			std::cerr << "[V] number of attempts reached max " << CC.maxattempt << " but container has ignorefail flag set" << std::endl;
+			std::cerr << "[V] number of attempts reached max " << CI.maxattempt << " but container has ignorefail flag set" << std::endl;
 
 			std::cerr << "[V] decreasing numattempts" << std::endl;
-			CO.numattempts -= 1;
-			if ( CO.deepsleep )
-				ndeepsleep += 1;
-			Srunning.insert(packageid);
-			std::cerr << "[V] decreased numattempts to " << CO.numattempts << std::endl;
+			CS.numattempts -= 1;
+			markRunning(packageid);
+			std::cerr << "[V] decreased numattempts to " << CS.numattempts << std::endl;
 
 			std::cerr << "[V] calling handleSuccesfulCommand" << std::endl;
-			handleSuccessfulCommand(slotid,true);
+			handleSuccessfulCommand(slotid,packageid,true);
 			std::cerr << "[V] returned from handleSuccesfulCommand" << std::endl;
 		}
 		else
 		{
-			writeContainer(packageid.containerid);
-			checkRequeue(slotid);
-			AW[slotid].resetPackageId();
+			writeCommandState(packageid);
+			checkRequeue(packageid);
+			releaseJob(slotid,packageid);
 		}
 	}
 
@@ -1716,9 +2477,9 @@ struct SlurmControl
 		return cdl + ".journal";
 	}
 
-	std::string getJournalName()
+	static std::string getLogName(std::string const & cdl)
 	{
-		return getJournalName(cdl);
+		return cdl + ".wal";
 	}
 
 	SlurmControl(
@@ -1729,6 +2490,18 @@ struct SlurmControl
 		uint64_t const rworkers,
 		std::string const & rcdl,
 		int64_t const rworkerthreads,
+		WriteAheadLog::sync_policy const rwalsync,
+		uint64_t const rwalgroup,
+		uint64_t const rwalinterval,
+		uint64_t const rwalcheckpoint,
+		ReadyQueue::queue_policy const rqueuepolicy,
+		std::string const & rworkerclasses,
+		std::string const & rbackend,
+		uint64_t const rsubmitinterval,
+		uint64_t const rsubmitretries,
+		uint64_t const rsubmitretrydelay,
+		std::string const & rcontrolmodules,
+		uint64_t const rcontrolmodulethreads,
 		libmaus2::util::ArgParser const & rarg
 	)
 	: curdir(libmaus2::util::ArgInfo::getCurDir()),
@@ -1740,20 +2513,39 @@ struct SlurmControl
 	  partition(rpartition),
 	  workers(rworkers),
 	  cdl(rcdl),
-	  AW(workers),
+	  Pbackend(BatchBackend::construct(rbackend,rarg)),
+	  Psubmit(new SubmissionThread(*Pbackend,rsubmitinterval,rsubmitretries,rsubmitretrydelay)),
+	  submitrunning(false),
+	  Ssubmitting(),
+	  numqueries(0),
+	  lastsubmitcheck(time(0)),
+	  Scontrolmodules(parseControlModules(rcontrolmodules)),
+	  moduleloader(rarg.getAbsProgName()),
+	  Pmodules(new ModuleThreadPool(rcontrolmodulethreads)),
+	  Mmodulejobs(),
+	  nextmoduletask(0),
+	  PCDL(new CDLv2(cdl,true)),
+	  maxthreads(computeMaxThreads()),
+	  workerthreads(rworkerthreads > 0 ? rworkerthreads : maxthreads),
+	  Vclass(computeWorkerClasses(rworkerclasses)),
+	  Vcontainerclass(computeContainerClasses()),
+	  Vslotclass(computeSlotClasses()),
+	  AW(Vslotclass.size()),
 	  idToSlot(),
 	  fdToSlot(),
 	  Mfail(),
-	  CDL(loadCDL(cdl)),
-	  CDLV(CDL.V),
-	  VCC(loadVCC(CDLV)),
-	  Sunfinished(),
+	  queuepolicy(rqueuepolicy),
+	  Vbottomlevel(computeBottomLevel(*PCDL)),
+	  Vclassindex(computeClassIndex()),
+	  Vready(computeReadyQueues()),
 	  Srunning(),
+	  Vclassrunning(Vclass.size(),0),
 	  ndeepsleep(0),
-	  Munfinished(),
-	  maxthreads(computeMaxThreads()),
-	  workerthreads(rworkerthreads > 0 ? rworkerthreads : maxthreads),
-	  EP(workers+1),
+	  Vunfinished(),
+	  EP(AW.size()+2),
+	  Vevents(),
+	  Mpending(),
+	  Soutput(),
 	  Pservsock(
 		libmaus2::network::ServerSocket::allocateServerSocket(
 			serverport,
@@ -1762,361 +2554,111 @@ struct SlurmControl
 			tries
 		)
 	  ),
-	  restartSet(),
 	  wakeupSet(),
 	  // pending(0),
 	  pstate(),
 	  failed(false),
-	  Vreq(computeStartRequests(rarg)),
 	  metastream(cdl + ".meta",std::ios::in | std::ios::out | std::ios::binary),
-	  cdlstream(new libmaus2::aio::InputOutputStreamInstance(cdl,std::ios::in | std::ios::out | std::ios::binary))
-	  #if 0
-	  WCRQ(),
-	  WCRQT(WCRQ,cdlstream,cdl)
-	  #endif
+	  WAL(getLogName(cdl),rwalsync,rwalgroup,rwalinterval),
+	  walcheckpoint(rwalcheckpoint)
 	{
 
 		metastream.seekp(0,std::ios::end);
 
-		std::cerr << "[V] hostname=" << hostname << " serverport=" << serverport << " number of containers " << CDLV.size() << std::endl;
+		std::cerr << "[V] hostname=" << hostname << " serverport=" << serverport << " number of containers " << PCDL->numContainers() << std::endl;
 
 		std::cerr << "[V] got server fd " << Pservsock->getFD() << std::endl;
+		NonBlockingFDIO::setNonBlocking(Pservsock->getFD());
+		::fcntl(Pservsock->getFD(),F_SETFD,FD_CLOEXEC);
 		EP.add(Pservsock->getFD());
-		fdToSlot[Pservsock->getFD()] = std::numeric_limits<uint64_t>::max();
+
+		NonBlockingFDIO::setNonBlocking(Psubmit->getFD());
+		EP.add(Psubmit->getFD());
+		Psubmit->start();
+		submitrunning = true;
+
+		NonBlockingFDIO::setNonBlocking(Pmodules->getFD());
+		EP.add(Pmodules->getFD());
+
+		replayLog();
 
 		countUnfinished();
 		enqueUnfinished();
+	}
 
-		#if 0
-		WCRQT.start();
-		#endif
+	// let the submission thread finish queued requests and wait for it
+	void stopSubmissionThread()
+	{
+		if ( submitrunning )
+		{
+			Psubmit->shutdown();
+			submitrunning = false;
+			handleSubmissionResults();
+		}
 	}
 
 	~SlurmControl()
 	{
-		#if 0
-		WCRQ.terminate();
-		WCRQT.join();
-		#endif
+		try
+		{
+			stopSubmissionThread();
+		}
+		catch(std::exception const & ex)
+		{
+			std::cerr << "[E] failed to stop submission thread:\n" << ex.what() << std::endl;
+		}
+
+		try
+		{
+			checkpoint();
+		}
+		catch(std::exception const & ex)
+		{
+			std::cerr << "[E] final checkpoint failed, updates remain in " << WAL.fn << ":\n" << ex.what() << std::endl;
+		}
 	}
 
 	int process()
 	{
-		for ( uint64_t i = 0; i < workers; ++i )
-			Vreq[i].dispatch();
-
 		libmaus2::util::TempFileNameGenerator tmpgen(tmpfilebase+"_tmpgen",3);
 
-		while ( Sunfinished.size() || Srunning.size() )
+		while ( numReady() || Srunning.size() )
 		{
-			std::set<uint64_t> nrestartSet;
-			for ( std::set<uint64_t>::const_iterator it = restartSet.begin(); it != restartSet.end(); ++it )
-			{
-				uint64_t const i = *it;
-
-				try
-				{
-					Vreq[i].dispatch();
-				}
-				catch(std::exception const & ex)
-				{
-					std::cerr << "[E] job start failed:\n" << ex.what() << std::endl;
-					nrestartSet.insert(i);
-					AW[i].reset();
-				}
-			}
-			restartSet.clear();
-			restartSet = nrestartSet;
+			// start workers for classes with waiting jobs
+			checkSubmitted();
+			growPools();
 
 			ProgState npstate(
-				Sunfinished.size(),
+				numReady(),
 				Srunning.size()
 			);
 
 			if ( npstate != pstate )
 			{
 				pstate = npstate;
-				std::cerr << "[V] Sunfinished.size()=" << pstate.numunfinished << " pending=" << pstate.numpending << std::endl;
+				std::cerr << "[V] ready=" << pstate.numunfinished << " pending=" << pstate.numpending << std::endl;
 			}
 
-			int rfd = -1;
-			if ( EP.wait(rfd) )
-			{
-				std::map<int,uint64_t>::const_iterator itslot = fdToSlot.find(rfd);
-
-				if ( itslot == fdToSlot.end() )
-				{
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[E] EPoll::wait returned unknown file descriptor" << std::endl;
-					lme.finish();
-					throw lme;
-				}
-				else if ( itslot->second == std::numeric_limits<uint64_t>::max() )
-				{
-					assert ( rfd == Pservsock->getFD() );
-					int64_t slot = -1;
-
-					try
-					{
-						libmaus2::network::SocketBase::unique_ptr_type nptr = Pservsock->accept();
-
-						FDIO fdio(nptr->getFD());
-						uint64_t const jobid = fdio.readNumber();
-
-						std::cerr << "[V] accepted connection for jobid=" << jobid << " fd " << nptr->getFD() << std::endl;
-
-						if ( idToSlot.find(jobid) != idToSlot.end() )
-						{
-							slot = idToSlot.find(jobid)->second;
-							fdio.writeNumber(AW[slot].workerid);
-							fdio.writeString(curdir);
-							bool const curdirok = fdio.readNumber();
-
-							if ( curdirok )
-							{
-								fdio.writeString(AW[slot].wtmpbase);
-								std::string const outdatafn = fdio.readString();
-								std::string const errdatafn = fdio.readString();
-								std::string const metafn = fdio.readString();
-
-								AW[slot].outdatafn = outdatafn;
-								AW[slot].errdatafn = errdatafn;
-								AW[slot].metafn = metafn;
-
-								if ( ! AW[slot].Asocket )
-								{
-									AW[slot].Asocket = UNIQUE_PTR_MOVE(nptr);
-									EP.add(AW[slot].Asocket->getFD());
-									fdToSlot[AW[slot].Asocket->getFD()] = slot;
-									AW[slot].active = true;
-
-									std::cerr << "[V] marked slot " << slot << " active for jobid " << AW[slot].id << std::endl;
-								}
-								else
-								{
-									libmaus2::exception::LibMausException lme;
-									lme.getStream() << "[E] erratic worker trying to open second connection" << std::endl;
-									lme.finish();
-									throw lme;
-								}
-							}
-						}
-						else
-						{
-							std::cerr << "[V] job id unknown" << std::endl;
-						}
-					}
-					catch(std::exception const & ex)
-					{
-						std::cerr << "[E] error while accepting new connection:\n" << ex.what() << std::endl;
-						if ( slot >= 0 )
-							AW[slot].reset();
-					}
-				}
-				else
-				{
-					uint64_t const i = itslot->second;
-
-					std::cerr << "[V] epoll returned slot " << i << " ready for reading" << std::endl;
-
-					if ( ! AW[i].active )
-					{
-						libmaus2::exception::LibMausException lme;
-						lme.getStream() << "[E] epoll returned file descriptor for inactive slot" << std::endl;
-						lme.finish();
-						throw lme;
-					}
-
-					try
-					{
-						// read worker state
-						FDIO fdio(AW[i].Asocket->getFD());
-						uint64_t const rd = fdio.readNumber();
-
-						// worker is idle
-						if ( rd == 0 )
-						{
-							if ( Sunfinished.size() )
-							{
-								// get next package
-								JobDescription const currentid = getUnfinished();
-								// get command
-								libmaus2::util::Command const com = VCC[currentid.containerid].V[currentid.subid];
-								// serialise command to string
-								std::ostringstream ostr;
-								com.serialise(ostr);
-								// process command
-								AW[i].packageid = currentid;
-								fdio.writeNumber(0);
-								fdio.writeString(ostr.str());
-								fdio.writeNumber(currentid.containerid);
-								fdio.writeNumber(currentid.subid);
-								std::string const sruninfo = fdio.readString();
-
-								Srunning.insert(currentid);
-								if ( com.deepsleep )
-									ndeepsleep += 1;
-
-								std::cerr << "[V] started " << com << " for " << currentid.containerid << "," << currentid.subid << " on slot " << i << " wtmpbase " << AW[i].wtmpbase << std::endl;
-							}
-							else
-							{
-								if ( ndeepsleep == Srunning.size() )
-								{
-									// put slot to deep sleep
-									std::cerr << "[V] putting slot " << i << " to deep sleep" << std::endl;
-
-									// request termination
-									fdio.writeNumber(2);
-									EP.remove(AW[i].Asocket->getFD());
-									fdToSlot.erase(AW[i].Asocket->getFD());
-									AW[i].reset();
-									Sresubmit.insert(i);
-								}
-								else
-								{
-									std::cerr << "[V] putting slot " << i << " in wakeupSet" << std::endl;
-
-									wakeupSet.insert(i);
-								}
-							}
-						}
-						// worker has finished a job (may or may not be succesful)
-						else if ( rd == 1 )
-						{
-							uint64_t const status = fdio.readNumber();
-							int const istatus = static_cast<int>(status);
-							std::string const sruninfo = fdio.readString();
-							RunInfo const RI(sruninfo);
-							RI.serialise(metastream);
-							metastream.flush();
-							// acknowledge
-							fdio.writeNumber(0);
-
-							std::cerr << "[V] slot " << i << " reports job ended with istatus=" << istatus << std::endl;
-
-							if ( WIFEXITED(istatus) && (WEXITSTATUS(istatus) == 0) )
-							{
-								handleSuccessfulCommand(i);
-							}
-							else
-							{
-								std::cerr << "[V] slot " << i << " failed, checking requeue " << AW[i].packageid.containerid << "," << AW[i].packageid.subid << std::endl;
-								handleFailedCommand(i);
-							}
-						}
-						// worker is still running a job
-						else if ( rd == 2 )
-						{
-							// acknowledge
-							fdio.writeNumber(0);
-						}
-						else
-						{
-							std::cerr << "[V] process for slot " << i << " jobid " << AW[i].id << " is erratic" << std::endl;
-
-							if ( AW[i].packageid.containerid >= 0 )
-							{
-								handleFailedCommand(i);
-							}
-
-							resetSlot(i /* slotid */);
-						}
-					}
-					catch(std::exception const & ex)
-					{
-						std::cerr << "[V] exception for slot " << i << " jobid " << AW[i].id << std::endl;
-						std::cerr << ex.what() << std::endl;
-
-						if ( AW[i].packageid.containerid >= 0 )
-						{
-							try
-							{
-								handleFailedCommand(i);
-							}
-							catch(std::exception const & ex)
-							{
-								std::cerr << "[E] exception in handleFailedCommand: " << std::endl;
-								std::cerr << ex.what() << std::endl;
-								throw;
-							}
-						}
-
-						try
-						{
-							resetSlot(i /* slotid */);
-						}
-						catch(std::exception const & ex)
-						{
-							std::cerr << "[E] exception in resetSlot: " << std::endl;
-							std::cerr << ex.what() << std::endl;
-							throw;
-						}
-					}
-				}
-			}
+			processEvents();
+			commitLog();
 		}
 
 		processWakeupSet();
-		processResubmitSet();
-
-		std::set<uint64_t> Sactive;
-		for ( uint64_t i = 0; i < AW.size(); ++i )
-			if ( AW[i].active )
-				Sactive.insert(i);
-
-		while ( Sactive.size() )
-		{
-			std::vector < uint64_t > Vterm;
-
-			for ( std::set<uint64_t>::const_iterator it = Sactive.begin(); it != Sactive.end(); ++it )
-			{
-				uint64_t const i = *it;
-
-				try
-				{
-					// read worker state
-					FDIO fdio(AW[i].Asocket->getFD());
-					uint64_t const rd = fdio.readNumber();
+		flushOutput();
 
-					// worker is idle
-					if ( rd == 0 )
-					{
-						// request terminate
-						fdio.writeNumber(2);
-						EP.remove(AW[i].Asocket->getFD());
-						fdToSlot.erase(AW[i].Asocket->getFD());
-						AW[i].reset();
-						Vterm.push_back(i);
-					}
-					else if ( rd == 1 )
-					{
-						std::cerr << "[V] slot " << i << " reports finished job with no jobs active" << std::endl;
-					}
-					// worker is still running a job
-					else if ( rd == 2 )
-					{
-						std::cerr << "[V] slot " << i << " reports job running, but we know of no such job" << std::endl;
-						fdio.writeNumber(0);
-					}
-					else
-					{
-						std::cerr << "[V] process for slot " << i << " jobid " << AW[i].id << " is erratic" << std::endl;
+		// wait for submissions in progress, so their workers can be cancelled
+		while ( Ssubmitting.size() )
+			processEvents();
 
-						resetSlot(i /* slotid */);
-					}
-				}
-				catch(...)
-				{
-					std::cerr << "[V] exception for slot " << i << " jobid " << AW[i].id << std::endl;
+		// tell remaining workers to terminate
+		while ( numConnected() )
+			processEvents();
 
-					resetSlot(i /* slotid */);
-				}
-			}
+		cancelSubmitted();
+		stopSubmissionThread();
+		Pmodules->shutdown();
 
-			for ( uint64_t i = 0; i < Vterm.size(); ++i )
-				Sactive.erase(Vterm[i]);
-		}
+		checkpoint();
 
 		if ( failed )
 		{
@@ -2141,12 +2683,24 @@ int hpcschedcontrol(libmaus2::util::ArgParser const & arg)
 	uint64_t const workermem = arg.uniqueArgPresent("workermem") ? arg.getParsedArg<uint64_t>("workermem") : 40000;
 	std::string const partition = arg.uniqueArgPresent("p") ? arg["p"] : "haswell";
 	uint64_t const workers = arg.uniqueArgPresent("workers") ? arg.getParsedArg<uint64_t>("workers") : 16;
+	WriteAheadLog::sync_policy const walsync = WriteAheadLog::parseSyncPolicy(arg.uniqueArgPresent("walsync") ? arg["walsync"] : "write");
+	uint64_t const walgroup = arg.uniqueArgPresent("walgroup") ? arg.getParsedArg<uint64_t>("walgroup") : 1024;
+	uint64_t const walinterval = arg.uniqueArgPresent("walinterval") ? arg.getParsedArg<uint64_t>("walinterval") : 1000;
+	uint64_t const walcheckpoint = arg.uniqueArgPresent("walcheckpoint") ? arg.getParsedArg<uint64_t>("walcheckpoint") : 65536;
+	ReadyQueue::queue_policy const queuepolicy = ReadyQueue::parsePolicy(arg.uniqueArgPresent("queue") ? arg["queue"] : "priority");
+	std::string const workerclasses = arg.uniqueArgPresent("workerclasses") ? arg["workerclasses"] : std::string();
+	std::string const backend = arg.uniqueArgPresent("backend") ? arg["backend"] : "slurm";
+	uint64_t const submitinterval = arg.uniqueArgPresent("submitinterval") ? arg.getParsedArg<uint64_t>("submitinterval") : 100;
+	uint64_t const submitretries = arg.uniqueArgPresent("submitretries") ? arg.getParsedArg<uint64_t>("submitretries") : 5;
+	uint64_t const submitretrydelay = arg.uniqueArgPresent("submitretrydelay") ? arg.getParsedArg<uint64_t>("submitretrydelay") : 1000;
+	std::string const controlmodules = arg.uniqueArgPresent("controlmodules") ? arg["controlmodules"] : "mkdir,rmdir";
+	uint64_t const controlmodulethreads = arg.uniqueArgPresent("controlmodulethreads") ? arg.getParsedArg<uint64_t>("controlmodulethreads") : 2;
 
 	std::string const cdl = arg[0];
 	std::string const cdlmeta = cdl + ".meta";
 	std::string const cdljournal = SlurmControl::getJournalName(cdl);
 
-	// check for journal
+	// check for single container journal left by older versions
 	if ( libmaus2::util::GetFileSize::fileExists(cdljournal) )
 	{
 		SlurmControl::WriteContainerRequest WCR;
@@ -2163,15 +2717,12 @@ int hpcschedcontrol(libmaus2::util::ArgParser const & arg)
 		libmaus2::aio::FileRemoval::removeFile(cdljournal);
 	}
 
-	#if 0
-	bool const journalok = SlurmControl::WCRQWriterThread::tryApplyJournal(cdl,cdljournal);
-
-	if ( ! journalok )
+	// convert container files written by older versions of hpcschedmake
+	if ( ! CDLv2::isCDLv2(cdl) )
 	{
-		std::cerr << "[E] failed to replay journal, please check error messages" << std::endl;
-		return EXIT_FAILURE;
+		std::cerr << "[V] converting " << cdl << " to container file format version 2" << std::endl;
+		CDLv2::convertVersion1(cdl);
 	}
-	#endif
 
 	if ( ! libmaus2::util::GetFileSize::fileExists(cdlmeta) )
 	{
@@ -2181,6 +2732,12 @@ int hpcschedcontrol(libmaus2::util::ArgParser const & arg)
 	SlurmControl SC(
 		tmpfilebase,workertime,workermem,partition,workers,cdl,
 		arg.uniqueArgPresent("workerthreads") ? arg.getParsedArg<uint64_t>("workerthreads") : -1,
+		walsync,walgroup,walinterval,walcheckpoint,
+		queuepolicy,
+		workerclasses,
+		backend,
+		submitinterval,submitretries,submitretrydelay,
+		controlmodules,controlmodulethreads,
 		arg
 	);
 
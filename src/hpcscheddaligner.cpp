@@ -262,8 +262,10 @@ int main(int argc, char * argv[])
 						std::cout << "\n";
 
 						std::cout << "LAmerge_" << fn << "_cleanup: " << fn << "\n";
+						std::cout << "\thpcsched::rmtree";
 						for ( uint64_t j = low; j < high; ++j )
-							std::cout << "\trm " << V[j] << "\n";
+							std::cout << " " << V[j];
+						std::cout << "\n";
 
 						Vout.push_back(fn);
 					}
@@ -296,8 +298,10 @@ int main(int argc, char * argv[])
 					std::cout << "\n";
 
 					std::cout << "LAmerge_" << fn << "_cleanup: " << fn << "\n";
+					std::cout << "\thpcsched::rmtree";
 					for ( uint64_t j = low; j < high; ++j )
-						std::cout << "\trm " << V[j] << "\n";
+						std::cout << " " << V[j];
+					std::cout << "\n";
 
 					Vout.push_back(fn);
 					V = Vout;
@@ -25,406 +25,331 @@
 #include <libmaus2/util/Base64.hpp>
 #include <libmaus2/parallel/NumCpus.hpp>
 #include <sstream>
-#include <regex>
+#include <CDLv2.hpp>
+#include <WriteAheadLog.hpp>
+#include <LogPolicy.hpp>
+#include <ExecCommand.hpp>
+#include <MakefileParser.hpp>
 
-struct Token
-{
-	enum token_type { TOKEN_NEWLINE, TOKEN_SYMBOL, TOKEN_EOF, TOKEN_ESCAPE };
-	token_type token;
-	char sym;
-
-	Token()
-	{
-
-	}
-
-	Token(token_type const rtoken, char const c) : token(rtoken), sym(c) {}
-};
-
-Token getNextToken(std::string const & s, uint64_t & i)
-{
-	while ( i < s.size() )
-	{
-		// skip newline
-		if ( s[i] == '\\' && i+1 < s.size() && s[i+1] == '\n' )
-		{
-			i += 2;
-		}
-		else if ( s[i] == '\\' && i+1 < s.size() && s[i+1] != '\n' )
-		{
-			Token tok(Token::TOKEN_ESCAPE,s[i+1]);
-			i += 2;
-			return tok;
-		}
-		else if ( s[i] == '\n' )
-		{
-			i += 1;
-			return Token(Token::TOKEN_NEWLINE,'\n');
-		}
-		else
-		{
-			Token tok(Token::TOKEN_SYMBOL,s[i]);
-			i += 1;
-			return tok;
-		}
-	}
-
-	return Token(Token::TOKEN_EOF,0);
-}
-
-struct Rule
-{
-	std::vector<std::string> produced;
-	std::vector<std::string> dependencies;
-	std::vector<std::string> commands;
-	bool ignorefail;
-	bool deepsleep;
-	int64_t maxattempt;
-	int64_t numthreads;
-	int64_t mem;
-
-	void clear()
-	{
-		produced.resize(0);
-		dependencies.resize(0);
-		commands.resize(0);
-	}
-};
-
-std::ostream & operator<<(std::ostream & out, Rule const & R)
+static std::string getDefaultD(libmaus2::util::ArgParser const & arg)
 {
-	out << "Rule:" << std::endl;
-	for ( uint64_t i = 0; i < R.produced.size(); ++i )
-		out << "\tproduced[" << i << "]=" << R.produced[i] << std::endl;
-	for ( uint64_t i = 0; i < R.dependencies.size(); ++i )
-		out << "\tdependencies[" << i << "]=" << R.dependencies[i] << std::endl;
-	for ( uint64_t i = 0; i < R.commands.size(); ++i )
-		out << "\t\tcommands[" << i << "]=" << R.commands[i] << std::endl;
-	return out;
+	return libmaus2::util::ArgInfo::getDefaultTmpFileName(arg.progname);
 }
 
-static std::vector<std::string> splitSpace(std::string const & s)
+#if 0
+static void schdir(std::string const & d)
 {
-	uint64_t i = 0;
+	bool done = false;
 
-	std::vector<std::string> V;
-	while ( i < s.size() )
+	while ( !done )
 	{
-		while ( i < s.size() && isspace(s[i]) )
-			++i;
-
-		uint64_t const j = i;
-
-		while ( i < s.size() && !isspace(s[i]) )
-			++i;
+		int const r = chdir(d.c_str());
 
-		if ( i > j )
+		if ( r == 0 )
+			done = true;
+		else
 		{
-			std::string const t(
-				s.begin()+j,
-				s.begin()+i
-			);
-			V.push_back(t);
+			int const error = errno;
+
+			switch ( error )
+			{
+				case EINTR:
+				case EAGAIN:
+					break;
+				default:
+				{
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] chdir(" << d << "): " << strerror(error) << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
 		}
 	}
-
-	return V;
 }
+#endif
 
-static uint64_t getDefaultMaxTry()
+static std::string abspath(std::string const & s)
 {
-	return 2;
+	if ( ! s.size() || s[0] == '/' )
+		return s;
+
+	// current directory
+	std::string const cdir = ::libmaus2::util::ArgInfo::getCurDir();
+
+	return cdir + "/" + s;
 }
 
-static uint64_t checkMaxTry(std::string const & s)
+/*
+ * fuse chains of rules in which each rule is the only one depending on its
+ * predecessor and depends on nothing else, provided their threads, mem,
+ * maxtry, priority and log flags agree. The commands of a chain are stored
+ * in a single container (see CDLv2::command_flag_sequence). hpcschedcontrol
+ * sends such a chain to one worker, which runs the commands one after the
+ * other, each keeping its own attempts and logs.
+ * The reverse dependencies in VCC need to be set on input, they are
+ * recomputed for the fused containers.
+ */
+static void fuseChains(
+	std::vector < libmaus2::util::CommandContainer > & VCC,
+	std::vector < int64_t > & Vpriority,
+	std::vector < uint64_t > & Vlogpolicy,
+	std::vector < uint64_t > & Vhash,
+	std::vector < bool > & Vsequence
+)
 {
-	std::regex R("\\{\\{maxtry(\\d+)\\}\\}");
+	uint64_t const n = VCC.size();
+	// next container in chain (n for none)
+	std::vector < uint64_t > Vnext(n,n);
+	std::vector < bool > Vhead(n,true);
 
-	std::smatch sm;
-	if ( ::std::regex_search(s, sm, R) )
+	for ( uint64_t i = 0; i < n; ++i )
 	{
-		std::istringstream istr(sm[1]);
-		uint64_t i;
-		istr >> i;
+		libmaus2::util::CommandContainer const & CN = VCC[i];
 
-		if ( istr && istr.peek() == std::istream::traits_type::eof() )
+		if ( CN.rdepid.size() == 1 )
 		{
-			return i;
-		}
-		else
-		{
-			libmaus2::exception::LibMausException lme;
-			lme.getStream() << "[E] cannot parse maxtry parameter in " << s << std::endl;
-			lme.finish();
-			throw lme;
+			uint64_t const k = CN.rdepid[0];
+			libmaus2::util::CommandContainer const & CK = VCC[k];
+
+			if (
+				CK.depid.size() == 1
+				&&
+				CK.threads == CN.threads
+				&&
+				CK.mem == CN.mem
+				&&
+				CK.maxattempt == CN.maxattempt
+				&&
+				Vpriority[k] == Vpriority[i]
+				&&
+				Vlogpolicy[k] == Vlogpolicy[i]
+			)
+			{
+				Vnext[i] = k;
+				Vhead[k] = false;
+			}
 		}
 	}
-	else
-	{
-		return getDefaultMaxTry();
-	}
-}
 
-static uint64_t getDefaultNumThreads()
-{
-	return 1;
-}
-
-static uint64_t checkNumThreads(std::string const & s)
-{
-	std::regex R("\\{\\{threads(\\d+)\\}\\}");
+	// id of the fused container of each container
+	std::vector < uint64_t > Vfusedid(n,n);
+	std::vector < libmaus2::util::CommandContainer > VF;
+	std::vector < int64_t > Fpriority;
+	std::vector < uint64_t > Flogpolicy;
+	std::vector < uint64_t > Fhash;
+	std::vector < bool > Fsequence;
 
-	std::smatch sm;
-	if ( ::std::regex_search(s, sm, R) )
-	{
-		std::istringstream istr(sm[1]);
-		uint64_t i;
-		istr >> i;
-
-		if ( istr && istr.peek() == std::istream::traits_type::eof() )
-		{
-			return i;
-		}
-		else
+	for ( uint64_t pass = 0; pass < 2; ++pass )
+		for ( uint64_t i = 0; i < n; ++i )
 		{
-			libmaus2::exception::LibMausException lme;
-			lme.getStream() << "[E] cannot parse threads parameter in " << s << std::endl;
-			lme.finish();
-			throw lme;
+			// chains are built from their first container, containers left after the first pass lie on a cycle of dependencies and are kept as they are
+			if ( pass == 0 ? !Vhead[i] : (Vfusedid[i] != n) )
+				continue;
+			if ( pass == 1 )
+				Vnext[i] = n;
+
+			uint64_t const fusedid = VF.size();
+			libmaus2::util::CommandContainer CN;
+			CN.id = fusedid;
+			CN.threads = VCC[i].threads;
+			CN.mem = VCC[i].mem;
+			CN.depid = VCC[i].depid;
+			CN.attempt = VCC[i].attempt;
+			CN.maxattempt = VCC[i].maxattempt;
+
+			for ( uint64_t j = i; j < n; j = Vnext[j] )
+			{
+				Vfusedid[j] = fusedid;
+				CN.V.insert(CN.V.end(),VCC[j].V.begin(),VCC[j].V.end());
+				Fhash.push_back(Vhash[j]);
+			}
+
+			VF.push_back(CN);
+			Fpriority.push_back(Vpriority[i]);
+			Flogpolicy.push_back(Vlogpolicy[i]);
+			Fsequence.push_back(CN.V.size() > 1);
 		}
-	}
-	else
+
+	for ( uint64_t i = 0; i < VF.size(); ++i )
 	{
-		return getDefaultNumThreads();
-	}
-}
+		std::vector < uint64_t > & depid = VF[i].depid;
 
-static uint64_t getDefaultMem()
-{
-	return 1*1024;
-}
+		for ( uint64_t j = 0; j < depid.size(); ++j )
+			depid[j] = Vfusedid[depid[j]];
 
-static uint64_t checkMem(std::string const & s)
-{
-	std::regex R("\\{\\{mem(\\d+)\\}\\}");
+		std::sort(depid.begin(),depid.end());
+		depid.resize(std::unique(depid.begin(),depid.end()) - depid.begin());
+	}
 
-	std::smatch sm;
-	if ( ::std::regex_search(s, sm, R) )
-	{
-		std::istringstream istr(sm[1]);
-		uint64_t i;
-		istr >> i;
+	for ( uint64_t i = 0; i < VF.size(); ++i )
+		for ( uint64_t j = 0; j < VF[i].depid.size(); ++j )
+			VF[VF[i].depid[j]].rdepid.push_back(i);
 
-		if ( istr && istr.peek() == std::istream::traits_type::eof() )
-		{
-			return i;
-		}
-		else
-		{
-			libmaus2::exception::LibMausException lme;
-			lme.getStream() << "[E] cannot parse mem parameter in " << s << std::endl;
-			lme.finish();
-			throw lme;
-		}
-	}
-	else
-	{
-		return getDefaultMem();
-	}
-}
+	std::cerr << "[V] hpcschedmake: fused " << n << " rules into " << VF.size() << " containers" << std::endl;
 
-static std::string getDefaultD(libmaus2::util::ArgParser const & arg)
-{
-	return libmaus2::util::ArgInfo::getDefaultTmpFileName(arg.progname);
+	VCC.swap(VF);
+	Vpriority.swap(Fpriority);
+	Vlogpolicy.swap(Flogpolicy);
+	Vhash.swap(Fhash);
+	Vsequence.swap(Fsequence);
 }
 
-std::vector<Rule> parseFile(std::string const fn)
+/*
+ * carry the state of the rules in control file oldfn (including updates
+ * left in its log) over to the commands in VCC. Commands are matched by
+ * the content hashes of their rules in Vhash. A matched command keeps its
+ * state if all the containers its container depends on (and for fused
+ * rules the previous command) kept their state and are complete, otherwise
+ * its state is reset, so changed rules and all rules depending on them are
+ * run again.
+ */
+static void updateState(
+	std::string const & oldfn,
+	std::vector < libmaus2::util::CommandContainer > & VCC,
+	std::vector < uint64_t > const & Vhash,
+	std::vector < bool > const & Vsequence
+)
 {
-	libmaus2::aio::InputStreamInstance ISI(fn);
-
-	std::ostringstream ostr;
-	while ( ISI )
+	if ( ! CDLv2::isCDLv2(oldfn) )
 	{
-		std::string line;
-		std::getline(ISI,line);
-		ostr << line << '\n';
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] hpcschedmake: " << oldfn << " is not a version 2 control file" << std::endl;
+		lme.finish();
+		throw lme;
 	}
 
-	std::string const s = ostr.str();
-
-	std::vector<std::string> V;
+	CDLv2 const oldcdl(oldfn);
 
-	uint64_t l = 0;
-	ostr.str(std::string());
-
-	while ( l < s.size() )
+	if ( ! oldcdl.hasHashes() )
 	{
-		Token tok = getNextToken(s,l);
-
-		if ( tok.token == Token::TOKEN_NEWLINE )
-		{
-			std::string const line = ostr.str();
-			ostr.str(std::string());
-			if ( line.size() )
-				V.push_back(line);
-		}
-		else if ( tok.token == Token::TOKEN_ESCAPE )
-		{
-			ostr << '\\' << tok.sym;
-		}
-		else if ( tok.token == Token::TOKEN_SYMBOL )
-		{
-			ostr << tok.sym;
-		}
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] hpcschedmake: " << oldfn << " contains no rule hashes (it was written by an older version of hpcschedmake)" << std::endl;
+		lme.finish();
+		throw lme;
 	}
 
-	if ( ostr.str().size() )
-		V.push_back(ostr.str());
-
-	Rule R;
-	bool rulevalid = false;
-	std::vector < Rule > VR;
+	uint64_t const oldnumcontainers = oldcdl.numContainers();
 
-	bool ignorefail = false;
-	bool deepsleep = false;
-	int64_t maxattempt = getDefaultMaxTry();
-	int64_t numthreads = getDefaultNumThreads();
-	int64_t mem = getDefaultMem();
-
-	for ( uint64_t i = 0; i < V.size(); ++i )
+	// state of the old commands, including the updates in the log of hpcschedcontrol
+	std::vector < CDLv2::CommandState > Vcommandstate(oldcdl.commandstate,oldcdl.commandstate + oldcdl.numCommands());
 	{
-		std::string const s = V[i];
+		std::string const walfn = oldfn + ".wal";
+		std::vector < CommandStateUpdate > const V = WriteAheadLog::replay(walfn);
 
-		if ( s.size() )
+		for ( uint64_t i = 0; i < V.size(); ++i )
 		{
-			// rule command line
-			if ( s[0] == '\t' )
-			{
-				if ( rulevalid )
-				{
-					R.commands.push_back(s.substr(1));
-				}
-				else
-				{
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[E] command line " << s << " outside any rule" << std::endl;
-					lme.finish();
-					throw lme;
-				}
-			}
-			// comment
-			else if ( s[0] == '#' )
-			{
-				std::string const flagprefix = "#{{hpcschedflags}}";
+			CommandStateUpdate const & U = V[i];
 
-				if ( s.size() >= flagprefix.size() && s.substr(0,flagprefix.size()) == flagprefix )
-				{
-					std::string const f = s.substr(flagprefix.size());
-
-					ignorefail = false;
-					deepsleep = false;
-					maxattempt = checkMaxTry(f);
-					numthreads = checkNumThreads(f);
-					mem = checkMem(f);
-
-					if ( f.find("{{ignorefail}}") != std::string::npos )
-					{
-						ignorefail = true;
-					}
-					if ( f.find("{{deepsleep}}") != std::string::npos )
-					{
-						deepsleep = true;
-					}
-				}
-			}
-			else
+			if ( U.containerid >= oldnumcontainers || U.subid >= oldcdl.getContainerInfo(U.containerid).numcommands )
 			{
-				if ( rulevalid )
-				{
-					VR.push_back(R);
-					R.clear();
-				}
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] hpcschedmake: log " << walfn << " contains update for unknown command " << U.containerid << "," << U.subid << std::endl;
+				lme.finish();
+				throw lme;
+			}
 
-				if ( s.find(':') != std::string::npos )
-				{
-					int64_t const p = s.find(':');
+			CDLv2::CommandState & CS = Vcommandstate[oldcdl.getCommandIndex(U.containerid,U.subid)];
+			CS.numattempts = U.numattempts;
+			CS.completed = U.completed;
+		}
+	}
 
-					std::string const prefix = s.substr(0,p);
-					std::string const suffix = s.substr(p+1);
+	// old commands sorted by hash
+	uint64_t const oldnumcommands = oldcdl.numCommands();
+	std::vector < std::pair<uint64_t,uint64_t> > Vold;
+	Vold.reserve(oldnumcommands);
+	// old container of each old command
+	std::vector < uint64_t > Voldcontainer(oldnumcommands);
+	for ( uint64_t i = 0; i < oldnumcontainers; ++i )
+		for ( uint64_t j = 0; j < oldcdl.getContainerInfo(i).numcommands; ++j )
+		{
+			Vold.push_back(std::pair<uint64_t,uint64_t>(oldcdl.getHash(i,j),oldcdl.getCommandIndex(i,j)));
+			Voldcontainer[oldcdl.getCommandIndex(i,j)] = i;
+		}
+	std::sort(Vold.begin(),Vold.end());
+	std::vector < bool > Vused(oldnumcommands,false);
 
-					R.produced = splitSpace(prefix);
-					R.dependencies = splitSpace(suffix);
+	// matching old command for each new one (oldnumcommands if none)
+	std::vector < uint64_t > Vmatch(Vhash.size(),oldnumcommands);
+	uint64_t nummatched = 0;
 
-					R.ignorefail = ignorefail;
-					R.deepsleep = deepsleep;
-					R.maxattempt = maxattempt;
-					R.numthreads = numthreads;
-					R.mem = mem;
+	for ( uint64_t i = 0; i < Vhash.size(); ++i )
+	{
+		std::vector < std::pair<uint64_t,uint64_t> >::const_iterator it =
+			std::lower_bound(Vold.begin(),Vold.end(),std::pair<uint64_t,uint64_t>(Vhash[i],0));
 
-					rulevalid = true;
-				}
-				else
-				{
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[E] cannot parse line " << s << std::endl;
-					lme.finish();
-					throw lme;
-				}
+		for ( ; it != Vold.end() && it->first == Vhash[i]; ++it )
+			if ( ! Vused[it->second] )
+			{
+				Vused[it->second] = true;
+				Vmatch[i] = it->second;
+				nummatched += 1;
+				break;
 			}
-		}
 	}
 
-	if ( rulevalid )
+	// visit the containers in topological order
+	std::vector < uint64_t > Vmissing(VCC.size());
+	std::deque < uint64_t > Q;
+	for ( uint64_t i = 0; i < VCC.size(); ++i )
+		if ( ! (Vmissing[i] = VCC[i].depid.size()) )
+			Q.push_back(i);
+
+	// containers all commands of which kept their state and are complete
+	std::vector < bool > Vcomplete(VCC.size(),false);
+	uint64_t numkept = 0;
+	uint64_t numcomplete = 0;
+	uint64_t firstcommand = 0;
+	std::vector < uint64_t > Vfirstcommand(VCC.size());
+	for ( uint64_t i = 0; i < VCC.size(); firstcommand += VCC[i++].V.size() )
+		Vfirstcommand[i] = firstcommand;
+
+	while ( Q.size() )
 	{
-		VR.push_back(R);
-		R.clear();
-	}
+		uint64_t const i = Q.front();
+		Q.pop_front();
+		libmaus2::util::CommandContainer & CN = VCC[i];
 
-	return VR;
-}
+		bool depscomplete = true;
+		for ( uint64_t j = 0; depscomplete && j < CN.depid.size(); ++j )
+			depscomplete = Vcomplete[CN.depid[j]];
 
-#if 0
-static void schdir(std::string const & d)
-{
-	bool done = false;
+		bool complete = depscomplete;
+		bool prevcomplete = true;
+		uint64_t numkeptcn = 0;
 
-	while ( !done )
-	{
-		int const r = chdir(d.c_str());
-
-		if ( r == 0 )
-			done = true;
-		else
+		for ( uint64_t j = 0; j < CN.V.size(); ++j )
 		{
-			int const error = errno;
+			uint64_t const o = Vmatch[Vfirstcommand[i] + j];
+			// commands of fused rules also depend on the previous command
+			bool const keep = depscomplete && o < oldnumcommands && (!(i < Vsequence.size() && Vsequence[i]) || prevcomplete);
 
-			switch ( error )
+			if ( keep )
 			{
-				case EINTR:
-				case EAGAIN:
-					break;
-				default:
-				{
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[E] chdir(" << d << "): " << strerror(error) << std::endl;
-					lme.finish();
-					throw lme;
-				}
+				// the attempt counter comes from the container of the first kept command
+				if ( ! numkeptcn++ )
+					CN.attempt = oldcdl.containerstate[Voldcontainer[o]].attempt;
+				CN.V[j].numattempts = Vcommandstate[o].numattempts;
+				CN.V[j].completed = Vcommandstate[o].completed;
+				numkept += 1;
+				numcomplete += CN.V[j].completed ? 1 : 0;
 			}
+
+			prevcomplete = keep && CN.V[j].completed;
+			complete = complete && prevcomplete;
 		}
-	}
-}
-#endif
 
-static std::string abspath(std::string const & s)
-{
-	if ( ! s.size() || s[0] == '/' )
-		return s;
+		Vcomplete[i] = complete;
 
-	// current directory
-	std::string const cdir = ::libmaus2::util::ArgInfo::getCurDir();
+		for ( uint64_t j = 0; j < CN.rdepid.size(); ++j )
+			if ( ! --Vmissing[CN.rdepid[j]] )
+				Q.push_back(CN.rdepid[j]);
+	}
 
-	return cdir + "/" + s;
+	std::cerr << "[V] hpcschedmake: " << nummatched << " of " << Vhash.size() << " rules found in " << oldfn
+		<< ", kept state of " << numkept << " (" << numcomplete << " complete), "
+		<< (nummatched - numkept) << " invalidated by changed dependencies" << std::endl;
 }
 
 int hpcschedmake(libmaus2::util::ArgParser const & arg)
@@ -432,92 +357,78 @@ int hpcschedmake(libmaus2::util::ArgParser const & arg)
 	std::string const fn = arg[0];
 
 	// number of threads
-	uint64_t const numthreads = arg.uniqueArgPresent("t") ? arg.getUnsignedNumericArg<uint64_t>("t") : getDefaultNumThreads();
+	uint64_t const numthreads = arg.uniqueArgPresent("t") ? arg.getUnsignedNumericArg<uint64_t>("t") : RuleFlags::getDefaultNumThreads();
 
-	std::vector<Rule> const VL = parseFile(fn);
+	// keeps the input referred to by the rules
+	MakefileParser parser(fn);
+	RuleSet const RS = parser.parse(numthreads);
+	std::vector<Rule> const & VL = RS.rules;
 
 	std::string const dn = arg.uniqueArgPresent("d") ? arg["d"] : getDefaultD(arg);
+	// store single simple commands for running without bash
+	bool const directexec = arg.uniqueArgPresent("directexec") ? arg.getParsedArg<uint64_t>("directexec") : true;
+	// fuse linear chains of rules into single containers
+	bool const fuse = arg.uniqueArgPresent("fuse") ? arg.getParsedArg<uint64_t>("fuse") : false;
 	libmaus2::util::TempFileNameGenerator tgen(abspath(dn),4,16 /* dirmod */, 16 /* filemod */);
 
-	struct ProducedInfo
-	{
-		uint64_t id;
-		std::vector < uint64_t > producers;
-
-		ProducedInfo() {}
-		ProducedInfo(uint64_t const rid) : id(rid) {}
-	};
+	// rules producing each target (sorted), the ones of target t are producers[producersoff[t]..producersoff[t+1])
+	uint64_t const numtargets = RS.targets.size();
+	std::vector < uint64_t > producersoff(numtargets+1,0);
+	for ( uint64_t i = 0; i < RS.produced.size(); ++i )
+		producersoff[RS.produced[i]+1] += 1;
+	for ( uint64_t i = 0; i < numtargets; ++i )
+		producersoff[i+1] += producersoff[i];
 
-	std::map<std::string,ProducedInfo> targetmap;
-	for ( uint64_t i = 0; i < VL.size(); ++i )
+	std::vector < uint64_t > producers(RS.produced.size());
 	{
-		Rule const & R = VL[i];
-
-		for ( uint64_t j = 0; j < R.produced.size(); ++j )
-		{
-			std::map<std::string,ProducedInfo>::iterator it = targetmap.find(R.produced[j]);
-
-			if ( it == targetmap.end() )
-			{
-				uint64_t const nextid = targetmap.size();
-				targetmap[R.produced[j]] = ProducedInfo(nextid);
-				it = targetmap.find(R.produced[j]);
-			}
-
-			assert ( it != targetmap.end() );
-
-			it->second.producers.push_back(i);
-		}
-	}
-
-	for ( uint64_t i = 0; i < VL.size(); ++i )
-	{
-		Rule const & R = VL[i];
-
-		for ( uint64_t j = 0; j < R.dependencies.size(); ++j )
-		{
-			std::map<std::string,ProducedInfo>::iterator it = targetmap.find(R.dependencies[j]);
-
-			if ( it == targetmap.end() )
-			{
-				libmaus2::exception::LibMausException lme;
-				lme.getStream() << "[E] dependency " << R.dependencies[j] << " is not produced by any rule" << std::endl;
-				lme.finish();
-				throw lme;
-			}
-		}
+		std::vector < uint64_t > next(producersoff.begin(),producersoff.end()-1);
+		for ( uint64_t i = 0; i < VL.size(); ++i )
+			for ( uint64_t j = VL[i].producedlow; j < VL[i].producedhigh; ++j )
+				producers[next[RS.produced[j]]++] = i;
 	}
 
 	std::vector < libmaus2::util::CommandContainer > VCC(VL.size());
+	std::vector < int64_t > Vpriority(VL.size());
+	std::vector < uint64_t > Vlogpolicy(VL.size());
+	std::vector < uint64_t > Vhash(VL.size());
 	std::string const shell = "/bin/bash";
 
 	std::string const modmagic = "hpcsched::";
 
+	#if defined(_OPENMP)
+	#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1024)
+	#endif
 	for ( uint64_t id = 0; id < VL.size(); ++id )
 	{
-		Rule const R = VL[id];
+		Rule const & R = VL[id];
+		StringRef const * commands = RS.commands.data() + R.commandslow;
+		uint64_t const numcommands = R.getNumCommands();
 
 		std::string const in = "/dev/null";
 		std::string const out = "/dev/null";
 		std::string const err = "/dev/null";
 
-		bool const modcall =
-			(R.commands.size() == 1) &&
-			(R.commands[0].size() >= modmagic.size()) &&
-			(R.commands[0].substr(0,modmagic.size()) == modmagic);
+		bool const modcall = (numcommands == 1) && commands[0].startsWith(modmagic);
+
+		std::vector < std::string > const execargs =
+			(directexec && !modcall && numcommands == 1) ? ExecCommand::tokenise(commands[0].str()) : std::vector < std::string >();
 
 		std::ostringstream scriptscr;
 		if ( modcall )
 		{
-			scriptscr << R.commands[0].substr(modmagic.size());
+			scriptscr << StringRef(commands[0].a + modmagic.size(),commands[0].e);
+		}
+		else if ( execargs.size() )
+		{
+			scriptscr << ExecCommand::encode(execargs);
 		}
 		else
 		{
 			// produce shell script
 			scriptscr << "#! " << shell << "\n";
 			scriptscr << "set -Eeuxo pipefail\n";
-			for ( uint64_t i = 0; i < R.commands.size(); ++i )
-				scriptscr << R.commands[i] << '\n';
+			for ( uint64_t i = 0; i < numcommands; ++i )
+				scriptscr << commands[i] << '\n';
 			scriptscr.flush();
 		}
 
@@ -534,26 +445,22 @@ int hpcschedmake(libmaus2::util::ArgParser const & arg)
 		CN.threads = R.numthreads;
 		CN.mem = R.mem;
 
-		std::vector<uint64_t> depid;
-		for ( uint64_t j = 0; j < R.dependencies.size(); ++j )
+		for ( uint64_t j = R.dependencieslow; j < R.dependencieshigh; ++j )
 		{
-			std::map<std::string,ProducedInfo>::iterator it = targetmap.find(R.dependencies[j]);
-			assert ( it != targetmap.end() );
-
-			ProducedInfo const & PI = it->second;
-
-			for ( uint64_t k = 0; k < PI.producers.size(); ++k )
-				depid.push_back(PI.producers[k]);
+			uint32_t const t = RS.dependencies[j];
+			CN.depid.insert(CN.depid.end(),producers.begin() + producersoff[t],producers.begin() + producersoff[t+1]);
 		}
-		std::sort(depid.begin(),depid.end());
-		depid.resize(std::unique(depid.begin(),depid.end()) - depid.begin());
+		std::sort(CN.depid.begin(),CN.depid.end());
+		CN.depid.resize(std::unique(CN.depid.begin(),CN.depid.end()) - CN.depid.begin());
 
-		CN.depid = depid;
 		CN.attempt = 0;
 		CN.maxattempt = R.maxattempt;
 		CN.V.push_back(C);
 
 		VCC[id] = CN;
+		Vpriority[id] = R.priority;
+		Vlogpolicy[id] = R.logpolicy.encode();
+		Vhash[id] = RS.getHash(id);
 	}
 
 	// compute reverse dependencies
@@ -569,36 +476,21 @@ int hpcschedmake(libmaus2::util::ArgParser const & arg)
 
 	}
 
-	libmaus2::util::ContainerDescriptionList CDL;
-	CDL.V.resize(VCC.size());
-
-	#if defined(_OPENMP)
-	#pragma omp parallel for num_threads(numthreads) schedule(dynamic,1)
-	#endif
-	for ( uint64_t id = 0; id < VCC.size(); ++id )
-	{
-		#if 0
-		std::ostringstream ostr;
-		ostr << tgen.getFileName() << ".cc";
-		std::string const fn = ostr.str();
-		#endif
-
-		std::ostringstream OSI;
-		// libmaus2::aio::OutputStreamInstance OSI(fn);
-		VCC[id].serialise(OSI);
+	// containers running their commands one after the other
+	std::vector < bool > Vsequence;
 
-		libmaus2::util::ContainerDescription const CD(OSI.str(), false, VCC[id].rdepid.size());
+	if ( fuse )
+		fuseChains(VCC,Vpriority,Vlogpolicy,Vhash,Vsequence);
 
-		CDL.V[id] = CD;
-	}
+	if ( arg.uniqueArgPresent("update") )
+		updateState(arg["update"],VCC,Vhash,Vsequence);
 
 	{
 		std::ostringstream ostr;
 		ostr << tgen.getFileName() << ".cdl";
 		std::string const fn = ostr.str();
 
-		libmaus2::aio::OutputStreamInstance OSI(fn);
-		CDL.serialise(OSI);
+		CDLv2::write(fn,VCC,Vpriority,Vlogpolicy,Vhash,Vsequence,numthreads);
 
 		std::cout << fn << std::endl;
 	}
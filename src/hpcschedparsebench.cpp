@@ -0,0 +1,131 @@
+/*
+    hpcsched
+    Copyright (C) 2018 German Tischler-Höhle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <libmaus2/util/ArgParser.hpp>
+#include <libmaus2/util/ArgInfo.hpp>
+#include <libmaus2/util/TempFileRemovalContainer.hpp>
+#include <libmaus2/aio/OutputStreamInstance.hpp>
+#include <libmaus2/timing/RealTimeClock.hpp>
+#include <MakefileParser.hpp>
+#include <iomanip>
+#include <sys/resource.h>
+
+/*
+ * throughput benchmark for the Makefile parser of hpcschedmake. Parses the
+ * given Makefile or, if none is given, a generated one shaped like the
+ * output of hpcscheddaligner.
+ */
+
+static void generate(std::string const & fn, uint64_t const numrules)
+{
+	libmaus2::aio::OutputStreamInstance OSI(fn);
+
+	for ( uint64_t i = 0; i < numrules; ++i )
+	{
+		if ( i % 64 == 0 )
+			OSI << "#{{hpcschedflags}} {{threads4}} {{mem16000}} {{maxtry3}} {{priority" << (i/64) << "}}\n";
+
+		OSI << "db.1." << i << ".las:";
+		// rules depend on earlier ones like the merge tree of hpcscheddaligner
+		if ( i )
+			OSI << " db.1." << (i-1)/2 << ".las";
+		if ( i > 1 )
+			OSI << " db.1." << i-2 << ".las";
+		OSI << "\n";
+
+		OSI << "\tdaligner -v -T4 -k14 -w6 -h35 -e0.7 -l1000 -s100 -M16 db.1 db." << i << "\n";
+		if ( i % 8 == 0 )
+			OSI << "\tLAcheck -v db db.1." << i << ".las \\\n\t\t&& LAsort -v db.1." << i << ".las\n";
+	}
+
+	OSI.flush();
+}
+
+int hpcschedparsebench(libmaus2::util::ArgParser const & arg)
+{
+	uint64_t const numrules = arg.uniqueArgPresent("n") ? arg.getUnsignedNumericArg<uint64_t>("n") : 1000000;
+	uint64_t const numruns = arg.uniqueArgPresent("r") ? arg.getUnsignedNumericArg<uint64_t>("r") : 3;
+	uint64_t const numthreads = arg.uniqueArgPresent("t") ? arg.getUnsignedNumericArg<uint64_t>("t") : 1;
+
+	std::string fn;
+	if ( arg.size() )
+		fn = arg[0];
+	else
+	{
+		fn = libmaus2::util::ArgInfo::getDefaultTmpFileName(arg.progname) + ".mk";
+		libmaus2::util::TempFileRemovalContainer::addTempFile(fn);
+		std::cerr << "[V] generating " << fn << " with " << numrules << " rules" << std::endl;
+		generate(fn,numrules);
+	}
+
+	double mintime = std::numeric_limits<double>::max();
+	double sumtime = 0;
+	uint64_t bytes = 0;
+	uint64_t rules = 0;
+
+	for ( uint64_t i = 0; i < numruns; ++i )
+	{
+		libmaus2::timing::RealTimeClock rtc;
+		rtc.start();
+
+		MakefileParser parser(fn);
+		RuleSet const RS = parser.parse(numthreads);
+
+		double const t = rtc.getElapsedSeconds();
+
+		bytes = parser.file.size;
+		rules = RS.size();
+		mintime = std::min(mintime,t);
+		sumtime += t;
+
+		std::cerr << "[V] run " << i << " parsed " << rules << " rules in " << t << "s" << std::endl;
+	}
+
+	if ( numruns )
+	{
+		std::cout << "file\t" << fn << "\n";
+		std::cout << "bytes\t" << bytes << "\n";
+		std::cout << "rules\t" << rules << "\n";
+		std::cout << "runs\t" << numruns << "\n";
+		std::cout << "threads\t" << numthreads << "\n";
+		std::cout << "min_seconds\t" << mintime << "\n";
+		std::cout << "avg_seconds\t" << sumtime / numruns << "\n";
+		std::cout << "MB_per_second\t" << std::fixed << std::setprecision(1) << (bytes / (1024.0*1024.0)) / mintime << "\n";
+		std::cout << "rules_per_second\t" << std::fixed << std::setprecision(0) << rules / mintime << "\n";
+
+		struct rusage ru;
+		if ( getrusage(RUSAGE_SELF,&ru) == 0 )
+			std::cout << "peak_rss_kb\t" << ru.ru_maxrss << "\n";
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char * argv[])
+{
+	try
+	{
+		libmaus2::util::ArgParser const arg(argc,argv);
+
+		return hpcschedparsebench(arg);
+	}
+	catch(std::exception const & ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+}
@@ -32,6 +32,7 @@
 #include <libmaus2/util/ContainerDescriptionList.hpp>
 #include <libmaus2/util/CommandContainer.hpp>
 #include <libmaus2/util/TarWriter.hpp>
+#include <CDLv2.hpp>
 
 int processlogs(libmaus2::util::ArgParser const & arg)
 {
@@ -45,7 +46,17 @@ int processlogs(libmaus2::util::ArgParser const & arg)
 
 		libmaus2::aio::InputStreamInstance ISI(cdlmeta);
 
+		// container files in format version 2 are mapped, scripts are added to the log
+		CDLv2::unique_ptr_type PCDL;
+		if ( libmaus2::util::GetFileSize::fileExists(cdl) && CDLv2::isCDLv2(cdl) )
+		{
+			CDLv2::unique_ptr_type TCDL(new CDLv2(cdl));
+			PCDL = UNIQUE_PTR_MOVE(TCDL);
+		}
+
 		std::map < std::pair<uint64_t,uint64_t>, uint64_t > IDM;
+		// number of runs with output dropped by the log policy
+		uint64_t numtruncated = 0;
 
 		while ( ISI && ISI.peek() != std::istream::traits_type::eof() )
 		{
@@ -69,7 +80,27 @@ int processlogs(libmaus2::util::ArgParser const & arg)
 			TW.addFile(fnpref + ".out", std::string(Aout.begin(),Aout.end()));
 			TW.addFile(fnpref + ".err", std::string(Aerr.begin(),Aerr.end()));
 			TW.addFile(fnpref + ".status", statusstr.str());
+
+			if ( RI.outskipped || RI.errskipped )
+			{
+				std::ostringstream skippedstr;
+				skippedstr << "out " << RI.outskipped << "\n" << "err " << RI.errskipped << "\n";
+				TW.addFile(fnpref + ".skipped", skippedstr.str());
+				numtruncated += 1;
+			}
+
+			if (
+				PCDL
+				&&
+				RI.containerid < PCDL->numContainers()
+				&&
+				RI.subid < PCDL->getContainerInfo(RI.containerid).numcommands
+			)
+				TW.addFile(fnpref + ".script", PCDL->getCommand(RI.containerid,RI.subid).script);
 		}
+
+		if ( numtruncated )
+			std::cerr << "[V] output of " << numtruncated << " runs was truncated or dropped by the log policy (see .skipped files in " << logtar << ")" << std::endl;
 	}
 
 	return EXIT_SUCCESS;
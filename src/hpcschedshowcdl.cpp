@@ -31,30 +31,27 @@
 #include <libmaus2/util/GetFileSize.hpp>
 #include <libmaus2/util/ContainerDescriptionList.hpp>
 #include <libmaus2/util/CommandContainer.hpp>
+#include <CDLv2.hpp>
 
 struct CommandContainerView
 {
 	std::string const cdl;
-	libmaus2::util::ContainerDescriptionList CDL;
-	std::vector < libmaus2::util::ContainerDescription > & CDLV;
+	// mapped file for container file format version 2
+	CDLv2::unique_ptr_type PCDL;
+	// containers loaded from files in format version 1
 	std::vector < libmaus2::util::CommandContainer > VCC;
 
-	static libmaus2::util::ContainerDescriptionList loadCDL(std::string const & cdl)
+	static std::vector < libmaus2::util::CommandContainer > loadVCC(std::string const & cdl)
 	{
 		libmaus2::util::ContainerDescriptionList CDL;
 		libmaus2::aio::InputStreamInstance ISI(cdl);
 		CDL.deserialise(ISI);
-		return CDL;
-	}
 
-	static std::vector < libmaus2::util::CommandContainer > loadVCC(std::vector < libmaus2::util::ContainerDescription > & CDLV)
-	{
-		std::vector < libmaus2::util::CommandContainer > VCC(CDLV.size());
-		for ( uint64_t i = 0; i < CDLV.size(); ++i )
+		std::vector < libmaus2::util::CommandContainer > VCC(CDL.V.size());
+		for ( uint64_t i = 0; i < CDL.V.size(); ++i )
 		{
-			std::istringstream ISI(CDLV[i].fn);
+			std::istringstream ISI(CDL.V[i].fn);
 			VCC[i].deserialise(ISI);
-			CDLV[i].missingdep = 0;
 		}
 
 		return VCC;
@@ -63,42 +60,48 @@ struct CommandContainerView
 	CommandContainerView(std::string const & rcdl)
 	:
 	  cdl(rcdl),
-	  CDL(loadCDL(cdl)),
-	  CDLV(CDL.V),
-	  VCC(loadVCC(CDLV))
+	  PCDL(),
+	  VCC()
 	{
+		if ( CDLv2::isCDLv2(cdl) )
+		{
+			CDLv2::unique_ptr_type TCDL(new CDLv2(cdl));
+			PCDL = UNIQUE_PTR_MOVE(TCDL);
+		}
+		else
+		{
+			VCC = loadVCC(cdl);
+		}
 	}
 
-	bool isComplete() const
+	uint64_t size() const
 	{
-		bool iscomplete = true;
-
-		for ( uint64_t i = 0; i < VCC.size(); ++i )
-			iscomplete = iscomplete && VCC[i].isComplete();
-
-		return iscomplete;
+		return PCDL ? PCDL->numContainers() : VCC.size();
 	}
 
-	bool isFinished() const
+	libmaus2::util::CommandContainer getContainer(uint64_t const i) const
 	{
-		bool isfinished = true;
-
-		for ( uint64_t i = 0; i < VCC.size(); ++i )
-			isfinished = isfinished && VCC[i].isFinished();
-
-		return isfinished;
+		return PCDL ? PCDL->getContainer(i) : VCC[i];
 	}
 };
 
 std::ostream & operator<<(std::ostream & out, CommandContainerView const & C)
 {
-	for ( uint64_t i = 0; i < C.VCC.size(); ++i )
+	bool iscomplete = true;
+	bool isfinished = true;
+
+	for ( uint64_t i = 0; i < C.size(); ++i )
 	{
-		out << "CommandContainer[" << i << "]=" << C.VCC[i];
-		out << "CommandContainerInfo[" << i << "]= isComplete=" << C.VCC[i].isComplete() << " isFinished=" << C.VCC[i].isFinished() << std::endl;
+		libmaus2::util::CommandContainer const CC = C.getContainer(i);
+
+		out << "CommandContainer[" << i << "]=" << CC;
+		out << "CommandContainerInfo[" << i << "]= isComplete=" << CC.isComplete() << " isFinished=" << CC.isFinished() << std::endl;
+
+		iscomplete = iscomplete && CC.isComplete();
+		isfinished = isfinished && CC.isFinished();
 	}
 
-	out << "CommandContainer[*] isComplete=" << C.isComplete() << " isFinished=" << C.isFinished() << std::endl;
+	out << "CommandContainer[*] isComplete=" << iscomplete << " isFinished=" << isfinished << std::endl;
 
 	return out;
 }
@@ -21,6 +21,11 @@
 #include <runProgram.hpp>
 #include <which.hpp>
 #include <RunInfo.hpp>
+#include <BatchBackend.hpp>
+#include <LogPolicy.hpp>
+#include <ExecCommand.hpp>
+#include <ModuleRunner.hpp>
+#include <ModuleMessage.hpp>
 
 #include <libmaus2/util/ArgParser.hpp>
 #include <libmaus2/util/ArgInfo.hpp>
@@ -35,12 +40,19 @@
 #include <libmaus2/parallel/PosixThread.hpp>
 #include <libmaus2/util/DynamicLoading.hpp>
 #include <libmaus2/util/PathTools.hpp>
+#include <libmaus2/parallel/NumCpus.hpp>
 #include <FDIO.hpp>
+#include <Launcher.hpp>
 #include <sys/wait.h>
 
 #include <sys/types.h>
 #include <pwd.h>
 #include <libgen.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <deque>
 
 static int doClose(int const fd)
 {
@@ -66,305 +78,279 @@ static int doClose(int const fd)
 	}
 }
 
-static int doDup2(int const fd0, int const fd1)
+/*
+ * anonymous in memory file containing script or -1 if this is not
+ * supported by the system. Running bash on such a file avoids creating and
+ * removing a script file in the (shared) working directory for each
+ * command.
+ */
+static int createScriptFD(std::string const & script)
 {
-	while ( true )
+	#if defined(__linux__) && defined(MFD_CLOEXEC)
+	int const fd = ::memfd_create("hpcsched_script",MFD_CLOEXEC);
+
+	if ( fd < 0 )
+		return -1;
+
+	char const * p = script.c_str();
+	uint64_t n = script.size();
+
+	while ( n )
 	{
-		int const r = ::dup2(fd0,fd1);
+		ssize_t const w = ::write(fd,p,n);
 
-		if ( r == -1 )
+		if ( w > 0 )
+		{
+			p += w;
+			n -= w;
+		}
+		else if ( w < 0 && errno == EINTR )
 		{
-			int const error = errno;
-
-			switch ( error )
-			{
-				case EINTR:
-				case EAGAIN:
-					break;
-				default:
-					return r;
-			}
 		}
 		else
 		{
-			return r;
+			doClose(fd);
+			return -1;
 		}
 	}
-}
-
-std::pair<std::string,std::string> split(std::string const & s)
-{
-	uint64_t p = 0;
-	while ( p < s.size() && !isspace(s[p]) )
-		++p;
 
-	std::string const first = s.substr(0,p);
-
-	while ( p < s.size() && isspace(s[p]) )
-		++p;
-
-	std::string const second = s.substr(p);
-
-	return std::pair<std::string,std::string>(first,second);
-}
-
-struct Module
-{
-	typedef int(*function_type)(char const *, uint64_t const);
-
-	libmaus2::util::DynamicLibrary::shared_ptr_type library;
-	libmaus2::util::DynamicLibraryFunction<function_type>::shared_ptr_type function;
-};
-
-std::map < std::string, Module > modules;
-
-bool canLoadLibrary(std::string const & name)
-{
-	try
-	{
-		std::cerr << "canLoadLibrary(" << name << ")" << std::endl;
-		libmaus2::util::DynamicLibrary lib(name);
-		return true;
-	}
-	catch(...)
-	{
-		return false;
-	}
+	return fd;
+	#else
+	(void)script;
+	return -1;
+	#endif
 }
 
+/*
+ * start command C with standard output and error connected to outfd and
+ * errfd. Scripts are run from scriptfd (see createScriptFD) if it is not
+ * negative, otherwise they are written to scriptname first. Returns -1 if
+ * a simple command cannot be run, the reason is written to errfd.
+ */
 pid_t startCommand(
-	libmaus2::util::ArgParser const & arg,
-	libmaus2::util::Command C,
+	ModuleLoader & loader,
+	libmaus2::util::Command const & C,
 	std::string const & scriptname,
 	int const outfd = -1,
-	int const errfd = -1
+	int const errfd = -1,
+	int const scriptfd = -1
 )
 {
 	if ( C.modcall )
 	{
-		std::pair<std::string,std::string> const P = split(C.script);
-
-		if ( modules.find(P.first) == modules.end() )
-		{
-			try
-			{
-				Module module;
-				std::string const functionname = "hpcsched_" + P.first;
-				std::string modname;
-
-				if ( canLoadLibrary(functionname + ".so") )
-					modname = functionname + ".so";
-				else
-				{
-					std::string const prog = arg.getAbsProgName();
-					std::string const progdir = libmaus2::util::PathTools::sdirname(prog);
-					std::string const libdir = progdir + "/../lib/hpcsched/" + PACKAGE_VERSION;
-					std::string const modpath = libdir + "/" + functionname + ".so";
-					if ( canLoadLibrary(modpath) )
-					{
-						modname = modpath;
-					}
-					else
-					{
-						libmaus2::exception::LibMausException lme;
-						lme.getStream() << "[E] unable to find module for " << P.first << std::endl;
-						lme.finish();
-						throw lme;
-					}
-				}
-
-				libmaus2::util::DynamicLibrary::shared_ptr_type library(
-					new libmaus2::util::DynamicLibrary(modname)
-				);
-				module.library = library;
-
-				libmaus2::util::DynamicLibraryFunction<Module::function_type>::shared_ptr_type function(
-					new libmaus2::util::DynamicLibraryFunction<Module::function_type>(
-						*(module.library),
-						functionname
-					)
-				);
-				module.function = function;
-
-				modules [ P.first ] = module;
-			}
-			catch(std::exception const & ex)
-			{
-				std::cerr << "[E] trying to load module for " << P.first << " failed:\n" << ex.what() << std::endl;
-			}
-		}
-	}
+		std::pair<std::string,std::string> const P = ModuleLoader::split(C.script);
+		Module const * mod = loader.get(P.first);
 
-	pid_t const pid = fork();
+		// module functions run in the address space of the worker, so they need a forked child
+		pid_t const pid = Launcher::forkRedirected(outfd,errfd);
 
-	if ( pid == 0 )
-	{
-		try
+		if ( pid == 0 )
 		{
-			if ( outfd >= 0 )
-			{
-				C.out = "/dev/stdout";
-				if ( doClose(STDOUT_FILENO) != 0 )
-					_exit(EXIT_FAILURE);
-				if ( doDup2(outfd,STDOUT_FILENO) == -1 )
-					_exit(EXIT_FAILURE);
-				if ( doClose(outfd) != 0 )
-					_exit(EXIT_FAILURE);
-			}
-			if ( errfd >= 0 )
-			{
-				C.err = "/dev/stderr";
-				if ( doClose(STDERR_FILENO) != 0 )
-					_exit(EXIT_FAILURE);
-				if ( doDup2(errfd,STDERR_FILENO) == -1 )
-					_exit(EXIT_FAILURE);
-				if ( doClose(errfd) != 0 )
-					_exit(EXIT_FAILURE);
-			}
-			if ( C.modcall )
+			try
 			{
-				std::pair<std::string,std::string> const P = split(C.script);
-				std::map < std::string, Module >::iterator it = modules.find(P.first);
-
-				if ( it == modules.end() )
+				if ( ! mod )
 				{
 					_exit(EXIT_FAILURE);
 				}
 				else
 				{
-					Module & mod = it->second;
-					libmaus2::util::DynamicLibraryFunction<Module::function_type> & function = *(mod.function);
+					libmaus2::util::DynamicLibraryFunction<Module::function_type> & function = *(mod->function);
 					char const * p = P.second.c_str();
 					uint64_t const n = P.second.size();
 					int const r = function.func(p,n);
 					_exit(r);
 				}
 			}
-			else
+			catch(...)
 			{
-				int const r = C.dispatch(scriptname);
-				_exit(r);
+				_exit(EXIT_FAILURE);
 			}
 		}
-		catch(...)
-		{
-			_exit(EXIT_FAILURE);
-		}
-	}
-	else if ( pid == static_cast<pid_t>(-1) )
-	{
-		int const error = errno;
-		libmaus2::exception::LibMausException lme;
-		lme.getStream() << "[V] fork failed: " << strerror(error) << std::endl;
-		lme.finish();
-		throw lme;
-	}
-	else
-	{
+
 		return pid;
 	}
-}
+	else if ( ExecCommand::isExec(C.script) )
+	{
+		// simple command stored by hpcschedmake, run it without a shell
+		LaunchRequest req(ExecCommand::decode(C.script));
+		req.searchpath = true;
+		req.infn = C.in;
+		req.outfd = outfd;
+		req.outfn = C.out;
+		req.errfd = errfd;
+		req.errfn = C.err;
 
-pid_t startSleep(int const len)
-{
-	pid_t const pid = fork();
+		try
+		{
+			return Launcher::spawn(req);
+		}
+		catch(std::exception const & ex)
+		{
+			// report the failure on the error stream of the command, the caller sets exit status 127 like bash
+			if ( errfd >= 0 )
+				ModuleMessage::write(errfd,(std::string(ex.what()) + "\n").c_str());
 
-	if ( pid == 0 )
-	{
-		sleep(len);
-		_exit(0);
-	}
-	else if ( pid == static_cast<pid_t>(-1) )
-	{
-		int const error = errno;
-		libmaus2::exception::LibMausException lme;
-		lme.getStream() << "[V] fork failed: " << strerror(error) << std::endl;
-		lme.finish();
-		throw lme;
+			return static_cast<pid_t>(-1);
+		}
 	}
 	else
 	{
-		return pid;
+		std::vector < std::string > args;
+		args.push_back("/bin/bash");
+
+		if ( scriptfd >= 0 )
+		{
+			// the descriptor is close on exec, so bash opens it through the worker's fd directory
+			std::ostringstream fnstr;
+			fnstr << "/proc/" << getpid() << "/fd/" << scriptfd;
+			args.push_back(fnstr.str());
+		}
+		else
+		{
+			// write script and run it using bash
+			{
+				libmaus2::aio::OutputStreamInstance OSI(scriptname);
+				OSI << C.script;
+				OSI.flush();
+			}
+
+			args.push_back(scriptname);
+		}
+
+		LaunchRequest req(args);
+		req.infn = C.in;
+		req.outfd = outfd;
+		req.outfn = C.out;
+		req.errfd = errfd;
+		req.errfn = C.err;
+
+		return Launcher::spawn(req);
 	}
 }
 
-std::pair<pid_t,int> waitWithTimeout(int const timeout)
+/*
+ * notification about terminated child processes. A SIGCHLD handler writes
+ * to a pipe which is polled along with the control socket and the output
+ * pipes, so finished commands are noticed as soon as they exit.
+ */
+struct ChildWatcher
 {
-	pid_t const sleeppid = startSleep(timeout);
+	static int notifyfd[2];
 
-	while ( true )
+	static void handler(int)
 	{
-		int status = 0;
-		pid_t const wpid = waitpid(-1, &status, 0);
+		int const saved = errno;
+		char const c = 0;
+		// a full pipe already signals a pending notification
+		ssize_t const r = ::write(notifyfd[1],&c,1);
+		(void)r;
+		errno = saved;
+	}
 
-		if ( wpid == static_cast<pid_t>(-1) )
+	ChildWatcher()
+	{
+		if ( ::pipe(&notifyfd[0]) != 0 )
 		{
 			int const error = errno;
-
-			switch ( error )
-			{
-				case EAGAIN:
-				case EINTR:
-					break;
-				default:
-				{
-					int const error = errno;
-					libmaus2::exception::LibMausException lme;
-					lme.getStream() << "[V] waitpid failed in waitWithTimeout: " << strerror(error) << std::endl;
-					lme.finish();
-					throw lme;
-				}
-			}
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] ChildWatcher: pipe failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
 		}
-		else if ( wpid == sleeppid )
+
+		for ( uint64_t i = 0; i < 2; ++i )
 		{
-			return std::pair<pid_t,int>(static_cast<pid_t>(0),0);
+			::fcntl(notifyfd[i],F_SETFL,::fcntl(notifyfd[i],F_GETFL) | O_NONBLOCK);
+			::fcntl(notifyfd[i],F_SETFD,FD_CLOEXEC);
 		}
-		else
+
+		struct sigaction sa;
+		memset(&sa,0,sizeof(sa));
+		sa.sa_handler = handler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+
+		if ( sigaction(SIGCHLD,&sa,NULL) != 0 )
 		{
-			kill(sleeppid,SIGTERM);
-			int sleepstatus = 0;
+			int const error = errno;
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] ChildWatcher: sigaction failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
+	}
 
-			while ( true )
-			{
-				pid_t const wpid = waitpid(sleeppid,&sleepstatus,0);
+	~ChildWatcher()
+	{
+		signal(SIGCHLD,SIG_DFL);
+		doClose(notifyfd[0]);
+		doClose(notifyfd[1]);
+	}
 
-				if ( wpid == sleeppid )
-					break;
+	/*
+	 * wait until a child terminates, a descriptor in V becomes readable or
+	 * timeout milliseconds have passed. The revents fields of V are set on
+	 * return.
+	 */
+	void wait(std::vector < struct pollfd > & V, int const timeout)
+	{
+		std::vector < struct pollfd > P(V.size()+1);
+		P[0].fd = notifyfd[0];
+		P[0].events = POLLIN;
+		P[0].revents = 0;
+		for ( uint64_t i = 0; i < V.size(); ++i )
+		{
+			P[i+1] = V[i];
+			P[i+1].revents = 0;
+		}
 
-				int const error = errno;
+		int const r = ::poll(&P[0],P.size(),timeout);
 
-				switch ( error )
-				{
-					case EAGAIN:
-					case EINTR:
-						break;
-					default:
-					{
-						int const error = errno;
-						libmaus2::exception::LibMausException lme;
-						lme.getStream() << "[V] waitpid(sleeppid) failed in waitWithTimeout: " << strerror(error) << std::endl;
-						lme.finish();
-						throw lme;
-					}
-				}
-			}
+		if ( r < 0 && errno != EINTR && errno != EAGAIN )
+		{
+			int const error = errno;
+			libmaus2::exception::LibMausException lme;
+			lme.getStream() << "[E] ChildWatcher: poll failed: " << strerror(error) << std::endl;
+			lme.finish();
+			throw lme;
+		}
 
-			return std::pair<pid_t,int>(wpid,status);
+		char buf[64];
+		while ( ::read(notifyfd[0],&buf[0],sizeof(buf)) > 0 )
+		{
 		}
+
+		for ( uint64_t i = 0; i < V.size(); ++i )
+			V[i].revents = (r > 0) ? P[i+1].revents : 0;
 	}
-}
+};
+
+int ChildWatcher::notifyfd[2] = { -1, -1 };
 
+/*
+ * output file written via its file descriptor. offset is the number of
+ * bytes written so far, which is the file size as the file is truncated
+ * on opening.
+ */
 struct PosixOutput
 {
 	typedef PosixOutput this_type;
 	typedef libmaus2::util::unique_ptr<this_type>::type unique_ptr_type;
 
+	// maximum size of a single transfer and of the copy buffer
+	static uint64_t const blocksize = 1024*1024;
+	// maximum number of bytes moved per transfer call, so a single command cannot starve the others
+	static uint64_t const maxtransfer = 4*blocksize;
+
 	std::string fn;
 	int fd;
+	uint64_t offset;
+	// cleared if the file system does not support splice
+	bool usesplice;
+	libmaus2::autoarray::AutoArray<char> B;
 
 	PosixOutput(std::string const & rfn)
-	: fn(rfn), fd(libmaus2::aio::PosixFdOutputStreamBuffer::doOpen(fn))
+	: fn(rfn), fd(libmaus2::aio::PosixFdOutputStreamBuffer::doOpen(fn)), offset(0), usesplice(true)
 	{
 
 	}
@@ -385,87 +371,255 @@ struct PosixOutput
 		uint64_t const off = libmaus2::aio::PosixFdOutputStreamBuffer::doSeekAbsolute(fd,fn,0,SEEK_END);
 		return off;
 	}
-};
-
-
-struct CopyThread : public libmaus2::parallel::PosixThread
-{
-	typedef CopyThread this_type;
-	typedef libmaus2::util::unique_ptr<this_type>::type unique_ptr_type;
 
-	int const infd;
-	std::ostream & out;
-	bool const immediateFlush;
+	void write(char const * p, uint64_t n)
+	{
+		while ( n )
+		{
+			ssize_t const w = ::write(fd,p,n);
 
-	CopyThread(int const rinfd, std::ostream & rout, bool rimmediateFlush) : infd(rinfd), out(rout), immediateFlush(rimmediateFlush) {}
+			if ( w > 0 )
+			{
+				p += w;
+				n -= w;
+				offset += w;
+			}
+			else if ( w < 0 && errno == EINTR )
+			{
+			}
+			else
+			{
+				int const error = errno;
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] PosixOutput::write: failed to write to " << fn << ": " << strerror(error) << std::endl;
+				lme.finish();
+				throw lme;
+			}
+		}
+	}
 
-	virtual void * run()
+	/*
+	 * move the data currently available in the non blocking pipe infd to
+	 * the file. On Linux splice moves the pipe pages to the file without
+	 * copying them through user space, otherwise (or if the file system
+	 * rejects splice) read and write are used. Returns false when the
+	 * write end of the pipe is closed and no data is left.
+	 */
+	bool transfer(int const infd)
 	{
-		libmaus2::autoarray::AutoArray<char> C(8192,false);
+		uint64_t moved = 0;
 
-		try
+		while ( moved < maxtransfer )
 		{
-			while ( true )
+			ssize_t r;
+
+			#if defined(__linux__) && defined(SPLICE_F_MOVE)
+			if ( usesplice )
 			{
-				::ssize_t r = ::read(infd,C.begin(),C.size());
+				r = ::splice(infd,NULL,fd,NULL,blocksize,SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
 
 				if ( r > 0 )
+					offset += r;
+				else if ( r < 0 && errno == EINVAL )
 				{
-					out.write(C.begin(),r);
+					usesplice = false;
+					continue;
+				}
+			}
+			else
+			#endif
+			{
+				if ( ! B.size() )
+					B = libmaus2::autoarray::AutoArray<char>(blocksize,false);
 
-					if ( ! out )
+				r = ::read(infd,B.begin(),B.size());
+
+				if ( r > 0 )
+					write(B.begin(),r);
+			}
+
+			if ( r > 0 )
+				moved += r;
+			else if ( r == 0 )
+				return false;
+			else
+			{
+				int const error = errno;
+
+				switch ( error )
+				{
+					case EINTR:
+						break;
+					case EAGAIN:
+						return true;
+					default:
 					{
 						libmaus2::exception::LibMausException lme;
-						lme.getStream() << "[E] CopyThread::run: failed to copy " << r << " bytes" << std::endl;
+						lme.getStream() << "[E] PosixOutput::transfer: failed to transfer data to " << fn << ": " << strerror(error) << std::endl;
 						lme.finish();
 						throw lme;
 					}
+				}
+			}
+		}
 
-					if ( immediateFlush )
-					{
-						out.flush();
+		return true;
+	}
+};
 
-						if ( ! out )
-						{
-							libmaus2::exception::LibMausException lme;
-							lme.getStream() << "[E] CopyThread::run: failed to copy " << r << " bytes" << std::endl;
-							lme.finish();
-							throw lme;
-						}
-					}
-				}
-				else if ( r == 0 )
-				{
-					break;
-				}
-				else
-				{
-					int const error = errno;
+/*
+ * one output stream of the running command of a lane stored according to
+ * the log policy of its rule. Output without limit under log_all is
+ * moved to the file directly (PosixOutput::transfer). Otherwise the head
+ * of the output is written to the file as it arrives (log_all) or kept in
+ * memory (log_onfailure), the tail is kept in a ring buffer. Buffered data
+ * is written to the file by finish if the policy asks for it. skipped
+ * counts the bytes not stored.
+ */
+struct OutputCapture
+{
+	PosixOutput & file;
+	LogPolicy policy;
+	uint64_t headlimit;
+	uint64_t headsize;
+	std::string head;
+	std::vector < char > tail;
+	// next write position in tail and number of valid bytes in tail
+	uint64_t tailpos;
+	uint64_t tailfill;
+	uint64_t skipped;
+	libmaus2::autoarray::AutoArray<char> B;
+
+	OutputCapture(PosixOutput & rfile)
+	: file(rfile), headlimit(0), headsize(0), tailpos(0), tailfill(0), skipped(0)
+	{
+
+	}
+
+	void reset(LogPolicy const & rpolicy)
+	{
+		policy = rpolicy;
+		headlimit = policy.getHeadLimit();
+		headsize = 0;
+		head.clear();
+		tail.resize(policy.getTailLimit());
+		tailpos = 0;
+		tailfill = 0;
+		skipped = 0;
+	}
+
+	bool direct() const
+	{
+		return policy.mode == LogPolicy::log_all && ! policy.limit;
+	}
+
+	void consume(char const * p, uint64_t n)
+	{
+		if ( headsize < headlimit )
+		{
+			uint64_t const h = std::min(n,headlimit-headsize);
+
+			if ( policy.mode == LogPolicy::log_all )
+				file.write(p,h);
+			else if ( policy.mode == LogPolicy::log_onfailure )
+				head.append(p,h);
+			else
+				skipped += h;
+
+			headsize += h;
+			p += h;
+			n -= h;
+		}
+
+		if ( n > tail.size() )
+		{
+			skipped += tailfill + (n - tail.size());
+			tailfill = 0;
+			p += n - tail.size();
+			n = tail.size();
+		}
+
+		if ( n )
+		{
+			uint64_t const overflow = (tailfill + n > tail.size()) ? (tailfill + n - tail.size()) : 0;
+			skipped += overflow;
+			tailfill = std::min(tailfill + n, static_cast<uint64_t>(tail.size()));
+
+			uint64_t const n0 = std::min(n,static_cast<uint64_t>(tail.size()) - tailpos);
+			std::copy(p,p+n0,tail.begin()+tailpos);
+			std::copy(p+n0,p+n,tail.begin());
+			tailpos = (tailpos + n) % tail.size();
+		}
+	}
+
+	// returns false on EOF, see PosixOutput::transfer
+	bool transfer(int const infd)
+	{
+		if ( direct() )
+			return file.transfer(infd);
+
+		if ( ! B.size() )
+			B = libmaus2::autoarray::AutoArray<char>(PosixOutput::blocksize,false);
+
+		uint64_t moved = 0;
+
+		while ( moved < PosixOutput::maxtransfer )
+		{
+			ssize_t const r = ::read(infd,B.begin(),B.size());
 
-					switch ( error )
+			if ( r > 0 )
+			{
+				consume(B.begin(),r);
+				moved += r;
+			}
+			else if ( r == 0 )
+				return false;
+			else
+			{
+				int const error = errno;
+
+				switch ( error )
+				{
+					case EINTR:
+						break;
+					case EAGAIN:
+						return true;
+					default:
 					{
-						case EAGAIN:
-						case EINTR:
-							break;
-						default:
-						{
-							libmaus2::exception::LibMausException lme;
-							lme.getStream() << "[E] CopyThread::run: failed to read: " << strerror(error) << std::endl;
-							lme.finish();
-							throw lme;
-						}
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] OutputCapture::transfer: failed to read: " << strerror(error) << std::endl;
+						lme.finish();
+						throw lme;
 					}
 				}
 			}
 		}
-		catch(std::exception const & ex)
+
+		return true;
+	}
+
+	// store buffered data after the command has finished
+	void finish(bool const failed)
+	{
+		bool const store =
+			policy.mode == LogPolicy::log_all ||
+			(policy.mode == LogPolicy::log_onfailure && failed);
+
+		if ( store )
 		{
-			libmaus2::parallel::ScopePosixSpinLock slock(libmaus2::aio::StreamLock::cerrlock);
-			std::cerr << ex.what() << std::endl;
-			return 0;
+			file.write(head.c_str(),head.size());
+			uint64_t const tailstart = (tailpos + tail.size() - tailfill) % std::max(tail.size(),static_cast<std::size_t>(1));
+			uint64_t const n0 = std::min(tailfill,static_cast<uint64_t>(tail.size()) - tailstart);
+			file.write(tail.data()+tailstart,n0);
+			file.write(tail.data(),tailfill-n0);
+		}
+		else
+		{
+			skipped += head.size() + tailfill;
 		}
 
-		return 0;
+		head.clear();
+		tailfill = 0;
 	}
 };
 
@@ -505,6 +659,26 @@ struct Pipe
 				break;
 			}
 		}
+
+		// keep the pipe out of commands started for other lanes
+		::fcntl(fd[0],F_SETFD,FD_CLOEXEC);
+		::fcntl(fd[1],F_SETFD,FD_CLOEXEC);
+	}
+
+	/*
+	 * make the read end non blocking for the event loop and try to enlarge
+	 * the pipe buffer, so commands writing a lot of output cause fewer
+	 * wake ups. Failure to resize (e.g. above /proc/sys/fs/pipe-max-size)
+	 * is not an error.
+	 */
+	void setupReadEnd(uint64_t const size)
+	{
+		::fcntl(fd[0],F_SETFL,::fcntl(fd[0],F_GETFL) | O_NONBLOCK);
+		#if defined(F_SETPIPE_SZ)
+		::fcntl(fd[0],F_SETPIPE_SZ,static_cast<int>(size));
+		#else
+		(void)size;
+		#endif
 	}
 
 	~Pipe()
@@ -542,30 +716,458 @@ struct Pipe
 	}
 };
 
-int slurmworker(libmaus2::util::ArgParser const & arg)
+/*
+ * output files and state of one command running in the worker. Each
+ * concurrently running command uses its own lane, so the output of
+ * different commands is not interleaved in the data files. The output
+ * of the running command is moved from its pipes to the data files by
+ * the event loop of the worker (see transfer).
+ */
+struct Lane
 {
+	typedef Lane this_type;
+	typedef libmaus2::util::shared_ptr<this_type>::type shared_ptr_type;
+
+	std::string const outdata;
+	std::string const errdata;
+	PosixOutput outFile;
+	PosixOutput errFile;
+	OutputCapture outCapture;
+	OutputCapture errCapture;
+	// fsync the data files before a command is reported as finished
+	bool const syncoutput;
+
+	// seconds the output pipes are kept open after the command has ended
+	static uint64_t const draintimeout = 60;
+
+	pid_t pid;
+	// set while a module call of the lane runs on the module thread pool
+	bool inthread;
+	/*
+	 * set after the process has been reaped or the module call has
+	 * returned. The lane stays busy until its pipes reach EOF (or
+	 * draintimeout passes), as background processes started by the command
+	 * may still hold their write ends.
+	 */
+	bool reaped;
+	int exitstatus;
+	uint64_t reaptime;
 	RunInfo RI;
 
+	/*
+	 * steps of a chain of fused commands left to run after the current
+	 * one as pairs of subid and serialised command, each step is started
+	 * once control has acknowledged the report of the previous one
+	 */
+	std::deque < std::pair<uint64_t,std::string> > chain;
+	LogPolicy chainlogpolicy;
+
+	// in memory script of the running command or -1, the script is kept to write it to a file on failure
+	int scriptfd;
+	std::string script;
+
+	Pipe::unique_ptr_type outPipe;
+	Pipe::unique_ptr_type errPipe;
+
+	Lane(std::string const & routdata, std::string const & rerrdata, bool const rsyncoutput)
+	: outdata(routdata), errdata(rerrdata), outFile(outdata), errFile(errdata), outCapture(outFile), errCapture(errFile), syncoutput(rsyncoutput), pid(static_cast<pid_t>(-1)), inthread(false), reaped(false), exitstatus(0), reaptime(0), scriptfd(-1)
+	{
+
+	}
+
+	bool busy() const
+	{
+		return hasProcess() || inthread || reaped;
+	}
+
+	bool hasProcess() const
+	{
+		return pid != static_cast<pid_t>(-1);
+	}
+
+	static std::string getScriptName(std::string const & scriptbase, uint64_t const containerid, uint64_t const subid)
+	{
+		std::ostringstream scriptnamestr;
+		scriptnamestr << scriptbase + "_" << containerid << "_" << subid << ".sh";
+		return scriptnamestr.str();
+	}
+
+	void prepare(uint64_t const containerid, uint64_t const subid, std::string const & scriptname, LogPolicy const & logpolicy)
+	{
+		outCapture.reset(logpolicy);
+		errCapture.reset(logpolicy);
+
+		RI.containerid = containerid;
+		RI.subid = subid;
+		RI.outstart = outFile.offset;
+		RI.errstart = errFile.offset;
+		RI.outend = std::numeric_limits<uint64_t>::max();
+		RI.errend = std::numeric_limits<uint64_t>::max();
+		RI.outfn = outdata;
+		RI.errfn = errdata;
+		RI.scriptname = scriptname;
+		RI.outskipped = 0;
+		RI.errskipped = 0;
+	}
+
+	/*
+	 * start command com. Module calls with a thread safe entry point are
+	 * queued on pool with the lane id laneid, their result has to be
+	 * passed to threadFinished.
+	 */
+	void start(ModuleLoader & loader, ModuleThreadPool & pool, uint64_t const laneid, libmaus2::util::Command const & com)
+	{
+		Pipe::unique_ptr_type toutPipe(new Pipe());
+		outPipe = UNIQUE_PTR_MOVE(toutPipe);
+		Pipe::unique_ptr_type terrPipe(new Pipe());
+		errPipe = UNIQUE_PTR_MOVE(terrPipe);
+
+		if ( com.modcall )
+		{
+			std::pair<std::string,std::string> const P = ModuleLoader::split(com.script);
+			Module const * mod = loader.get(P.first);
+
+			if ( mod && mod->fdfunction )
+			{
+				// the write end of the error pipe is closed by threadFinished
+				pool.enque(ModuleTask(laneid,mod->fdfunction->func,P.second,errPipe->getWriteEnd()));
+				inthread = true;
+				outPipe->closeWriteEnd();
+				outPipe->setupReadEnd(PosixOutput::blocksize);
+				errPipe->setupReadEnd(PosixOutput::blocksize);
+				return;
+			}
+		}
+
+		if ( ! com.modcall && ! ExecCommand::isExec(com.script) )
+		{
+			script = com.script;
+			scriptfd = createScriptFD(script);
+		}
+
+		pid = startCommand(loader,com,RI.scriptname,outPipe->getWriteEnd(),errPipe->getWriteEnd(),scriptfd);
+		outPipe->closeWriteEnd();
+		errPipe->closeWriteEnd();
+
+		// command not found or not executable, finish with exit code 127 (waitpid format)
+		if ( pid == static_cast<pid_t>(-1) )
+			reap(127 << 8);
+
+		outPipe->setupReadEnd(PosixOutput::blocksize);
+		errPipe->setupReadEnd(PosixOutput::blocksize);
+	}
+
+	// read end of the pipe for standard output (j=0) or error (j=1), -1 after EOF
+	int getPipeFD(uint64_t const j) const
+	{
+		Pipe * P = j ? errPipe.get() : outPipe.get();
+		return P ? P->getReadEnd() : -1;
+	}
+
+	// move available output of stream j to its data file
+	void transfer(uint64_t const j)
+	{
+		Pipe * P = j ? errPipe.get() : outPipe.get();
+		OutputCapture & O = j ? errCapture : outCapture;
+
+		if ( P && P->getReadEnd() >= 0 && ! O.transfer(P->getReadEnd()) )
+			P->closeReadEnd();
+	}
+
+	// true if both pipes have reached EOF
+	bool drained() const
+	{
+		return getPipeFD(0) < 0 && getPipeFD(1) < 0;
+	}
+
+	// true if finish can be called at time now
+	bool finishable(uint64_t const now) const
+	{
+		return reaped && (drained() || now >= reaptime + draintimeout);
+	}
+
+	// milliseconds until the drain timeout of a reaped lane passes
+	int getDrainWait(uint64_t const now) const
+	{
+		return (now < reaptime + draintimeout) ? (reaptime + draintimeout - now) * 1000 : 0;
+	}
+
+	// called when the module call started on the thread pool has returned
+	void threadFinished()
+	{
+		errPipe->closeWriteEnd();
+	}
+
+	// called after the process has been reaped or the module call has returned
+	void reap(int const status)
+	{
+		pid = static_cast<pid_t>(-1);
+		inthread = false;
+		reaped = true;
+		exitstatus = status;
+		reaptime = time(0);
+	}
+
+	// called once finishable returns true, output still in the pipes is dropped
+	void finish(std::ostream & metaOSI)
+	{
+		int const status = exitstatus;
+		reaped = false;
+
+		if ( ! drained() )
+		{
+			std::cerr << "[W] output of (" << RI.containerid << "," << RI.subid << ") still open "
+				<< draintimeout << " seconds after the command ended, output is truncated" << std::endl;
+
+			std::ostringstream notestr;
+			notestr << "\n[hpcschedworker] output truncated, pipes still open " << draintimeout << " seconds after the command ended\n";
+			std::string const note = notestr.str();
+			if ( errCapture.direct() )
+				errFile.write(note.c_str(),note.size());
+			else
+				errCapture.consume(note.c_str(),note.size());
+		}
+
+		outPipe.reset();
+		errPipe.reset();
+
+		outCapture.finish(status != 0);
+		errCapture.finish(status != 0);
+
+		// keep the script of failed commands for debugging
+		if ( scriptfd >= 0 )
+		{
+			doClose(scriptfd);
+			scriptfd = -1;
+
+			if ( status != 0 )
+			{
+				libmaus2::aio::OutputStreamInstance OSI(RI.scriptname);
+				OSI << script;
+				OSI.flush();
+			}
+		}
+		else if ( status == 0 )
+			libmaus2::aio::FileRemoval::removeFile(RI.scriptname);
+
+		script = std::string();
+
+		if ( syncoutput )
+		{
+			outFile.flush();
+			errFile.flush();
+		}
+
+		RI.outend = outFile.offset;
+		RI.errend = errFile.offset;
+		RI.outskipped = outCapture.skipped;
+		RI.errskipped = errCapture.skipped;
+		RI.status = status;
+		RI.serialise(metaOSI);
+		metaOSI.flush();
+	}
+};
+
+/*
+ * collect exit status of finished commands without blocking. Only the
+ * processes of the lanes are waited for, module calls finished on pool are
+ * included. Returns the lanes which finished along with their exit status.
+ */
+static std::vector < std::pair<uint64_t,int> > reapLanes(std::vector < Lane::shared_ptr_type > & lanes, ModuleThreadPool & pool)
+{
+	std::vector < std::pair<uint64_t,int> > V;
+
+	for ( uint64_t l = 0; l < lanes.size(); ++l )
+		if ( lanes[l]->hasProcess() )
+		{
+			int status = 0;
+			pid_t const r = waitpid(lanes[l]->pid,&status,WNOHANG);
+
+			if ( r == lanes[l]->pid )
+				V.push_back(std::pair<uint64_t,int>(l,status));
+			else if ( r == static_cast<pid_t>(-1) && errno != EINTR )
+			{
+				int const error = errno;
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] waitpid failed for lane " << l << ": " << strerror(error) << std::endl;
+				lme.finish();
+				throw lme;
+			}
+		}
+
+	std::vector < ModuleResult > const R = pool.getResults();
+
+	for ( uint64_t i = 0; i < R.size(); ++i )
+	{
+		lanes[R[i].id]->threadFinished();
+		V.push_back(std::pair<uint64_t,int>(R[i].id,R[i].status));
+	}
+
+	return V;
+}
+
+/*
+ * wait until a child terminates or a module call on pool returns, output of
+ * a running command is available, fd (if not negative) becomes readable or
+ * timeout milliseconds have passed. Available output is moved to the data
+ * files of the lanes. Returns true if fd is readable.
+ */
+static bool waitLanes(
+	ChildWatcher & watcher, std::vector < Lane::shared_ptr_type > & lanes, ModuleThreadPool & pool, int const fd, int const timeout
+)
+{
+	std::vector < struct pollfd > P;
+	std::vector < std::pair<uint64_t,uint64_t> > S;
+
+	if ( fd >= 0 )
+	{
+		struct pollfd E;
+		E.fd = fd;
+		E.events = POLLIN;
+		E.revents = 0;
+		P.push_back(E);
+		S.push_back(std::pair<uint64_t,uint64_t>(0,0));
+	}
+
+	for ( uint64_t l = 0; l < lanes.size(); ++l )
+		for ( uint64_t j = 0; j < 2; ++j )
+			if ( lanes[l]->getPipeFD(j) >= 0 )
+			{
+				struct pollfd E;
+				E.fd = lanes[l]->getPipeFD(j);
+				E.events = POLLIN;
+				E.revents = 0;
+				P.push_back(E);
+				S.push_back(std::pair<uint64_t,uint64_t>(l,j));
+			}
+
+	// results are collected by reapLanes
+	struct pollfd E;
+	E.fd = pool.getFD();
+	E.events = POLLIN;
+	E.revents = 0;
+	P.push_back(E);
+	S.push_back(std::pair<uint64_t,uint64_t>(lanes.size(),0));
+
+	watcher.wait(P,timeout);
+
+	bool fdready = false;
+	for ( uint64_t i = 0; i < P.size(); ++i )
+		if ( P[i].revents )
+		{
+			if ( fd >= 0 && i == 0 )
+				fdready = true;
+			else if ( S[i].first < lanes.size() )
+				lanes[S[i].first]->transfer(S[i].second);
+		}
+
+	return fdready;
+}
+
+/*
+ * read the next reply or acknowledgement from control. After answering a
+ * request for work with 3 (nothing fits) control sends 5 once jobs
+ * become ready. Such a notification may arrive before the message
+ * expected, it is consumed and sets requestwork.
+ */
+static uint64_t readReply(FDIO & fdio, bool & requestwork)
+{
+	uint64_t r;
+
+	while ( (r = fdio.readNumber()) == 5 )
+		requestwork = true;
+
+	return r;
+}
+
+static uint64_t getEnvNumber(char const * name, uint64_t const def)
+{
+	char const * s = getenv(name);
+
+	if ( ! s )
+		return def;
+
+	std::istringstream istr(s);
+	uint64_t v;
+	istr >> v;
+
+	if ( istr && istr.peek() == std::istream::traits_type::eof() )
+		return v;
+	else
+		return def;
+}
+
+int slurmworker(libmaus2::util::ArgParser const & arg)
+{
 	std::string const tmpfilebase = arg.uniqueArgPresent("T") ? arg["T"] : libmaus2::util::ArgInfo::getDefaultTmpFileName(arg.progname);
+	// capacity advertised to control, memory 0 means unknown
+	uint64_t const threads = arg.uniqueArgPresent("threads") ? arg.getParsedArg<uint64_t>("threads") :
+		getEnvNumber("SLURM_CPUS_PER_TASK",libmaus2::parallel::NumCpus::getNumLogicalProcessors());
+	uint64_t const mem = arg.uniqueArgPresent("mem") ? arg.getParsedArg<uint64_t>("mem") : getEnvNumber("SLURM_MEM_PER_NODE",0);
+	// seconds to wait before asking for work again after control had none fitting
+	int const pollinterval = arg.uniqueArgPresent("pollinterval") ? arg.getParsedArg<int>("pollinterval") : 10;
+	// flush policy for the data files: none (leave it to the kernel) or fsync (before reporting a finished command)
+	std::string const outputsync = arg.uniqueArgPresent("outputsync") ? arg["outputsync"] : std::string("none");
+
+	if ( outputsync != "none" && outputsync != "fsync" )
+	{
+		std::cerr << "[E] unknown value " << outputsync << " for --outputsync (use none or fsync)" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	bool const syncoutput = (outputsync == "fsync");
+	// number of threads running module calls inside the worker
+	uint64_t const modulethreads = arg.uniqueArgPresent("modulethreads") ? arg.getParsedArg<uint64_t>("modulethreads") : 4;
 
 	std::string const hostname = arg[0];
 	uint64_t const port = arg.getParsedRestArg<uint64_t>(1);
 
-	char const * jobid_s = getenv("SLURM_JOB_ID");
+	// job id assigned by the batch backend, SLURM_JOB_ID unless given on the command line
+	uint64_t jobid;
+	char const * arrayjobid_s = getenv("SLURM_ARRAY_JOB_ID");
+	char const * arraytaskid_s = getenv("SLURM_ARRAY_TASK_ID");
 
-	if ( ! jobid_s )
+	if ( arg.uniqueArgPresent("jobid") )
 	{
-		std::cerr << "[E] job id not found in SLURM_JOB_ID" << std::endl;
-		return EXIT_FAILURE;
+		jobid = arg.getParsedArg<uint64_t>("jobid");
 	}
+	else if ( arrayjobid_s && arraytaskid_s )
+	{
+		std::istringstream arrayjobidistr(arrayjobid_s);
+		std::istringstream arraytaskidistr(arraytaskid_s);
+		uint64_t arrayjobid, arraytaskid;
+		arrayjobidistr >> arrayjobid;
+		arraytaskidistr >> arraytaskid;
+
+		if (
+			! arrayjobidistr || arrayjobidistr.peek() != std::istream::traits_type::eof()
+			||
+			! arraytaskidistr || arraytaskidistr.peek() != std::istream::traits_type::eof()
+		)
+		{
+			std::cerr << "[E] array job id " << arrayjobid_s << " or task id " << arraytaskid_s << " not parseable" << std::endl;
+			return EXIT_FAILURE;
+		}
 
-	std::istringstream jobidistr(jobid_s);
-	uint64_t jobid;
-	jobidistr >> jobid;
-	if ( ! jobidistr || jobidistr.peek() != std::istream::traits_type::eof() )
+		jobid = SlurmBatchBackend::getArrayTaskId(arrayjobid,arraytaskid);
+	}
+	else
 	{
-		std::cerr << "[E] job id " << jobid_s << " found in SLURM_JOB_ID not parseable" << std::endl;
-		return EXIT_FAILURE;
+		char const * jobid_s = getenv("SLURM_JOB_ID");
+
+		if ( ! jobid_s )
+		{
+			std::cerr << "[E] job id not found in SLURM_JOB_ID and not given via --jobid" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::istringstream jobidistr(jobid_s);
+		jobidistr >> jobid;
+		if ( ! jobidistr || jobidistr.peek() != std::istream::traits_type::eof() )
+		{
+			std::cerr << "[E] job id " << jobid_s << " found in SLURM_JOB_ID not parseable" << std::endl;
+			return EXIT_FAILURE;
+		}
 	}
 
 	libmaus2::network::ClientSocket sockA(port,hostname.c_str());
@@ -597,154 +1199,210 @@ int slurmworker(libmaus2::util::ArgParser const & arg)
 
 	std::cerr << "[V] using outdata=" << outdata << std::endl;
 	std::cerr << "[V] using errdata=" << errdata << std::endl;
+	std::cerr << "[V] advertising threads=" << threads << " mem=" << mem << std::endl;
 
 	fdio.writeString(outdata);
 	fdio.writeString(errdata);
 	fdio.writeString(metafn);
+	fdio.writeNumber(threads);
+	fdio.writeNumber(mem);
 
 	libmaus2::aio::OutputStreamInstance metaOSI(metafn);
-	libmaus2::aio::OutputStreamInstance outData(outdata);
-	libmaus2::aio::OutputStreamInstance errData(errdata);
 
-	CopyThread::unique_ptr_type outCopy;
-	CopyThread::unique_ptr_type errCopy;
-	Pipe::unique_ptr_type outPipe;
-	Pipe::unique_ptr_type errPipe;
-	// (int const rinfd, std::ostream & rout) : infd(rinfd), out(rout) {}
+	// lane 0 uses the data files announced to control, further lanes are created on demand
+	std::vector < Lane::shared_ptr_type > lanes;
+	lanes.push_back(Lane::shared_ptr_type(new Lane(outdata,errdata,syncoutput)));
+	uint64_t numrunning = 0;
+	ChildWatcher watcher;
+	ModuleLoader loader(arg.getAbsProgName());
+	ModuleThreadPool pool(modulethreads);
 
 	bool running = true;
-
-	enum state_type
-	{
-		state_idle = 0,
-		state_running = 1
-	};
-
-	state_type state = state_idle;
-	pid_t workpid = static_cast<pid_t>(-1);
+	// set if control may have more work for us
+	bool requestwork = true;
+	// time of the last request for work
+	uint64_t lastrequest = 0;
 
 	try
 	{
 		while ( running )
 		{
-			switch ( state )
+			if ( requestwork || ! numrunning )
 			{
-				case state_idle:
+				std::cerr << "[V] asking control for work, running " << numrunning << std::endl;
+				lastrequest = time(0);
+				fdio.writeNumber(0);
+				uint64_t const rep = readReply(fdio,requestwork);
+				std::cerr << "[V] got reply with code " << rep << std::endl;
+
+				// execute command (0) or chain of fused commands (4)
+				if ( rep == 0 || rep == 4 )
 				{
-					std::cerr << "[V] telling control we are idle" << std::endl;
-					// tell control we are idle
-					fdio.writeNumber(0);
-					std::cerr << "[V] waiting for acknowledgement" << std::endl;
-					// get reply
-					uint64_t const rep = fdio.readNumber();
-					std::cerr << "[V] got acknowledgement with code " << rep << std::endl;
-
-					// execute command
+					std::deque < std::pair<uint64_t,std::string> > chain;
+					uint64_t containerid;
+					LogPolicy logpolicy;
+
 					if ( rep == 0 )
 					{
 						std::string const jobdesc = fdio.readString();
-						std::istringstream jobdescistr(jobdesc);
-						libmaus2::util::Command const com(jobdescistr);
-						uint64_t const containerid = fdio.readNumber();
+						containerid = fdio.readNumber();
 						uint64_t const subid = fdio.readNumber();
+						logpolicy = LogPolicy::decode(fdio.readNumber());
+						chain.push_back(std::pair<uint64_t,std::string>(subid,jobdesc));
+					}
+					else
+					{
+						containerid = fdio.readNumber();
+						logpolicy = LogPolicy::decode(fdio.readNumber());
+						uint64_t const numsteps = fdio.readNumber();
 
-						std::ostringstream scriptnamestr;
-						scriptnamestr << scriptbase + "_" << containerid << "_" << subid << ".sh";
+						for ( uint64_t i = 0; i < numsteps; ++i )
+						{
+							std::string const jobdesc = fdio.readString();
+							uint64_t const subid = fdio.readNumber();
+							chain.push_back(std::pair<uint64_t,std::string>(subid,jobdesc));
+						}
+					}
 
-						std::cerr << "[V] starting command " << com << " (" << containerid << "," << subid << ")" << std::endl;
+					if ( ! chain.size() )
+					{
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] control sent empty chain for container " << containerid << std::endl;
+						lme.finish();
+						throw lme;
+					}
 
-						RI.containerid = containerid;
-						RI.subid = subid;
-						RI.outstart = outData.tellp();
-						RI.errstart = errData.tellp();
-						RI.outend = std::numeric_limits<uint64_t>::max();
-						RI.errend = std::numeric_limits<uint64_t>::max();
-						RI.outfn = outdata;
-						RI.errfn = errdata;
-						RI.scriptname = scriptnamestr.str();
+					uint64_t const subid = chain.front().first;
+					std::istringstream jobdescistr(chain.front().second);
+					libmaus2::util::Command const com(jobdescistr);
+					chain.pop_front();
 
-						fdio.writeString(RI.serialise());
+					uint64_t l = 0;
+					while ( l < lanes.size() && lanes[l]->busy() )
+						++l;
+					if ( l == lanes.size() )
+					{
+						std::ostringstream outstr, errstr;
+						outstr << outbase << "_" << l << ".data";
+						errstr << errbase << "_" << l << ".data";
+						lanes.push_back(Lane::shared_ptr_type(new Lane(outstr.str(),errstr.str(),syncoutput)));
+					}
+					Lane & lane = *(lanes[l]);
 
-						Pipe::unique_ptr_type toutPipe(new Pipe());
-						outPipe = UNIQUE_PTR_MOVE(toutPipe);
-						Pipe::unique_ptr_type terrPipe(new Pipe());
-						errPipe = UNIQUE_PTR_MOVE(terrPipe);
+					std::cerr << "[V] starting command " << com << " (" << containerid << "," << subid << ") in lane " << l
+						<< " followed by " << chain.size() << " steps" << std::endl;
 
-						workpid = startCommand(arg,com,scriptnamestr.str(),outPipe->getWriteEnd(),errPipe->getWriteEnd());
-						outPipe->closeWriteEnd();
-						errPipe->closeWriteEnd();
+					lane.chain.swap(chain);
+					lane.chainlogpolicy = logpolicy;
+					lane.prepare(containerid,subid,Lane::getScriptName(scriptbase,containerid,subid),logpolicy);
+					fdio.writeString(lane.RI.serialise());
+					lane.start(loader,pool,l,com);
+					numrunning += 1;
+				}
+				// wake up
+				else if ( rep == 1 )
+				{
+				}
+				// terminate
+				else if ( rep == 2 )
+				{
+					if ( numrunning )
+					{
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] control requested termination while " << numrunning << " commands are running" << std::endl;
+						lme.finish();
+						throw lme;
+					}
 
-						CopyThread::unique_ptr_type toutCopy(new CopyThread(outPipe->getReadEnd(),outData,false /* im flush */));
-						outCopy = UNIQUE_PTR_MOVE(toutCopy);
-						outCopy->start();
-						CopyThread::unique_ptr_type terrCopy(new CopyThread(errPipe->getReadEnd(),errData,true /* im flush */));
-						errCopy = UNIQUE_PTR_MOVE(terrCopy);
-						errCopy->start();
+					std::cerr << "[V] terminating" << std::endl;
+					running = false;
+				}
+				// no work fitting our free capacity, control sends 5 once jobs become ready
+				else if ( rep == 3 )
+				{
+					requestwork = false;
+				}
+			}
+			else
+			{
+				uint64_t const now = time(0);
+				int timeout = (now < lastrequest + pollinterval) ? (lastrequest + pollinterval - now) * 1000 : 0;
+				// wake up when the drain timeout of a reaped lane passes
+				for ( uint64_t l = 0; l < lanes.size(); ++l )
+					if ( lanes[l]->reaped )
+						timeout = std::min(timeout,lanes[l]->getDrainWait(now));
+				bool const sockready = waitLanes(watcher,lanes,pool,sockA.getFD(),timeout);
+
+				// the only message control sends unasked is the notification about new work
+				if ( sockready )
+				{
+					char c;
+					ssize_t const r = ::recv(sockA.getFD(),&c,1,MSG_PEEK);
 
-						state = state_running;
-					}
-					// terminate
-					else if ( rep == 2 )
+					if ( r == 0 || fdio.readNumber() != 5 )
 					{
-						std::cerr << "[V] terminating" << std::endl;
-						running = false;
+						libmaus2::exception::LibMausException lme;
+						if ( r == 0 )
+							lme.getStream() << "[E] control closed connection" << std::endl;
+						else
+							lme.getStream() << "[E] unexpected data from control" << std::endl;
+						lme.finish();
+						throw lme;
 					}
-					else
-					{
 
-					}
-					break;
+					std::cerr << "[V] control reports new work" << std::endl;
+					requestwork = true;
 				}
-				case state_running:
-				{
-					std::pair<pid_t,int> const P = waitWithTimeout(60 /* timeout */);
 
-					pid_t const wpid = P.first;
-					int const status = P.second;
+				std::vector < std::pair<uint64_t,int> > const V = reapLanes(lanes,pool);
 
-					if ( wpid == workpid )
-					{
-						workpid = static_cast<pid_t>(-1);
+				for ( uint64_t j = 0; j < V.size(); ++j )
+					lanes[V[j].first]->reap(V[j].second);
 
-						outCopy->join();
-						outCopy.reset();
-						errCopy->join();
-						errCopy.reset();
-						outPipe.reset();
-						errPipe.reset();
+				uint64_t numfinished = 0;
+				uint64_t const finishtime = time(0);
+				for ( uint64_t l = 0; l < lanes.size(); ++l )
+				{
+					if ( ! lanes[l]->finishable(finishtime) )
+						continue;
 
-						outData.flush();
-						errData.flush();
+					Lane & lane = *(lanes[l]);
+					int const status = lane.exitstatus;
+					lane.finish(metaOSI);
 
-						RI.outend = outData.tellp();
-						RI.errend = errData.tellp();
-						RI.status = status;
-						RI.serialise(metaOSI);
-						metaOSI.flush();
+					// tell control we finished a job
+					fdio.writeNumber(1);
+					fdio.writeNumber(status);
+					fdio.writeString(lane.RI.serialise());
+					// wait for acknowledgement, 0 lets us go on with the chain of the job
+					uint64_t const ack = readReply(fdio,requestwork);
 
-						if ( status == 0 )
-							libmaus2::aio::FileRemoval::removeFile(RI.scriptname);
+					std::cerr << "[V] finished (" << lane.RI.containerid << "," << lane.RI.subid << ") with status " << status << std::endl;
 
-						// tell control we finished a job
-						fdio.writeNumber(1);
-						fdio.writeNumber(status);
-						fdio.writeString(RI.serialise());
-						// wait for acknowledgement
-						fdio.readNumber();
+					if ( ack == 0 && lane.chain.size() )
+					{
+						uint64_t const containerid = lane.RI.containerid;
+						uint64_t const subid = lane.chain.front().first;
+						std::istringstream jobdescistr(lane.chain.front().second);
+						libmaus2::util::Command const com(jobdescistr);
+						lane.chain.pop_front();
 
-						std::cerr << "[V] finished with status " << status << std::endl;
+						std::cerr << "[V] continuing chain with command " << com << " (" << containerid << "," << subid << ") in lane " << l << std::endl;
 
-						state = state_idle;
+						lane.prepare(containerid,subid,Lane::getScriptName(scriptbase,containerid,subid),lane.chainlogpolicy);
+						lane.start(loader,pool,l,com);
 					}
 					else
 					{
-						// tell control we are still running our job
-						fdio.writeNumber(2);
-						// wait for acknowledgement
-						fdio.readNumber();
+						lane.chain.clear();
+						numrunning -= 1;
+						numfinished += 1;
 					}
-					break;
 				}
+
+				// ask again after a command finished or the poll interval passed
+				if ( numfinished || static_cast<uint64_t>(time(0)) >= lastrequest + pollinterval )
+					requestwork = true;
 			}
 		}
 	}
@@ -753,83 +1411,51 @@ int slurmworker(libmaus2::util::ArgParser const & arg)
 		std::cerr << ex.what() << std::endl;
 
 		/*
-		 * kill worker process if it is still running
+		 * kill processes still running
 		 *
 		 * first try SIGTERM to allow for "gracious" failure with possible cleanup activity
 		 *
-		 * if process does not end after SIGTERM then send SIGKILL
+		 * if processes do not end after SIGTERM then send SIGKILL
 		 */
-		if ( workpid != static_cast<pid_t>(-1) )
-		{
-			kill(workpid,SIGTERM);
+		int const signals[] = { SIGTERM, SIGKILL };
 
-			for ( uint64_t i = 0; workpid != static_cast<pid_t>(-1) && i < 10; ++i )
-			{
-				std::pair<pid_t,int> const P = waitWithTimeout(60 /* timeout */);
-
-				pid_t const wpid = P.first;
-				//int const status = P.second;
-
-				if ( wpid == workpid )
-				{
-					workpid = static_cast<pid_t>(-1);
-
-					RI.outend = outData.tellp();
-					RI.errend = errData.tellp();
-					RI.status = std::numeric_limits<int>::min();
-					RI.serialise(metaOSI);
-					metaOSI.flush();
-
-					outCopy->join();
-					outCopy.reset();
-					errCopy->join();
-					errCopy.reset();
-					outPipe.reset();
-					errPipe.reset();
-
-					outData.flush();
-					errData.flush();
-				}
-			}
-		}
-		if ( workpid != static_cast<pid_t>(-1) )
+		for ( uint64_t s = 0; numrunning && s < sizeof(signals)/sizeof(signals[0]); ++s )
 		{
-			kill(workpid,SIGKILL);
-
-			for ( uint64_t i = 0; workpid != static_cast<pid_t>(-1) && i < 10; ++i )
+			for ( uint64_t l = 0; l < lanes.size(); ++l )
+				// module calls running in threads cannot be interrupted, they are waited for
+				if ( lanes[l]->hasProcess() )
+					kill(lanes[l]->pid,signals[s]);
+
+			// wait up to 10 minutes for the processes to end
+			uint64_t const start = time(0);
+			while ( numrunning && time(0) - start < 600 )
 			{
-				std::pair<pid_t,int> const P = waitWithTimeout(60 /* timeout */);
+				std::vector < std::pair<uint64_t,int> > const V = reapLanes(lanes,pool);
 
-				pid_t const wpid = P.first;
-				//int const status = P.second;
+				for ( uint64_t j = 0; j < V.size(); ++j )
+					lanes[V[j].first]->reap(std::numeric_limits<int>::min());
 
-				if ( wpid == workpid )
-				{
-					workpid = static_cast<pid_t>(-1);
-
-					RI.outend = outData.tellp();
-					RI.errend = errData.tellp();
-					RI.serialise(metaOSI);
-					RI.status = std::numeric_limits<int>::min();
-					metaOSI.flush();
-
-					outCopy->join();
-					outCopy.reset();
-					errCopy->join();
-					errCopy.reset();
-					outPipe.reset();
-					errPipe.reset();
-
-					outData.flush();
-					errData.flush();
-				}
+				uint64_t const finishtime = time(0);
+				for ( uint64_t l = 0; l < lanes.size(); ++l )
+					if ( lanes[l]->finishable(finishtime) )
+					{
+						lanes[l]->finish(metaOSI);
+						lanes[l]->chain.clear();
+						numrunning -= 1;
+					}
+
+				if ( numrunning )
+					waitLanes(watcher,lanes,pool,-1,1000);
 			}
 		}
 	}
 
 	metaOSI.flush();
-	outData.flush();
-	errData.flush();
+	for ( uint64_t l = 0; l < lanes.size(); ++l )
+	{
+		lanes[l]->outFile.flush();
+		lanes[l]->errFile.flush();
+	}
 
 	return EXIT_SUCCESS;
 }
@@ -16,10 +16,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include <runProgram.hpp>
-
-#if defined(__APPLE__)
-#include <crt_externs.h>
-#endif
+#include <Launcher.hpp>
 
 #include <unistd.h>
 #include <string>
@@ -27,102 +24,286 @@
 #include <libmaus2/util/ArgInfo.hpp>
 #include <libmaus2/util/WriteableString.hpp>
 #include <which.hpp>
-#include <libmaus2/util/TempFileRemovalContainer.hpp>
-#include <libmaus2/util/GetFileSize.hpp>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/wait.h>
 
-static char ** getEnviron()
+bool ProgramResult::ok() const
 {
-	#if defined(__APPLE__)
-	return *_NSGetEnviron();
-	#else
-	return environ;
-	#endif
+	return !timedout && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
 }
 
-std::string runProgram(std::vector<std::string> const & args, libmaus2::util::ArgParser const & arg)
+static uint64_t getTimeMs()
 {
-	std::string const tmpprefix = std::string("/tmp/") + libmaus2::util::ArgInfo::getDefaultTmpFileName(arg.progname);
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
 
-	libmaus2::autoarray::AutoArray < libmaus2::util::WriteableString::unique_ptr_type > AW(args.size());
-	for ( uint64_t i = 0; i < args.size(); ++i )
+static void makePipe(int * fd)
+{
+	if ( ::pipe(fd) != 0 )
 	{
-		libmaus2::util::WriteableString::unique_ptr_type tptr(new libmaus2::util::WriteableString(args[i]));
-		AW[i] = UNIQUE_PTR_MOVE(tptr);
+		int const error = errno;
+		libmaus2::exception::LibMausException lme;
+		lme.getStream() << "[E] pipe failed: " << strerror(error) << std::endl;
+		lme.finish();
+		throw lme;
 	}
-	libmaus2::autoarray::AutoArray < char * > AA(args.size()+1);
-	for ( uint64_t i = 0; i < args.size(); ++i )
-		AA[i] = AW[i]->A.begin();
-	AA[args.size()] = 0;
-
-	std::string const prog = which(args[0]);
 
-	std::string const errfile = tmpprefix + "_runprog.err";
-	libmaus2::util::TempFileRemovalContainer::addTempFile(errfile);
-	std::string const outfile = tmpprefix + "_runprog.out";
-	libmaus2::util::TempFileRemovalContainer::addTempFile(outfile);
+	// keep the pipes out of programs started concurrently, the child gets its copies via dup2
+	for ( uint64_t i = 0; i < 2; ++i )
+		::fcntl(fd[i],F_SETFD,FD_CLOEXEC);
+	::fcntl(fd[0],F_SETFL,::fcntl(fd[0],F_GETFL) | O_NONBLOCK);
+}
 
-	pid_t const pid = fork();
+/*
+ * running program with the read ends of its output pipes
+ */
+struct SpawnedProgram
+{
+	pid_t pid;
+	// read ends of the stdout and stderr pipes, -1 after EOF
+	int fd[2];
 
-	if ( pid == static_cast<pid_t>(-1) )
+	SpawnedProgram() : pid(-1)
 	{
-		int const error = errno;
-		libmaus2::exception::LibMausException lme;
-		lme.getStream() << "[E] fork failed: " << strerror(error) << std::endl;
-		lme.finish();
-		throw lme;
+		fd[0] = fd[1] = -1;
 	}
-	if ( pid == 0 )
+
+	void closeFd(uint64_t const i)
 	{
-		int const fdout = ::open(outfile.c_str(),O_CREAT|O_TRUNC|O_RDWR,0600);
-		if ( fdout == -1 )
+		if ( fd[i] != -1 )
 		{
-			int const error = errno;
-			std::cerr << "[E] failed to open " << outfile << ":" << strerror(error) << std::endl;
-			_exit(EXIT_FAILURE);
+			::close(fd[i]);
+			fd[i] = -1;
 		}
-		int const fderr = ::open(errfile.c_str(),O_CREAT|O_TRUNC|O_RDWR,0600);
-		if ( fderr == -1 )
+	}
+};
+
+static pid_t spawnProgram(std::vector<std::string> const & args, int const outfd, int const errfd)
+{
+	LaunchRequest req(args);
+	req.args[0] = which(args[0]);
+	req.outfd = outfd;
+	req.errfd = errfd;
+	return Launcher::spawn(req);
+}
+
+std::vector<ProgramResult> runPrograms(std::vector< std::vector<std::string> > const & Vargs, int64_t const timeout)
+{
+	std::vector<ProgramResult> Vres(Vargs.size());
+	std::vector<SpawnedProgram> Vprog(Vargs.size());
+	uint64_t const deadline = getTimeMs() + (timeout >= 0 ? timeout : 0);
+
+	try
+	{
+		for ( uint64_t i = 0; i < Vargs.size(); ++i )
 		{
-			int const error = errno;
-			std::cerr << "[E] failed to open " << errfile << ":" << strerror(error) << std::endl;
-			_exit(EXIT_FAILURE);
+			int outpipe[2] = { -1, -1 };
+			int errpipe[2] = { -1, -1 };
+
+			try
+			{
+				makePipe(&outpipe[0]);
+				makePipe(&errpipe[0]);
+				Vprog[i].pid = spawnProgram(Vargs[i],outpipe[1],errpipe[1]);
+			}
+			catch(...)
+			{
+				for ( uint64_t j = 0; j < 2; ++j )
+				{
+					if ( outpipe[j] != -1 )
+						::close(outpipe[j]);
+					if ( errpipe[j] != -1 )
+						::close(errpipe[j]);
+				}
+				throw;
+			}
+
+			::close(outpipe[1]);
+			::close(errpipe[1]);
+			Vprog[i].fd[0] = outpipe[0];
+			Vprog[i].fd[1] = errpipe[0];
 		}
 
-		if ( ::close(STDOUT_FILENO) == -1 )
-			_exit(EXIT_FAILURE);
-		if ( ::close(STDERR_FILENO) == -1 )
-			_exit(EXIT_FAILURE);
+		libmaus2::autoarray::AutoArray<char> B(8192,false);
+		bool killed = false;
+
+		while ( true )
+		{
+			std::vector<struct pollfd> Vpoll;
+			std::vector< std::pair<uint64_t,uint64_t> > Vid;
 
-		if ( dup2 ( fdout, STDOUT_FILENO ) == -1 )
-			_exit(EXIT_FAILURE);
-		if ( dup2 ( fderr, STDERR_FILENO ) == -1 )
-			_exit(EXIT_FAILURE);
+			for ( uint64_t i = 0; i < Vprog.size(); ++i )
+				for ( uint64_t j = 0; j < 2; ++j )
+					if ( Vprog[i].fd[j] != -1 )
+					{
+						struct pollfd P;
+						P.fd = Vprog[i].fd[j];
+						P.events = POLLIN;
+						P.revents = 0;
+						Vpoll.push_back(P);
+						Vid.push_back(std::pair<uint64_t,uint64_t>(i,j));
+					}
 
-		execve(prog.c_str(),AA.begin(),getEnviron());
-		_exit(EXIT_FAILURE);
+			if ( ! Vpoll.size() )
+				break;
+
+			int polltimeout = -1;
+			if ( timeout >= 0 && ! killed )
+			{
+				uint64_t const now = getTimeMs();
+				polltimeout = (now >= deadline) ? 0 : static_cast<int>(deadline - now);
+			}
+
+			int const r = ::poll(&Vpoll[0],Vpoll.size(),polltimeout);
+
+			if ( r < 0 )
+			{
+				int const error = errno;
+
+				if ( error == EINTR || error == EAGAIN )
+					continue;
+
+				libmaus2::exception::LibMausException lme;
+				lme.getStream() << "[E] poll failed: " << strerror(error) << std::endl;
+				lme.finish();
+				throw lme;
+			}
+			else if ( r == 0 )
+			{
+				// timeout, kill programs which have not closed their output yet
+				for ( uint64_t i = 0; i < Vprog.size(); ++i )
+					if ( Vprog[i].fd[0] != -1 || Vprog[i].fd[1] != -1 )
+					{
+						::kill(Vprog[i].pid,SIGKILL);
+						Vres[i].timedout = true;
+						// descendants may keep the pipes open
+						Vprog[i].closeFd(0);
+						Vprog[i].closeFd(1);
+					}
+				killed = true;
+				continue;
+			}
+
+			for ( uint64_t k = 0; k < Vpoll.size(); ++k )
+				if ( Vpoll[k].revents )
+				{
+					uint64_t const i = Vid[k].first;
+					uint64_t const j = Vid[k].second;
+					ssize_t const n = ::read(Vprog[i].fd[j],B.begin(),B.size());
+
+					if ( n > 0 )
+					{
+						std::string & S = j ? Vres[i].err : Vres[i].out;
+						S.append(B.begin(),B.begin()+n);
+					}
+					else if ( n == 0 )
+					{
+						Vprog[i].closeFd(j);
+					}
+					else if ( errno != EINTR && errno != EAGAIN )
+					{
+						int const error = errno;
+						libmaus2::exception::LibMausException lme;
+						lme.getStream() << "[E] read failed: " << strerror(error) << std::endl;
+						lme.finish();
+						throw lme;
+					}
+				}
+		}
+	}
+	catch(...)
+	{
+		for ( uint64_t i = 0; i < Vprog.size(); ++i )
+		{
+			Vprog[i].closeFd(0);
+			Vprog[i].closeFd(1);
+
+			if ( Vprog[i].pid != -1 )
+			{
+				int status = 0;
+				::kill(Vprog[i].pid,SIGKILL);
+				while ( waitpid(Vprog[i].pid,&status,0) == -1 && errno == EINTR )
+				{
+				}
+			}
+		}
+		throw;
 	}
 
-	int status = 0;
-	int const r = waitpid(pid,&status,0/*options */);
-	if ( r == -1 )
+	/*
+	 * reap the programs. Programs can close their output and keep running,
+	 * so the deadline applies here as well and programs still running
+	 * after it are killed.
+	 */
+	std::vector<bool> Vreaped(Vprog.size(),false);
+	uint64_t numreaped = 0;
+	bool killedall = false;
+
+	while ( true )
 	{
-		int const error = errno;
-		libmaus2::exception::LibMausException lme;
-		lme.getStream() << "[E] waitpid failed: " << strerror(error) << std::endl;
-		lme.finish();
-		throw lme;
+		for ( uint64_t i = 0; i < Vprog.size(); ++i )
+			if ( ! Vreaped[i] )
+			{
+				int status = 0;
+				pid_t const r = waitpid(Vprog[i].pid,&status,WNOHANG);
+
+				if ( r == Vprog[i].pid )
+				{
+					Vres[i].status = status;
+					Vreaped[i] = true;
+					numreaped += 1;
+				}
+				else if ( r == -1 && errno != EINTR )
+				{
+					int const error = errno;
+					libmaus2::exception::LibMausException lme;
+					lme.getStream() << "[E] waitpid failed: " << strerror(error) << std::endl;
+					lme.finish();
+					throw lme;
+				}
+			}
+
+		if ( numreaped == Vprog.size() )
+			break;
+
+		if ( timeout >= 0 && ! killedall && getTimeMs() >= deadline )
+		{
+			for ( uint64_t i = 0; i < Vprog.size(); ++i )
+				if ( ! Vreaped[i] )
+				{
+					::kill(Vprog[i].pid,SIGKILL);
+					Vres[i].timedout = true;
+				}
+			killedall = true;
+		}
+		else
+		{
+			// wait 10 milliseconds
+			::poll(NULL,0,10);
+		}
 	}
 
-	if ( WIFEXITED(status) && (WEXITSTATUS(status) == 0) )
+	return Vres;
+}
+
+std::string runProgram(std::vector<std::string> const & args, libmaus2::util::ArgParser const & /* arg */, int64_t const timeout)
+{
+	std::vector< std::vector<std::string> > Vargs(1,args);
+	ProgramResult const res = runPrograms(Vargs,timeout)[0];
+
+	if ( res.ok() )
 	{
-		// std::cerr << "[V] " << prog << " finished ok" << "\n";
+		// std::cerr << "[V] " << args[0] << " finished ok" << "\n";
 	}
 	else
 	{
@@ -131,43 +312,23 @@ std::string runProgram(std::vector<std::string> const & args, libmaus2::util::Ar
 
 		errstr << "[E] " << args[0] << " failed" << std::endl;
 
-		if ( WIFEXITED(status) )
+		if ( res.timedout )
 		{
-			errstr << "[E] exit code " << WEXITSTATUS(status) << std::endl;
+			errstr << "[E] killed after timeout of " << timeout << " milliseconds" << std::endl;
 		}
-
-		if ( libmaus2::util::GetFileSize::fileExists(errfile) )
+		else if ( WIFEXITED(res.status) )
 		{
-			libmaus2::aio::InputStreamInstance ISI(errfile);
-			while ( ISI )
-			{
-				std::string line;
-				std::getline(ISI,line);
-				if ( ISI )
-					errstr << line << std::endl;
-			}
+			errstr << "[E] exit code " << WEXITSTATUS(res.status) << std::endl;
 		}
 
-		lme.finish();
-
-		throw lme;
-	}
+		errstr << res.err;
+		if ( res.err.size() && res.err[res.err.size()-1] != '\n' )
+			errstr << std::endl;
 
-	if ( !libmaus2::util::GetFileSize::fileExists(outfile) )
-	{
-		libmaus2::exception::LibMausException lme;
-		lme.getStream() << "[E] output file " << outfile << "  does not exist." << std::endl;
 		lme.finish();
+
 		throw lme;
 	}
 
-	libmaus2::aio::InputStreamInstance ISI(outfile);
-	std::istreambuf_iterator<char> ia(ISI);
-	std::istreambuf_iterator<char> ib;
-	std::string const res(ia,ib);
-
-	libmaus2::aio::FileRemoval::removeFile(errfile);
-	libmaus2::aio::FileRemoval::removeFile(outfile);
-
-	return res;
+	return res.out;
 }
@@ -20,5 +20,29 @@
 
 #include <libmaus2/util/ArgParser.hpp>
 
-std::string runProgram(std::vector<std::string> const & args, libmaus2::util::ArgParser const & arg);
+/*
+ * outcome of running a program. status is the value reported by waitpid,
+ * timedout is set if the program was killed after exceeding the timeout.
+ */
+struct ProgramResult
+{
+	int status;
+	bool timedout;
+	std::string out;
+	std::string err;
+
+	ProgramResult() : status(0), timedout(false) {}
+
+	bool ok() const;
+};
+
+/*
+ * run the given programs concurrently and collect their standard output
+ * and error channels. Programs still running after timeout milliseconds
+ * are killed, a negative timeout waits indefinitely.
+ */
+std::vector<ProgramResult> runPrograms(std::vector< std::vector<std::string> > const & Vargs, int64_t const timeout = -1);
+
+// run program, return its standard output and throw an exception if it fails
+std::string runProgram(std::vector<std::string> const & args, libmaus2::util::ArgParser const & arg, int64_t const timeout = -1);
 #endif